@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <mutex>
+#include "accumulation.h"
+#include "color.h"
+
+void initialize_sample_buffers(sample_buffers& buffers, int width, int height, int nr_buffers, const reconstruction_filter& filter) {
+	buffers.width = width;
+	buffers.height = height;
+	buffers.nr_buffers = std::max(nr_buffers, 1);
+	buffers.row_offset = 0;
+	buffers.column_offset = 0;
+	buffers.filter = filter;
+	buffers.sums.assign(static_cast<size_t>(width) * height * buffers.nr_buffers, color(0.0, 0.0, 0.0));
+	buffers.weights.assign(static_cast<size_t>(width) * height * buffers.nr_buffers, 0.0);
+}
+
+// Buffers of a tile, extended by the reach of the filter on each side and clipped to the image
+void initialize_tile_sample_buffers(sample_buffers& tile, const sample_buffers& image, int row_begin, int row_end, int column_begin, int column_end) {
+	int reach = filter_reach(image.filter);
+	int first_row = std::max(row_begin - reach, 0);
+	int first_column = std::max(column_begin - reach, 0);
+	initialize_sample_buffers(tile, std::min(column_end + reach, image.width) - first_column, std::min(row_end + reach, image.height) - first_row, image.nr_buffers, image.filter);
+	tile.row_offset = first_row;
+	tile.column_offset = first_column;
+}
+
+// Pixels on each side of the pixel of a sample that the filter reaches, samples lie up to half a pixel from the pixel center
+// Filters wider than the largest reach are cut off there
+const int max_filter_reach = 8;
+
+int filter_reach(const reconstruction_filter& filter) {
+	if (filter.filter_type == BOX_FILTER) {
+		return 0;
+	}
+	return std::min(std::max(0, static_cast<int>(glm::ceil(filter.radius + 0.5)) - 1), max_filter_reach);
+}
+
+// Separable filter weight at a distance in pixels from the sample
+double filter_weight(const reconstruction_filter& filter, double distance) {
+	double x = glm::abs(distance);
+	if (x >= filter.radius) {
+		return 0.0;
+	}
+
+	switch (filter.filter_type) {
+	case GAUSSIAN_FILTER: {
+		double sigma = filter.radius / 3.0;
+		return glm::exp(-x * x / (2.0 * sigma * sigma)) - glm::exp(-filter.radius * filter.radius / (2.0 * sigma * sigma));
+	}
+	case MITCHELL_FILTER: {
+		const double b = 1.0 / 3.0;
+		const double c = 1.0 / 3.0;
+		x = 2.0 * x / filter.radius; // The cubic is defined on [0, 2]
+		if (x > 1.0) {
+			return ((-b - 6.0 * c) * x * x * x + (6.0 * b + 30.0 * c) * x * x + (-12.0 * b - 48.0 * c) * x + (8.0 * b + 24.0 * c)) / 6.0;
+		}
+		return ((12.0 - 9.0 * b - 6.0 * c) * x * x * x + (-18.0 + 12.0 * b + 6.0 * c) * x * x + (6.0 - 2.0 * b)) / 6.0;
+	}
+	case BLACKMAN_HARRIS_FILTER: {
+		double phase = pi * (distance / filter.radius + 1.0); // The window over [0, 2 pi], centered on the sample
+		return 0.35875 - 0.48829 * glm::cos(phase) + 0.14128 * glm::cos(2.0 * phase) - 0.01168 * glm::cos(3.0 * phase);
+	}
+	default:
+		return 1.0;
+	}
+}
+
+// Add a sample taken at an offset in [-0.5, 0.5) from the center of pixel i, j to the pixels the filter reaches
+// Pixels outside the buffers are skipped, at the image border the weights of the remaining pixels still normalize them
+void splat_sample(sample_buffers& buffers, int i, int j, double offset_x, double offset_y, int buffer, const color& sample) {
+	if (buffers.filter.filter_type == BOX_FILTER) {
+		size_t index = (static_cast<size_t>(i - buffers.row_offset) * buffers.width + (j - buffers.column_offset)) * buffers.nr_buffers + buffer;
+		buffers.sums[index] += sample;
+		buffers.weights[index] += 1.0;
+		return;
+	}
+
+	// Weights of the rows and columns around the sample, a splat costs 2 * (2 * reach + 1) filter evaluations
+	int reach = filter_reach(buffers.filter);
+	double row_weights[2 * max_filter_reach + 1];
+	double column_weights[2 * max_filter_reach + 1];
+	for (int k = -reach; k <= reach; k++) {
+		row_weights[k + reach] = filter_weight(buffers.filter, k - offset_y);
+		column_weights[k + reach] = filter_weight(buffers.filter, k - offset_x);
+	}
+
+	for (int di = -reach; di <= reach; di++) {
+		int row = i + di - buffers.row_offset;
+		if (row < 0 || row >= buffers.height || row_weights[di + reach] == 0.0) {
+			continue;
+		}
+		for (int dj = -reach; dj <= reach; dj++) {
+			int column = j + dj - buffers.column_offset;
+			double weight = row_weights[di + reach] * column_weights[dj + reach];
+			if (column < 0 || column >= buffers.width || weight == 0.0) {
+				continue;
+			}
+			size_t index = (static_cast<size_t>(row) * buffers.width + column) * buffers.nr_buffers + buffer;
+			buffers.sums[index] += weight * sample;
+			buffers.weights[index] += weight;
+		}
+	}
+}
+
+// Tiles next to each other overlap in the border their filters reach, so merging is serialized
+static std::mutex merge_mutex;
+
+void merge_sample_buffers(sample_buffers& image, const sample_buffers& tile) {
+	std::lock_guard<std::mutex> lock(merge_mutex);
+	size_t row_length = static_cast<size_t>(tile.width) * tile.nr_buffers;
+	for (int row = 0; row < tile.height; row++) {
+		size_t tile_index = static_cast<size_t>(row) * row_length;
+		size_t image_index = (static_cast<size_t>(row + tile.row_offset) * image.width + tile.column_offset) * image.nr_buffers;
+		for (size_t k = 0; k < row_length; k++) {
+			image.sums[image_index + k] += tile.sums[tile_index + k];
+			image.weights[image_index + k] += tile.weights[tile_index + k];
+		}
+	}
+}
+
+// Gini index of luminances sorted in increasing order, 0.0 when all are equal and towards 1.0 when one holds everything
+double gini_index(const std::vector<color>& sorted_values) {
+	int n = sorted_values.size();
+	double total = 0.0;
+	double weighted = 0.0;
+	for (int i = 0; i < n; i++) {
+		double value = luminance(sorted_values[i]);
+		total += value;
+		weighted += (2.0 * (i + 1) - n - 1) * value;
+	}
+	return (total > 0.0) ? weighted / (n * total) : 0.0;
+}
+
+// Pixels whose buffer means are unequal beyond the threshold take the median of the means ordered by luminance, an even number of buffers averages the middle two
+// Other pixels keep the plain mean, the median alone darkens every pixel whose light mostly arrives through rare paths (Buisine et al. 2021)
+// Means are weighted by the filter, with the box filter the weights are the sample counts
+// The result is scaled so pixels keep the sum the color writer divides by samples per pixel
+void resolve_sample_buffers(const sample_buffers& buffers, double gini_threshold, double scale, std::vector<std::vector<color>>& pixel_colors) {
+	std::vector<color> means;
+	for (int i = 0; i < buffers.height; i++) {
+		for (int j = 0; j < buffers.width; j++) {
+			size_t first = (static_cast<size_t>(i) * buffers.width + j) * buffers.nr_buffers;
+			color sum = color(0.0, 0.0, 0.0);
+			double weight = 0.0;
+			means.clear();
+			for (int buffer = 0; buffer < buffers.nr_buffers; buffer++) {
+				sum += buffers.sums[first + buffer];
+				weight += buffers.weights[first + buffer];
+				if (buffers.weights[first + buffer] > 0.0) {
+					means.push_back(buffers.sums[first + buffer] / buffers.weights[first + buffer]); // Buffers beyond the sample count stay empty
+				}
+			}
+
+			int nr_means = means.size();
+			std::sort(means.begin(), means.end(), [](const color& a, const color& b) { return luminance(a) < luminance(b); });
+			if (nr_means > 0 && gini_index(means) > gini_threshold) {
+				color median = (nr_means % 2 == 1) ? means[nr_means / 2] : 0.5 * (means[nr_means / 2 - 1] + means[nr_means / 2]);
+				pixel_colors[i][j] = median * scale;
+			}
+			else {
+				pixel_colors[i][j] = (weight > 0.0) ? sum / weight * scale : color(0.0, 0.0, 0.0);
+			}
+			pixel_colors[i][j] = glm::max(pixel_colors[i][j], color(0.0, 0.0, 0.0)); // Negative filter lobes can ring below zero next to bright pixels
+		}
+	}
+}
+
+// Clamped paths and the luminance they lost, summed over all threads once per pixel
+static std::mutex clamp_statistics_mutex;
+static long long clamp_statistics_samples = 0;
+static long long clamp_statistics_clamped = 0;
+static double clamp_statistics_removed = 0.0;
+static double clamp_statistics_total = 0.0;
+
+void reset_clamp_statistics() {
+	std::lock_guard<std::mutex> lock(clamp_statistics_mutex);
+	clamp_statistics_samples = 0;
+	clamp_statistics_clamped = 0;
+	clamp_statistics_removed = 0.0;
+	clamp_statistics_total = 0.0;
+}
+
+// Scale a path sample down to the largest luminance allowed, 0.0 or less turns clamping off
+// The caller keeps the counts for its pixel and records them once
+color clamp_sample(const color& sample, double max_luminance, long long& nr_clamped, double& removed_luminance, double& total_luminance) {
+	double sample_luminance = luminance(sample);
+	total_luminance += sample_luminance;
+	if (max_luminance <= 0.0 || sample_luminance <= max_luminance) {
+		return sample;
+	}
+
+	nr_clamped++;
+	removed_luminance += sample_luminance - max_luminance;
+	return sample * (max_luminance / sample_luminance);
+}
+
+void record_clamp_statistics(long long nr_samples, long long nr_clamped, double removed_luminance, double total_luminance) {
+	std::lock_guard<std::mutex> lock(clamp_statistics_mutex);
+	clamp_statistics_samples += nr_samples;
+	clamp_statistics_clamped += nr_clamped;
+	clamp_statistics_removed += removed_luminance;
+	clamp_statistics_total += total_luminance;
+}
+
+void print_clamp_statistics(std::ostream& os) {
+	std::lock_guard<std::mutex> lock(clamp_statistics_mutex);
+	if (clamp_statistics_samples == 0) {
+		return;
+	}
+
+	double clamped_fraction = static_cast<double>(clamp_statistics_clamped) / static_cast<double>(clamp_statistics_samples);
+	double removed_fraction = (clamp_statistics_total > 0.0) ? clamp_statistics_removed / clamp_statistics_total : 0.0;
+	os << "Clamped path samples: " << clamp_statistics_clamped << " of " << clamp_statistics_samples << " (" << 100.0 * clamped_fraction << "%), "
+		<< 100.0 * removed_fraction << "% of the sampled luminance removed" << std::endl;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <ostream>
+#include "util.h"
+
+// Filter samples are weighted by when they are reconstructed into pixels
+enum filter_enum {
+	BOX_FILTER, // Each sample counts fully for the pixel it was taken in and nowhere else
+	GAUSSIAN_FILTER, // Gaussian with a standard deviation of a third of the radius, shifted down to reach zero at the radius
+	MITCHELL_FILTER, // Mitchell-Netravali cubic with B = C = 1/3, its negative lobes sharpen edges
+	BLACKMAN_HARRIS_FILTER // Four term Blackman-Harris window, smooth like the gaussian with less blur
+};
+
+struct reconstruction_filter {
+	filter_enum filter_type = BOX_FILTER;
+	double radius = 2.0; // Distance in pixels at which the weight reaches zero, the box filter always covers its own pixel
+};
+
+// Samples of each pixel are summed into interleaved sub-buffers, primary sample n of a pixel goes to buffer n % nr_buffers
+// Pixels with a firefly are resolved to the median of the buffer means, so a rare huge sample only moves the mean of its own buffer
+// Samples are splatted to every pixel the filter reaches with the filter weight, which each buffer sums next to the weighted colors
+// Tiles accumulate into buffers of their own that cover the tile and the border its filter reaches, merged into the image buffers once done
+struct sample_buffers {
+	int width = 0;
+	int height = 0;
+	int nr_buffers = 1;
+	int row_offset = 0; // Image row and column of the first pixel of the buffers
+	int column_offset = 0;
+	reconstruction_filter filter;
+	std::vector<color> sums; // nr_buffers weighted sums for each pixel, row by row
+	std::vector<double> weights; // nr_buffers filter weight sums for each pixel
+};
+
+void initialize_sample_buffers(sample_buffers& buffers, int width, int height, int nr_buffers, const reconstruction_filter& filter);
+void initialize_tile_sample_buffers(sample_buffers& tile, const sample_buffers& image, int row_begin, int row_end, int column_begin, int column_end);
+int filter_reach(const reconstruction_filter& filter);
+void splat_sample(sample_buffers& buffers, int i, int j, double offset_x, double offset_y, int buffer, const color& sample);
+void merge_sample_buffers(sample_buffers& image, const sample_buffers& tile);
+void resolve_sample_buffers(const sample_buffers& buffers, double gini_threshold, double scale, std::vector<std::vector<color>>& pixel_colors);
+
+void reset_clamp_statistics();
+color clamp_sample(const color& sample, double max_luminance, long long& nr_clamped, double& removed_luminance, double& total_luminance);
+void record_clamp_statistics(long long nr_samples, long long nr_clamped, double removed_luminance, double total_luminance);
+void print_clamp_statistics(std::ostream& os);
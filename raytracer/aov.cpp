@@ -0,0 +1,136 @@
+#include <iostream>
+#include <algorithm>
+#include "aov.h"
+#include "image_output.h"
+
+const char* aov_name(aov_enum aov) {
+	switch (aov) {
+	case AOV_NORMAL:
+		return "normal";
+	case AOV_ALBEDO:
+		return "albedo";
+	case AOV_DEPTH:
+		return "depth";
+	case AOV_OBJECT_INDEX:
+		return "object_index";
+	case AOV_MATERIAL:
+		return "material";
+	case AOV_SAMPLE_COUNT:
+		return "sample_count";
+	default:
+		return "unknown";
+	}
+}
+
+void initialize_aov_buffers(aov_buffers& buffers, int width, int height, int enabled) {
+	size_t nr_pixels = static_cast<size_t>(width) * height;
+	buffers.width = width;
+	buffers.height = height;
+	buffers.enabled = enabled;
+	buffers.normals.assign((enabled & AOV_NORMAL) ? nr_pixels : 0, glm::dvec3(0.0, 0.0, 0.0));
+	buffers.albedos.assign((enabled & AOV_ALBEDO) ? nr_pixels : 0, color(0.0, 0.0, 0.0));
+	buffers.depths.assign((enabled & AOV_DEPTH) ? nr_pixels : 0, 0.0);
+	buffers.object_indices.assign((enabled & AOV_OBJECT_INDEX) ? nr_pixels : 0, -1);
+	buffers.materials.assign((enabled & AOV_MATERIAL) ? nr_pixels : 0, -1);
+	buffers.sample_counts.assign(enabled ? nr_pixels : 0, 0);
+}
+
+// Each pixel is rendered by a single thread, so its aovs are written without locking
+// Normal, albedo and depth are summed and averaged once the image is done, ids can't be averaged and keep the first sample
+void record_first_hit(aov_buffers& buffers, int i, int j, const hit_record& rec, double distance) {
+	size_t pixel = static_cast<size_t>(i) * buffers.width + j;
+	if (buffers.enabled & AOV_NORMAL) {
+		buffers.normals[pixel] += rec.normal;
+	}
+	if (buffers.enabled & AOV_ALBEDO) {
+		buffers.albedos[pixel] += rec.material_color;
+	}
+	if (buffers.enabled & AOV_DEPTH) {
+		buffers.depths[pixel] += distance;
+	}
+	if ((buffers.enabled & AOV_OBJECT_INDEX) && buffers.sample_counts[pixel] == 0) {
+		buffers.object_indices[pixel] = rec.object_index;
+	}
+	if ((buffers.enabled & AOV_MATERIAL) && buffers.sample_counts[pixel] == 0) {
+		buffers.materials[pixel] = rec.material;
+	}
+	buffers.sample_counts[pixel]++;
+}
+
+void record_first_miss(aov_buffers& buffers, int i, int j) {
+	size_t pixel = static_cast<size_t>(i) * buffers.width + j;
+	if (buffers.enabled & AOV_ALBEDO) {
+		buffers.albedos[pixel] += color(1.0, 1.0, 1.0);
+	}
+	buffers.sample_counts[pixel]++;
+}
+
+// Sums to means, the mean normal is normalized again so edge pixels get the direction in between both sides
+void resolve_aov_buffers(aov_buffers& buffers) {
+	for (size_t pixel = 0; pixel < buffers.sample_counts.size(); pixel++) {
+		double scale = 1.0 / static_cast<double>(std::max(1, buffers.sample_counts[pixel]));
+		if (buffers.enabled & AOV_NORMAL) {
+			double length = glm::length(buffers.normals[pixel]);
+			buffers.normals[pixel] = (length > 1e-8) ? buffers.normals[pixel] / length : glm::dvec3(0.0, 0.0, 0.0);
+		}
+		if (buffers.enabled & AOV_ALBEDO) {
+			buffers.albedos[pixel] *= scale;
+		}
+		if (buffers.enabled & AOV_DEPTH) {
+			buffers.depths[pixel] *= scale;
+		}
+	}
+}
+
+// Channel values of an aov at a pixel, ids and counts are stored as floats, which hold them exactly
+int aov_channels(const aov_buffers& buffers, aov_enum aov, size_t pixel, float* values) {
+	switch (aov) {
+	case AOV_NORMAL:
+		values[0] = static_cast<float>(buffers.normals[pixel].x);
+		values[1] = static_cast<float>(buffers.normals[pixel].y);
+		values[2] = static_cast<float>(buffers.normals[pixel].z);
+		return 3;
+	case AOV_ALBEDO:
+		values[0] = static_cast<float>(buffers.albedos[pixel].x);
+		values[1] = static_cast<float>(buffers.albedos[pixel].y);
+		values[2] = static_cast<float>(buffers.albedos[pixel].z);
+		return 3;
+	case AOV_DEPTH:
+		values[0] = static_cast<float>(buffers.depths[pixel]);
+		return 1;
+	case AOV_OBJECT_INDEX:
+		values[0] = static_cast<float>(buffers.object_indices[pixel]);
+		return 1;
+	case AOV_MATERIAL:
+		values[0] = static_cast<float>(buffers.materials[pixel]);
+		return 1;
+	case AOV_SAMPLE_COUNT:
+		values[0] = static_cast<float>(buffers.sample_counts[pixel]);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+// Each requested aov is written as a portable float map, base_name_aov.pfm, so compositing gets the exact values instead of 8 bit colors
+// Three channel aovs are color maps, the others grayscale
+void write_aov_images(const aov_buffers& buffers, int aovs, const std::string& base_name) {
+	for (int bit = 0; (1 << bit) <= ALL_AOVS; bit++) {
+		aov_enum aov = static_cast<aov_enum>(1 << bit);
+		if (!(aovs & buffers.enabled & aov)) {
+			continue;
+		}
+
+		float values[3];
+		int nr_channels = aov_channels(buffers, aov, 0, values);
+		std::vector<float> image(static_cast<size_t>(buffers.width) * buffers.height * nr_channels);
+		for (size_t pixel = 0; pixel < buffers.sample_counts.size(); pixel++) {
+			aov_channels(buffers, aov, pixel, &image[pixel * nr_channels]);
+		}
+
+		std::vector<unsigned char> file;
+		encode_float_map(image, buffers.width, buffers.height, nr_channels, file);
+		std::string path = base_name + "_" + aov_name(aov) + ".pfm";
+		std::cout << (write_file(path, file) ? "Wrote " : "Failed to write ") << path << std::endl;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <string>
+#include "util.h"
+#include "geometry.h"
+
+// Arbitrary output variables, auxiliary images of the first hit of each camera path written next to the beauty image
+enum aov_enum {
+	AOV_NORMAL = 1 << 0, // Mean surface normal, facing the camera
+	AOV_ALBEDO = 1 << 1, // Mean material color
+	AOV_DEPTH = 1 << 2, // Mean distance from the camera
+	AOV_OBJECT_INDEX = 1 << 3, // Scene object of the first sample, -1 for the background
+	AOV_MATERIAL = 1 << 4, // Material enum of the first sample, -1 for the background
+	AOV_SAMPLE_COUNT = 1 << 5, // Camera samples taken
+	ALL_AOVS = AOV_NORMAL | AOV_ALBEDO | AOV_DEPTH | AOV_OBJECT_INDEX | AOV_MATERIAL | AOV_SAMPLE_COUNT
+};
+
+// Row by row buffers of the enabled aovs, disabled ones stay empty, the sample count is kept whenever any aov is enabled
+// Camera rays that leave the scene record no normal, a white albedo and a distance of zero
+struct aov_buffers {
+	int width = 0;
+	int height = 0;
+	int enabled = 0; // Bits of aov_enum
+	std::vector<glm::dvec3> normals;
+	std::vector<color> albedos;
+	std::vector<double> depths;
+	std::vector<int> object_indices;
+	std::vector<int> materials;
+	std::vector<int> sample_counts;
+};
+
+const char* aov_name(aov_enum aov);
+void initialize_aov_buffers(aov_buffers& buffers, int width, int height, int enabled);
+void record_first_hit(aov_buffers& buffers, int i, int j, const hit_record& rec, double distance);
+void record_first_miss(aov_buffers& buffers, int i, int j);
+void resolve_aov_buffers(aov_buffers& buffers);
+void write_aov_images(const aov_buffers& buffers, int aovs, const std::string& base_name);
@@ -0,0 +1,564 @@
+#include <vector>
+#include <future>
+#include <atomic>
+#include <algorithm>
+#include "bidirectional.h"
+#include "direct_lighting.h"
+#include "geometry.h"
+#include "material.h"
+#include "camera.h"
+#include "color.h"
+#include "util.h"
+#include "glm.hpp"
+
+// Bidirectional path tracing
+// Every pixel sample traces one subpath from the camera and one from a light, then connects every pair of their vertices
+// Each connection is one way of sampling the same path, the balance heuristic weights them by how likely each strategy was to produce it
+// Connections of light subpaths straight to the camera can land on any pixel and are splatted into a shared buffer
+// Lambertian vertices are the only ones that can be connected to, dielectric, metal and medium scattering is followed but never connected through
+
+void initialize_splat_buffer(splat_buffer& buffer, int width, int height) {
+	buffer.width = width;
+	buffer.height = height;
+	buffer.values.reset(new std::atomic<double>[3 * width * height]);
+	for (int k = 0; k < 3 * width * height; k++) {
+		buffer.values[k].store(0.0, std::memory_order_relaxed);
+	}
+}
+
+// Compare-and-swap loop, atomic adds on doubles aren't available before C++20
+void atomic_add(std::atomic<double>& target, double value) {
+	double expected = target.load(std::memory_order_relaxed);
+	while (!target.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed)) {
+	}
+}
+
+void splat(splat_buffer& buffer, int i, int j, const color& contribution) {
+	int offset = 3 * (i * buffer.width + j);
+	atomic_add(buffer.values[offset], contribution.x);
+	atomic_add(buffer.values[offset + 1], contribution.y);
+	atomic_add(buffer.values[offset + 2], contribution.z);
+}
+
+// Add the splatted light tracing contributions to the camera samples, both are sums over samples per pixel
+void resolve_splat_buffer(const splat_buffer& buffer, std::vector<std::vector<color>>& pixel_colors) {
+	for (int i = 0; i < buffer.height; i++) {
+		for (int j = 0; j < buffer.width; j++) {
+			int offset = 3 * (i * buffer.width + j);
+			pixel_colors[i][j] += color(buffer.values[offset].load(), buffer.values[offset + 1].load(), buffer.values[offset + 2].load());
+		}
+	}
+}
+
+// Lights are picked in proportion to their power and sampled uniformly by area, so every point on a light has a fixed area density
+bidirectional_lights build_bidirectional_lights(const std::vector<scene_object>& scene_objects) {
+	bidirectional_lights lights;
+	for (const scene_object& obj : scene_objects) {
+		if (object_material(obj).material == LIGHT) {
+			lights.light_objects.push_back(obj);
+		}
+	}
+
+	lights.distribution = build_light_distribution(lights.light_objects);
+	lights.object_densities.assign(scene_objects.size(), 0.0);
+
+	if (lights.distribution.total_weight <= 0.0) {
+		return lights;
+	}
+
+	int light_index = 0;
+	for (int i = 0; i < static_cast<int>(scene_objects.size()); i++) {
+		if (object_material(scene_objects[i]).material == LIGHT) {
+			double light_probability = lights.distribution.weights[light_index] / lights.distribution.total_weight;
+			lights.object_densities[i] = light_probability / light_area(scene_objects[i]);
+			light_index++;
+		}
+	}
+
+	return lights;
+}
+
+// Area of the viewport at unit distance from the camera
+double film_area(const camera& camera) {
+	double viewport_width = glm::length(camera.pixel_delta_u) * static_cast<double>(camera.image_width);
+	double viewport_height = glm::length(camera.pixel_delta_v) * static_cast<double>(camera.image_height);
+	return viewport_width * viewport_height / (camera.focus_distance * camera.focus_distance);
+}
+
+// Pixel a point projects to through the camera center, returns false if it is behind the camera or outside the image
+bool raster_position(const camera& camera, const point3& point, int& i, int& j) {
+	glm::dvec3 direction = point - camera.center;
+	double forward = glm::dot(direction, -camera.w);
+	if (forward <= 0.0) {
+		return false;
+	}
+
+	point3 viewport_point = camera.center + direction * (camera.focus_distance / forward);
+	glm::dvec3 offset = viewport_point - (camera.pixel_00_loc - 0.5 * (camera.pixel_delta_u + camera.pixel_delta_v));
+	double x = glm::dot(offset, camera.pixel_delta_u) / glm::dot(camera.pixel_delta_u, camera.pixel_delta_u);
+	double y = glm::dot(offset, camera.pixel_delta_v) / glm::dot(camera.pixel_delta_v, camera.pixel_delta_v);
+
+	if (x < 0.0 || y < 0.0 || x >= static_cast<double>(camera.image_width) || y >= static_cast<double>(camera.image_height)) {
+		return false;
+	}
+
+	j = static_cast<int>(x);
+	i = static_cast<int>(y);
+	return true;
+}
+
+// Solid angle density of camera ray directions over the whole image, camera rays are uniform over the viewport
+double camera_direction_pdf(const camera& camera, const glm::dvec3& direction) {
+	glm::dvec3 unit_direction = glm::normalize(direction);
+	double cosine = glm::dot(unit_direction, -camera.w);
+
+	int i, j;
+	if (cosine <= 0.0 || !raster_position(camera, camera.center + unit_direction, i, j)) {
+		return 0.0;
+	}
+
+	return 1.0 / (film_area(camera) * cosine * cosine * cosine);
+}
+
+// Turn a solid angle density at one vertex into an area density at the next
+double convert_density(double pdf_direction, const path_vertex& from, const path_vertex& to) {
+	glm::dvec3 offset = to.point - from.point;
+	double distance_squared = glm::dot(offset, offset);
+	if (distance_squared <= 0.0) {
+		return 0.0;
+	}
+
+	double pdf = pdf_direction / distance_squared;
+	if (to.type != CAMERA_VERTEX) {
+		pdf *= glm::abs(glm::dot(to.normal, offset)) / glm::sqrt(distance_squared);
+	}
+	return pdf;
+}
+
+// Lambertian vertices scatter into the hemisphere they were reached from, every other material is never evaluated
+bool connectable(const path_vertex& vertex) {
+	return vertex.type == SURFACE_VERTEX && vertex.material == LAMBERTIAN && !vertex.delta;
+}
+
+color vertex_bsdf(const path_vertex& vertex, const point3& previous, const point3& next) {
+	if (vertex.material != LAMBERTIAN) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	if (glm::dot(vertex.normal, previous - vertex.point) <= 0.0 || glm::dot(vertex.normal, next - vertex.point) <= 0.0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	return vertex.material_color / pi;
+}
+
+// Cosine weighted emission of lights
+double emission_pdf(const path_vertex& vertex, const path_vertex& next) {
+	double cosine = glm::dot(vertex.normal, glm::normalize(next.point - vertex.point));
+	if (cosine <= 0.0) {
+		return 0.0;
+	}
+
+	return convert_density(cosine / pi, vertex, next);
+}
+
+// Area density of sampling next from vertex, given the vertex before it on the same path
+double vertex_pdf(const path_vertex& vertex, const path_vertex* previous, const path_vertex& next, const camera& camera) {
+	switch (vertex.type) {
+	case CAMERA_VERTEX:
+		return convert_density(camera_direction_pdf(camera, next.point - vertex.point), vertex, next);
+	case LIGHT_VERTEX:
+		return emission_pdf(vertex, next);
+	default:
+		if (vertex.material == LIGHT) {
+			return emission_pdf(vertex, next);
+		}
+
+		if (previous == nullptr || vertex.material != LAMBERTIAN) {
+			return 0.0;
+		}
+
+		glm::dvec3 direction = glm::normalize(next.point - vertex.point);
+		if (glm::dot(vertex.normal, previous->point - vertex.point) <= 0.0 || glm::dot(vertex.normal, direction) <= 0.0) {
+			return 0.0;
+		}
+
+		return convert_density(glm::dot(vertex.normal, direction) / pi, vertex, next);
+	}
+}
+
+// Extend a subpath by tracing and scattering until it leaves the scene, hits a light, gets absorbed or is long enough
+// Camera subpaths that leave the scene pick up the background, no other strategy can sample it
+void random_walk(ray walk_ray, color beta, double pdf_direction, int max_vertices, bool from_camera, std::vector<path_vertex>& path, color& escaped_color, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color) {
+	while (static_cast<int>(path.size()) < max_vertices) {
+		hit_record rec;
+		if (!find_intersection(walk_ray, interval{ 0.001, infinity }, rec, scene_objects)) {
+			if (from_camera) {
+				escaped_color += beta * background_radiance(camera.environment.get(), walk_ray.direction, background_color);
+			}
+			break;
+		}
+
+		path_vertex vertex;
+		vertex.type = SURFACE_VERTEX;
+		vertex.point = rec.point;
+		vertex.normal = rec.normal;
+		vertex.material = rec.material;
+		vertex.material_color = rec.material_color;
+		vertex.beta = beta;
+		vertex.object_index = rec.object_index;
+		vertex.pdf_forward = convert_density(pdf_direction, path.back(), vertex);
+		path.push_back(vertex);
+
+		// Lights don't reflect, a subpath ends on them
+		if (rec.material == LIGHT || static_cast<int>(path.size()) >= max_vertices) {
+			break;
+		}
+
+		ray scattered_ray;
+		color attenuation;
+		double pdf_reverse_direction = 0.0;
+		bool delta = true;
+
+		switch (rec.material) {
+		case LAMBERTIAN:
+			lambertian_scatter(walk_ray, rec, attenuation, scattered_ray, pdf_direction);
+			pdf_reverse_direction = glm::abs(glm::dot(rec.normal, glm::normalize(walk_ray.direction))) / pi;
+			delta = false;
+			break;
+		case METAL:
+			if (!metallic_reflection(walk_ray, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+				return;
+			}
+			break;
+		case DIELECTRIC:
+			dielectric_refraction(walk_ray, rec, attenuation, scattered_ray, rec.refraction_index);
+
+			// Camera paths don't scale radiance by the squared refraction ratio when they refract
+			// Light subpaths take the inverse scale instead, so both agree on lights embedded in glass
+			if (!from_camera && glm::dot(scattered_ray.direction, rec.normal) < 0.0) {
+				double refraction_ratio = rec.outward_face ? (1.0 / rec.refraction_index) : rec.refraction_index;
+				attenuation *= refraction_ratio * refraction_ratio;
+			}
+			break;
+		case CONSTANT_DENSITY_MEDIUM_MATERIAL:
+			constant_density_medium_scatter(rec, attenuation, scattered_ray);
+			break;
+		default:
+			return;
+		}
+
+		// Lambertian scattering is cosine weighted, so its throughput is just the albedo
+		if (delta || pdf_direction <= 0.0) {
+			path.back().delta = true;
+			pdf_direction = 0.0;
+			pdf_reverse_direction = 0.0;
+		}
+
+		int last = static_cast<int>(path.size()) - 1;
+		path[last - 1].pdf_reverse = convert_density(pdf_reverse_direction, path[last], path[last - 1]);
+
+		beta *= attenuation;
+		walk_ray = scattered_ray;
+	}
+}
+
+// Camera subpaths start at the camera with a unit throughput, a camera with depth-of-field counts as a delta vertex that light subpaths can't connect to
+void generate_camera_subpath(int i, int j, std::vector<path_vertex>& path, color& escaped_color, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color) {
+	path.clear();
+
+	ray camera_ray = get_multisample_ray(i, j, camera);
+
+	path_vertex vertex;
+	vertex.type = CAMERA_VERTEX;
+	vertex.point = camera_ray.origin;
+	vertex.normal = -camera.w;
+	vertex.beta = color(1.0, 1.0, 1.0);
+	vertex.delta = camera.defocus_angle > 0.0;
+	path.push_back(vertex);
+
+	random_walk(camera_ray, vertex.beta, camera_direction_pdf(camera, camera_ray.direction), camera.max_depth + 2, true, path, escaped_color, camera, scene_objects, background_color);
+}
+
+// Light subpaths start at a point on a light picked in proportion to its power and leave it in a cosine weighted direction
+void generate_light_subpath(std::vector<path_vertex>& path, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color) {
+	path.clear();
+
+	double light_probability;
+	int light_index = pick_light(lights.distribution, light_probability);
+	if (light_index < 0) {
+		return;
+	}
+
+	const scene_object& light = lights.light_objects[light_index];
+	light_sample sample = sample_light(light);
+
+	path_vertex vertex;
+	vertex.type = LIGHT_VERTEX;
+	vertex.point = sample.point;
+	vertex.normal = sample.normal;
+	vertex.material = LIGHT;
+	vertex.material_color = sample.emission;
+	vertex.pdf_forward = light_probability / light_area(light);
+	vertex.beta = sample.emission / vertex.pdf_forward;
+	path.push_back(vertex);
+
+	onb onb = build_onb_from_w(vertex.normal);
+	glm::dvec3 direction = local_coord(onb, random_cosine_direction());
+	double pdf_direction = glm::dot(vertex.normal, direction) / pi;
+	if (pdf_direction <= 0.0) {
+		return;
+	}
+
+	// Emitted radiance times the cosine over the position and direction densities
+	color beta = vertex.beta * pi;
+	color escaped_color(0.0, 0.0, 0.0);
+	random_walk(create_ray(vertex.point, direction), beta, pdf_direction, camera.max_depth + 1, false, path, escaped_color, camera, scene_objects, background_color);
+}
+
+// Unweighted contribution of the path made of s light subpath vertices and t camera subpath vertices
+// Strategies with a single light vertex sample a new point on a light, strategies with a single camera vertex connect to the camera and report the pixel they land on
+color connect_subpaths(const std::vector<path_vertex>& light_path, const std::vector<path_vertex>& camera_path, int s, int t, path_vertex& sampled, int& raster_i, int& raster_j, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects) {
+	color black(0.0, 0.0, 0.0);
+	const path_vertex& pt = camera_path[t - 1];
+
+	// The camera subpath found a light by itself
+	if (s == 0) {
+		if (pt.type != SURFACE_VERTEX || pt.material != LIGHT) {
+			return black;
+		}
+		return pt.beta * pt.material_color;
+	}
+
+	// Light tracing, connect the light subpath to the camera
+	if (t == 1) {
+		const path_vertex& qs = light_path[s - 1];
+		const path_vertex& camera_vertex = camera_path[0];
+		if (camera_vertex.delta || !connectable(qs) || !raster_position(camera, qs.point, raster_i, raster_j)) {
+			return black;
+		}
+
+		glm::dvec3 offset = camera_vertex.point - qs.point;
+		double distance_squared = glm::dot(offset, offset);
+		double cosine_camera = glm::dot(glm::normalize(-offset), -camera.w);
+		double cosine_surface = glm::abs(glm::dot(qs.normal, offset)) / glm::sqrt(distance_squared);
+
+		color contribution = qs.beta * vertex_bsdf(qs, light_path[s - 2].point, camera_vertex.point) *
+			(cosine_surface / (film_area(camera) * cosine_camera * cosine_camera * cosine_camera * distance_squared));
+
+		if (luminance(contribution) <= 0.0) {
+			return black;
+		}
+
+		sampled = camera_vertex;
+		return contribution * points_transmittance(qs.point, camera_vertex.point, scene_objects);
+	}
+
+	if (!connectable(pt)) {
+		return black;
+	}
+
+	// Next event estimation, connect the camera subpath to a new point on a light
+	if (s == 1) {
+		double light_probability;
+		int light_index = pick_light(lights.distribution, light_probability);
+		if (light_index < 0) {
+			return black;
+		}
+
+		const scene_object& light = lights.light_objects[light_index];
+		light_sample sample = sample_light(light);
+
+		sampled = path_vertex();
+		sampled.type = LIGHT_VERTEX;
+		sampled.point = sample.point;
+		sampled.normal = sample.normal;
+		sampled.material = LIGHT;
+		sampled.material_color = sample.emission;
+		sampled.pdf_forward = light_probability / light_area(light);
+		sampled.beta = sample.emission / sampled.pdf_forward;
+
+		glm::dvec3 offset = pt.point - sampled.point;
+		double distance_squared = glm::dot(offset, offset);
+		double cosine_light = glm::dot(sampled.normal, offset) / glm::sqrt(distance_squared);
+		double cosine_surface = glm::abs(glm::dot(pt.normal, offset)) / glm::sqrt(distance_squared);
+		if (cosine_light <= 0.0) {
+			return black;
+		}
+
+		color contribution = pt.beta * vertex_bsdf(pt, camera_path[t - 2].point, sampled.point) * sampled.beta * (cosine_light * cosine_surface / distance_squared);
+
+		if (luminance(contribution) <= 0.0) {
+			return black;
+		}
+
+		return contribution * points_transmittance(pt.point, sampled.point, scene_objects);
+	}
+
+	// Connect two surface vertices in the middle of the path
+	const path_vertex& qs = light_path[s - 1];
+	if (!connectable(qs)) {
+		return black;
+	}
+
+	glm::dvec3 offset = pt.point - qs.point;
+	double distance_squared = glm::dot(offset, offset);
+	double distance = glm::sqrt(distance_squared);
+	double geometry_term = glm::abs(glm::dot(qs.normal, offset)) * glm::abs(glm::dot(pt.normal, offset)) / (distance_squared * distance_squared);
+
+	color contribution = qs.beta * vertex_bsdf(qs, light_path[s - 2].point, pt.point) * vertex_bsdf(pt, camera_path[t - 2].point, qs.point) * pt.beta * geometry_term;
+
+	if (distance <= 0.0 || luminance(contribution) <= 0.0) {
+		return black;
+	}
+
+	return contribution * points_transmittance(qs.point, pt.point, scene_objects);
+}
+
+// Delta vertices store zero densities, they cancel out of the ratios instead
+double remap_zero(double pdf) {
+	return (pdf != 0.0) ? pdf : 1.0;
+}
+
+// Balance heuristic weight of the strategy with s light and t camera vertices
+// Walks outwards from the connection and accumulates the ratio of the density of each other strategy to the density of this one
+double bidirectional_mis_weight(const std::vector<path_vertex>& light_path, const std::vector<path_vertex>& camera_path, int s, int t, const path_vertex& sampled, const bidirectional_lights& lights, const camera& camera) {
+	if (s + t == 2) {
+		return 1.0;
+	}
+
+	std::vector<path_vertex> light_vertices(light_path.begin(), light_path.begin() + s);
+	std::vector<path_vertex> camera_vertices(camera_path.begin(), camera_path.begin() + t);
+
+	if (s == 1) {
+		light_vertices[0] = sampled;
+	}
+	if (t == 1) {
+		camera_vertices[0] = sampled;
+	}
+
+	path_vertex* qs = (s > 0) ? &light_vertices[s - 1] : nullptr;
+	path_vertex* qs_minus = (s > 1) ? &light_vertices[s - 2] : nullptr;
+	path_vertex* pt = &camera_vertices[t - 1];
+	path_vertex* pt_minus = (t > 1) ? &camera_vertices[t - 2] : nullptr;
+
+	// Reverse densities of the vertices around the connection depend on the strategy
+	if (s > 0) {
+		pt->pdf_reverse = vertex_pdf(*qs, qs_minus, *pt, camera);
+		if (pt_minus != nullptr) {
+			pt_minus->pdf_reverse = vertex_pdf(*pt, qs, *pt_minus, camera);
+		}
+		qs->pdf_reverse = vertex_pdf(*pt, pt_minus, *qs, camera);
+		if (qs_minus != nullptr) {
+			qs_minus->pdf_reverse = vertex_pdf(*qs, pt, *qs_minus, camera);
+		}
+	}
+	else {
+		pt->pdf_reverse = (pt->object_index >= 0) ? lights.object_densities[pt->object_index] : 0.0;
+		if (pt_minus != nullptr) {
+			pt_minus->pdf_reverse = emission_pdf(*pt, *pt_minus);
+		}
+	}
+
+	double ratio_sum = 0.0;
+
+	double ratio = 1.0;
+	for (int i = t - 1; i > 0; i--) {
+		ratio *= remap_zero(camera_vertices[i].pdf_reverse) / remap_zero(camera_vertices[i].pdf_forward);
+		if (!camera_vertices[i].delta && !camera_vertices[i - 1].delta) {
+			ratio_sum += ratio;
+		}
+	}
+
+	ratio = 1.0;
+	for (int i = s - 1; i >= 0; i--) {
+		ratio *= remap_zero(light_vertices[i].pdf_reverse) / remap_zero(light_vertices[i].pdf_forward);
+		bool delta_previous = (i > 0) ? light_vertices[i - 1].delta : false;
+		if (!light_vertices[i].delta && !delta_previous) {
+			ratio_sum += ratio;
+		}
+	}
+
+	return 1.0 / (1.0 + ratio_sum);
+}
+
+// One pixel sample, light tracing contributions go to the splat buffer and the rest is returned
+color bidirectional_sample(int i, int j, splat_buffer& splats, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color) {
+	std::vector<path_vertex> camera_path;
+	std::vector<path_vertex> light_path;
+	color pixel_color(0.0, 0.0, 0.0);
+
+	generate_camera_subpath(i, j, camera_path, pixel_color, camera, scene_objects, background_color);
+	generate_light_subpath(light_path, lights, camera, scene_objects, background_color);
+
+	int nr_camera_vertices = static_cast<int>(camera_path.size());
+	int nr_light_vertices = static_cast<int>(light_path.size());
+
+	for (int t = 1; t <= nr_camera_vertices; t++) {
+		for (int s = 0; s <= nr_light_vertices; s++) {
+			// Connecting a light point straight to the camera only finds lights the camera rays hit anyway
+			int depth = s + t - 2;
+			if ((s == 1 && t == 1) || depth < 0 || depth > camera.max_depth) {
+				continue;
+			}
+
+			path_vertex sampled;
+			int raster_i = i;
+			int raster_j = j;
+			color contribution = connect_subpaths(light_path, camera_path, s, t, sampled, raster_i, raster_j, lights, camera, scene_objects);
+			if (luminance(contribution) <= 0.0) {
+				continue;
+			}
+
+			contribution *= bidirectional_mis_weight(light_path, camera_path, s, t, sampled, lights, camera);
+
+			if (t == 1) {
+				splat(splats, raster_i, raster_j, contribution);
+			}
+			else {
+				pixel_color += contribution;
+			}
+		}
+	}
+
+	return pixel_color;
+}
+
+void render_tile_bidirectional(int row_begin, int row_end, int column_begin, int column_end, splat_buffer& splats, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors) {
+	re_seed_random_generator(); // Re-seed each thread
+
+	for (int i = row_begin; i < row_end; i++) {
+		for (int j = column_begin; j < column_end; j++) {
+			for (int sample = 0; sample < camera.samples_per_pixel; sample++) {
+				pixel_colors[i][j] += bidirectional_sample(i, j, splats, lights, camera, scene_objects, background_color);
+			}
+		}
+	}
+}
+
+// Every pixel sample traces one light subpath, so the splats are summed over the same sample count as the pixels
+void render_bidirectional(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors) {
+	int tile_size = (camera.tile_size < 1) ? 1 : camera.tile_size;
+
+	bidirectional_lights lights = build_bidirectional_lights(scene_objects);
+
+	splat_buffer splats;
+	initialize_splat_buffer(splats, camera.image_width, camera.image_height);
+
+	std::vector<std::future<void>> futures;
+	for (int i = 0; i < camera.image_height; i += tile_size) {
+		for (int j = 0; j < camera.image_width; j += tile_size) {
+			int row_end = std::min(i + tile_size, camera.image_height);
+			int column_end = std::min(j + tile_size, camera.image_width);
+			futures.emplace_back(std::async(std::launch::async, [=, &splats, &lights, &camera, &scene_objects, &pixel_colors]() {
+				render_tile_bidirectional(i, row_end, j, column_end, splats, lights, camera, scene_objects, background_color, pixel_colors);
+			}));
+		}
+	}
+
+	for (std::future<void>& future : futures) {
+		future.wait();
+	}
+
+	resolve_splat_buffer(splats, pixel_colors);
+}
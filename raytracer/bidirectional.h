@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "util.h"
+#include "geometry.h"
+#include "camera.h"
+#include "direct_lighting.h"
+
+// Enum for the kind of vertex on a camera or light subpath
+enum vertex_enum {
+	CAMERA_VERTEX,
+	LIGHT_VERTEX,
+	SURFACE_VERTEX
+};
+
+// A vertex of a camera or light subpath
+struct path_vertex {
+	vertex_enum type = SURFACE_VERTEX;
+	point3 point;
+	glm::dvec3 normal; // Faces the side the subpath arrived from, on light vertices the side that emits, on the camera the viewing direction
+	material_enum material = LAMBERTIAN;
+	color material_color;
+	color beta; // Throughput of the subpath up to and including this vertex
+	int object_index = -1; // Hit scene object, -1 for the camera and sampled light points
+	bool delta = false; // Specular, medium and lens vertices can't be connected to
+	double pdf_forward = 0.0; // Area density of sampling this vertex from the previous vertex of its own subpath
+	double pdf_reverse = 0.0; // Area density of sampling this vertex from the next vertex, as the other subpath would
+};
+
+// Lights of the scene with the densities light subpaths start with
+struct bidirectional_lights {
+	std::vector<scene_object> light_objects;
+	light_distribution distribution;
+	std::vector<double> object_densities; // Area density of starting a light subpath on each scene object, 0.0 for everything but lights
+};
+
+// Light tracing contributions land on arbitrary pixels, so they are accumulated with lock-free atomic adds
+struct splat_buffer {
+	int width = 0;
+	int height = 0;
+	std::unique_ptr<std::atomic<double>[]> values; // Three channels per pixel, row by row
+};
+
+void initialize_splat_buffer(splat_buffer& buffer, int width, int height);
+void splat(splat_buffer& buffer, int i, int j, const color& contribution);
+void resolve_splat_buffer(const splat_buffer& buffer, std::vector<std::vector<color>>& pixel_colors);
+
+bidirectional_lights build_bidirectional_lights(const std::vector<scene_object>& scene_objects);
+
+double camera_direction_pdf(const camera& camera, const glm::dvec3& direction);
+bool raster_position(const camera& camera, const point3& point, int& i, int& j);
+
+void generate_camera_subpath(int i, int j, std::vector<path_vertex>& path, color& escaped_color, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color);
+void generate_light_subpath(std::vector<path_vertex>& path, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color);
+color connect_subpaths(const std::vector<path_vertex>& light_path, const std::vector<path_vertex>& camera_path, int s, int t, path_vertex& sampled, int& raster_i, int& raster_j, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects);
+double bidirectional_mis_weight(const std::vector<path_vertex>& light_path, const std::vector<path_vertex>& camera_path, int s, int t, const path_vertex& sampled, const bidirectional_lights& lights, const camera& camera);
+
+color bidirectional_sample(int i, int j, splat_buffer& splats, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color);
+void render_tile_bidirectional(int row_begin, int row_end, int column_begin, int column_end, splat_buffer& splats, const bidirectional_lights& lights, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors);
+void render_bidirectional(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors);
@@ -3,6 +3,7 @@
 #include <future>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include "camera.h"
 #include "color.h"
 #include "util.h"
@@ -12,6 +13,16 @@
 #include "glm.hpp"
 #include "pdf.h"
 #include "post_processing.h"
+#include "direct_lighting.h"
+#include "photon_map.h"
+#include "path_guiding.h"
+#include "bidirectional.h"
+#include "volume.h"
+#include "fast_math.h"
+#include "accumulation.h"
+#include "image_output.h"
+#include "mapped_framebuffer.h"
+#include "checkpoint.h"
 
 std::ostream& print_camera_configuration(std::ostream& os, const camera& camera) {
 	os << "Aspect ratio: " << camera.aspect_ratio << std::endl;
@@ -34,6 +45,50 @@ std::ostream& print_camera_configuration(std::ostream& os, const camera& camera)
 
 	os << "Defocus angle: " << camera.defocus_angle << std::endl;
 	os << "Focus distance: " << camera.focus_distance << std::endl;
+	os << "Splitting factor: " << camera.splitting_factor << std::endl;
+	os << "Trace precision: " << (camera.single_precision ? "single" : "double") << std::endl;
+	os << "Math functions: " << (camera.fast_math ? "fast approximations" : "standard library") << std::endl;
+	os << "Pixel filter: " << camera.pixel_filter.filter_type << ", radius " << camera.pixel_filter.radius << std::endl;
+	os << "Median of means buffers: " << camera.median_of_means_buffers << ", gini threshold " << camera.median_of_means_gini << std::endl;
+	os << "Sample clamp: " << camera.sample_clamp << std::endl;
+	os << "Aovs:";
+	for (int bit = 0; (1 << bit) <= ALL_AOVS; bit++) {
+		os << ((camera.aovs & (1 << bit)) ? std::string(" ") + aov_name(static_cast<aov_enum>(1 << bit)) : "");
+	}
+	os << ((camera.aovs == 0) ? " none" : "") << std::endl;
+	os << "Denoise iterations: " << camera.denoise.iterations << ", color sigma " << camera.denoise.color_sigma << ", normal power " << camera.denoise.normal_power << ", depth sigma " << camera.denoise.depth_sigma << ", albedo sigma " << camera.denoise.albedo_sigma << std::endl;
+	os << "Filter sigma: " << camera.filter_sigma << std::endl;
+	os << "Output file: output" << image_extension(camera.output_format) << std::endl;
+	os << "Tone mapping: exposure " << camera.display.exposure << ", " << ((camera.display.curve == ACES_CURVE) ? "aces" : (camera.display.curve == REINHARD_CURVE) ? "reinhard" : "clip") << " curve, " << ((camera.display.transfer == SRGB_TRANSFER) ? "srgb" : "gamma 2") << ", " << camera.display.bits << " bits" << (camera.display.dither ? ", dithered" : "") << std::endl;
+	os << "Checkpoint interval: " << camera.checkpoint_interval << " s, " << camera.samples_per_pass << " samples per pass" << (camera.resume ? ", resuming" : "") << std::endl;
+	os << "Render cache: " << (camera.render_cache ? "on" : "off") << std::endl;
+	os << "Region: ";
+	if (camera.region_width > 0 && camera.region_height > 0) {
+		os << camera.region_width << "x" << camera.region_height << " from column " << camera.region_left << ", row " << camera.region_top << std::endl;
+	}
+	else {
+		os << "whole image" << std::endl;
+	}
+	os << "Framebuffer: " << ((camera.framebuffer == MAPPED_FLOAT_FRAMEBUFFER) ? "mapped float" : (camera.framebuffer == MAPPED_HALF_FRAMEBUFFER) ? "mapped half" : "memory") << std::endl;
+	os << "Integrator: " << camera.integrator << std::endl;
+
+	switch (camera.integrator) {
+	case RESAMPLED_DIRECT_LIGHTING:
+		os << "Resampled direct lighting: " << camera.light_candidates << " candidates, " << camera.spatial_reuse_neighbours << " neighbours, " << (camera.unbiased_reuse ? "unbiased" : "biased") << std::endl;
+		os << "Effective light samples per pixel: " << camera.samples_per_pixel * camera.light_candidates * (1 + camera.spatial_reuse_neighbours) << std::endl;
+		break;
+	case PHOTON_MAPPING:
+		os << "Photon mapping: " << camera.photon_passes << " passes of " << camera.photons_per_pass << " photons, radius alpha " << camera.photon_radius_alpha << std::endl;
+		break;
+	case PATH_GUIDING:
+		os << "Path guiding: " << camera.guiding_training_passes << " training passes" << std::endl;
+		break;
+	case BIDIRECTIONAL:
+		os << "Bidirectional path tracing: " << ((camera.defocus_angle > 0.0) ? "light tracing off with depth-of-field" : "light tracing on") << std::endl;
+		break;
+	default:
+		break;
+	}
 
 	return os;
 }
@@ -69,15 +124,11 @@ void initialize(camera& camera) {
 	camera.defocus_disc_u = camera.u * defocus_radius;
 	camera.defocus_disc_v = camera.v * defocus_radius;
 
-	print_camera_configuration(std::cout, camera);
-}
-
-// Sample a random point around pixel center in the viewport within delta_u and delta_v bounds
-point3 pixel_sample_square(const camera& camera) {
-	double px = -0.5 + random_double(0.0, 1.0);
-	double py = -0.5 + random_double(0.0, 1.0);
+	// Texture footprints spread by the angle one pixel covers
+	configure_textures(theta / camera.image_height, camera.texture_cache_megabytes);
+	configure_fast_math(camera.fast_math);
 
-	return (px * camera.pixel_delta_u) + (py * camera.pixel_delta_v);
+	print_camera_configuration(std::cout, camera);
 }
 
 // Adjust ray-origin depending on depth-of-field setting
@@ -86,37 +137,137 @@ point3 defocus_disk_sample(const camera& camera) {
 	return camera.center + (point.x * camera.defocus_disc_u) + (point.y * camera.defocus_disc_v);
 }
 
-// Get randomly sampled camera ray for pixel at location i,j
-const ray& get_multisample_ray(int i, int j, const camera& camera) {
+// Path tracing kernels are specialized at compile time on the features of the scene, see scene_feature
+// A kernel compiled without a feature has the tests and branches for it removed from the inner loop
+template <int features>
+color ray_color_kernel(const ray& ray_in, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor = 1);
+template <int features>
+color hit_color_kernel(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor);
+
+// Camera ray through pixel i,j at an offset in [-0.5, 0.5) from its center along the rows and columns
+template <int features>
+ray camera_ray_kernel(int i, int j, double offset_x, double offset_y, const camera& camera) {
 	point3 pixel_center = camera.pixel_00_loc /*Start position*/ + (static_cast<double>(j) * camera.pixel_delta_u) /*Iterate columns*/ + (static_cast<double>(i) * camera.pixel_delta_v); /*Iterate rows*/
-	point3 pixel_sample = pixel_center + pixel_sample_square(camera);
+	point3 pixel_sample = pixel_center + (offset_x * camera.pixel_delta_u) + (offset_y * camera.pixel_delta_v);
 
-	point3 ray_origin = (camera.defocus_angle <= 0) ? camera.center : defocus_disk_sample(camera); // Adjust ray origin depending on if the camera should have depth of field or not
+	point3 ray_origin = ((features & FEATURE_DEPTH_OF_FIELD) && camera.defocus_angle > 0) ? defocus_disk_sample(camera) : camera.center; // Adjust ray origin depending on if the camera should have depth of field or not
 	glm::dvec3 ray_direction = pixel_sample - ray_origin;
 
 	return create_ray(ray_origin, ray_direction);
 }
 
-// Calculate color for current ray
-color ray_color(const ray& ray_in, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
-	hit_record rec;
-	interval initial_ray_time_interval = { 0.001, infinity };
+// Get randomly sampled camera ray for pixel at location i,j
+template <int features>
+ray camera_ray_kernel(int i, int j, const camera& camera) {
+	double offset_x = -0.5 + random_double(0.0, 1.0);
+	double offset_y = -0.5 + random_double(0.0, 1.0);
+	return camera_ray_kernel<features>(i, j, offset_x, offset_y, camera);
+}
 
-	// If max depth is reached, stop bouncing the ray
-	if (depth <= 0) {
+// Rough metal hit, one-sample MIS between visible normal sampling and sampling the lights among the sample objects
+// Both strategies are weighted by the balance heuristic through the combined density of the direction
+template <int features>
+color glossy_metal_kernel(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
+	int nr_lights = 0;
+	if (features & FEATURE_EMITTERS) {
+		for (const scene_object& sample_object : sample_objects) {
+			nr_lights += (object_material(sample_object).material == LIGHT) ? 1 : 0;
+		}
+	}
+
+	color attenuation;
+	ray scattered_ray;
+
+	// Without lights to sample or for mirror-like metals, visible normal sampling alone is used
+	if (nr_lights == 0 || metal_is_specular(rec.metal_fuzz)) {
+		if (metallic_reflection(ray_in, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+			return attenuation * ray_color_kernel<features>(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera);
+		}
+		return color(0.0, 0.0, 0.0);
+	}
+
+	glm::dvec3 view = -glm::normalize(ray_in.direction);
+
+	if (random_double() < 0.5) {
+		int light_index = random_int(0, nr_lights - 1);
+		for (const scene_object& sample_object : sample_objects) {
+			if (object_material(sample_object).material == LIGHT && light_index-- == 0) {
+				scattered_ray = create_ray(rec.point, glm::normalize(sample_light(sample_object).point - rec.point));
+				break;
+			}
+		}
+	}
+	else if (!metallic_reflection(ray_in, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	glm::dvec3 scattered_direction = glm::normalize(scattered_ray.direction);
+	color brdf_cosine = metallic_brdf_cosine(rec, view, scattered_direction, rec.metal_fuzz);
+	if (brdf_cosine == color(0.0, 0.0, 0.0)) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	double light_pdf = 0.0;
+	for (const scene_object& sample_object : sample_objects) {
+		if (object_material(sample_object).material == LIGHT) {
+			light_pdf += light_direction_pdf(sample_object, rec.point, scattered_direction);
+		}
+	}
+	double pdf = 0.5 * metallic_reflection_pdf(rec, view, scattered_direction, rec.metal_fuzz) + 0.5 * light_pdf / static_cast<double>(nr_lights);
+
+	return brdf_cosine * ray_color_kernel<features>(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera) / pdf;
+}
+
+// Direct light from the environment through one sample of its importance distribution
+// Weighted by the power heuristic against cosine sampling, continuations that escape take the complementary weight
+template <int features>
+color environment_direct_light_kernel(const hit_record& rec, const std::vector<scene_object>& scene_objects, const camera& camera) {
+	double environment_sample_pdf;
+	glm::dvec3 direction = sample_environment(*camera.environment, environment_sample_pdf);
+	double cosine = glm::dot(direction, rec.normal);
+	if (environment_sample_pdf <= 0.0 || cosine <= 0.0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	ray shadow_ray = create_ray(rec.point, direction);
+	hit_record occluder;
+	if (find_intersection_kernel<features & GEOMETRY_FEATURES>(shadow_ray, interval{ 0.001, infinity }, occluder, scene_objects, false)) {
+		return color(0.0, 0.0, 0.0);
+	}
+	double transmittance = (features & FEATURE_MEDIA) ? medium_transmittance(shadow_ray, interval{ 0.001, infinity }, scene_objects) : 1.0;
+
+	double scatter_pdf = cosine / pi;
+	double weight = environment_sample_pdf * environment_sample_pdf / (environment_sample_pdf * environment_sample_pdf + scatter_pdf * scatter_pdf);
+	return rec.material_color * environment_radiance(*camera.environment, direction) * (scatter_pdf * transmittance * weight / environment_sample_pdf);
+}
+
+// Continuation from a lambertian hit when the environment is also sampled directly
+template <int features>
+color environment_mis_ray_color_kernel(const ray& scattered_ray, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
+	if (depth - 1 <= 0) {
 		return color(0.0, 0.0, 0.0);
 	}
 
-	// Look for intersection in scene, if no intersection is found, return background color
-	if (!find_intersection(ray_in, initial_ray_time_interval, rec, scene_objects)) {
-		return background_color;
+	hit_record next_rec;
+	if (find_intersection_kernel<features & GEOMETRY_FEATURES>(scattered_ray, interval{ 0.001, infinity }, next_rec, scene_objects)) {
+		return hit_color_kernel<features>(scattered_ray, next_rec, (depth - 1), scene_objects, background_color, sample_objects, camera, 1);
 	}
 
+	double scatter_pdf = cosine_pdf(rec.normal, scattered_ray.direction);
+	double environment_sample_pdf = environment_pdf(*camera.environment, scattered_ray.direction);
+	double weight = scatter_pdf * scatter_pdf / (scatter_pdf * scatter_pdf + environment_sample_pdf * environment_sample_pdf);
+	return environment_radiance(*camera.environment, scattered_ray.direction) * weight;
+}
+
+// Continue the path from an intersection by scattering once according to the material of the hit
+// Splitting factor is only passed on through dielectrics, so a pending split is resolved at the first non-specular hit behind glass
+template <int features>
+color scatter_color_kernel(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor) {
 	ray scattered_ray;
 	color attenuation;
 	double pdf;
 
-	// If intersection, check material for emission/ray-traversal
+	// Check material for emission/ray-traversal
 	switch (rec.material) {
 		case LAMBERTIAN:
 			if (lambertian_scatter(ray_in, rec, attenuation, scattered_ray, pdf)) {
@@ -125,7 +276,7 @@ color ray_color(const ray& ray_in, int depth, const std::vector<scene_object>& s
 				glm::dvec3 scattered_ray_direction = glm::dvec3(0.0, 0.0, 0.0);
 			
 				// 50/50 mixture of intersectable pdf and cosine pdf unless there are no sample objects, then just use cosine pdf
-				if (sample_objects.size() > 0 && random_double() < 0.5) {
+				if ((features & (FEATURE_EMITTERS | FEATURE_DIELECTRICS)) && sample_objects.size() > 0 && random_double() < 0.5) {
 					// Choose random sample object (light, dielectric, etc.)
 					int random_index = random_int(0, (sample_objects.size() - 1));
 					const scene_object& sample_object = sample_objects[random_index];
@@ -143,31 +294,493 @@ color ray_color(const ray& ray_in, int depth, const std::vector<scene_object>& s
 					pdf = cosine_pdf(rec.normal, random_direction);
 				}
 
+				// With an environment map the environment is sampled directly as well
+				if (camera.environment) {
+					return attenuation * lambertian_scatter_pdf(ray_in, rec, scattered_ray) *
+						environment_mis_ray_color_kernel<features>(scattered_ray, rec, depth, scene_objects, background_color, sample_objects, camera) / pdf +
+						environment_direct_light_kernel<features>(rec, scene_objects, camera);
+				}
+
 				return attenuation * lambertian_scatter_pdf(ray_in, rec, scattered_ray) *
-					ray_color(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera) / pdf;
+					ray_color_kernel<features>(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera) / pdf;
 			}
 		break;
 		case METAL:
-			if (metallic_reflection(ray_in, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
-				return attenuation * ray_color(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera);
-			}
-		break;
+			return glossy_metal_kernel<features>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera);
 		case DIELECTRIC:
-			if (dielectric_refraction(ray_in, rec, attenuation, scattered_ray, rec.refraction_index)) {
-				return attenuation * ray_color(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera);
+			if ((features & FEATURE_DIELECTRICS) && dielectric_refraction(ray_in, rec, attenuation, scattered_ray, rec.refraction_index)) {
+				return attenuation * ray_color_kernel<features>(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera, splitting_factor);
 			}
 		break;
 		case LIGHT:
-			return rec.material_color;
+			return (features & FEATURE_EMITTERS) ? rec.material_color : color(0.0, 0.0, 0.0);
 		break;
 		case CONSTANT_DENSITY_MEDIUM_MATERIAL:
-			if (constant_density_medium_scatter(rec, attenuation, scattered_ray, camera)) {
-				return attenuation * ray_color(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera);
+			if ((features & FEATURE_MEDIA) && constant_density_medium_scatter(rec, attenuation, scattered_ray)) {
+				return attenuation * ray_color_kernel<features>(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera);
+			}
+		break;
+		default:
+		break;
+	}
+
+	return color(0.0, 0.0, 0.0); // Absorbed
+}
+
+// Calculate color for current ray
+template <int features>
+color ray_color_kernel(const ray& ray_in, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor) {
+	hit_record rec;
+	interval initial_ray_time_interval = { 0.001, infinity };
+
+	// If max depth is reached, stop bouncing the ray
+	if (depth <= 0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	// Look for intersection in scene, if no intersection is found, return background color or environment radiance
+	if (!find_intersection_kernel<features & GEOMETRY_FEATURES>(ray_in, initial_ray_time_interval, rec, scene_objects)) {
+		return background_radiance(camera.environment.get(), ray_in.direction, background_color);
+	}
+
+	return hit_color_kernel<features>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, splitting_factor);
+}
+
+// Color of a ray from an intersection the caller has already found
+// A splitting factor above 1 traces that many continuations from the hit and averages them, the visibility of the hit is only paid for once
+template <int features>
+color hit_color_kernel(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor) {
+	// No splitting, or nothing to split since lights terminate the path
+	if (splitting_factor <= 1 || rec.material == LIGHT) {
+		return scatter_color_kernel<features>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, 1);
+	}
+
+	if ((features & FEATURE_DIELECTRICS) && rec.material == DIELECTRIC) {
+		// A camera ray hitting glass follows both the reflected and the refracted branch weighted by fresnel reflectance instead of picking one at random
+		// Deeper dielectric hits pick a single branch as usual so the branching can't grow exponentially inside the glass
+		ray reflected_ray, refracted_ray;
+		double reflected_weight;
+		if (depth == camera.max_depth && dielectric_split(ray_in, rec, reflected_ray, refracted_ray, reflected_weight, rec.refraction_index)) {
+			return reflected_weight * ray_color_kernel<features>(reflected_ray, (depth - 1), scene_objects, background_color, sample_objects, camera, splitting_factor) +
+				(1.0 - reflected_weight) * ray_color_kernel<features>(refracted_ray, (depth - 1), scene_objects, background_color, sample_objects, camera, splitting_factor);
+		}
+		return scatter_color_kernel<features>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, splitting_factor);
+	}
+
+	// Split the path, each continuation is weighted equally
+	color split_color = color(0.0, 0.0, 0.0);
+	for (int split = 0; split < splitting_factor; split++) {
+		split_color += scatter_color_kernel<features>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, 1);
+	}
+
+	return split_color / static_cast<double>(splitting_factor);
+}
+
+// The other integrators reach the path tracing functions without knowing the scene features, they run the kernel with every feature compiled in
+ray get_multisample_ray(int i, int j, const camera& camera) {
+	return camera_ray_kernel<ALL_FEATURES>(i, j, camera);
+}
+
+color glossy_metal_color(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
+	return glossy_metal_kernel<ALL_FEATURES>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera);
+}
+
+color environment_direct_light(const hit_record& rec, const std::vector<scene_object>& scene_objects, const camera& camera) {
+	return environment_direct_light_kernel<ALL_FEATURES>(rec, scene_objects, camera);
+}
+
+color environment_mis_ray_color(const ray& scattered_ray, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
+	return environment_mis_ray_color_kernel<ALL_FEATURES>(scattered_ray, rec, depth, scene_objects, background_color, sample_objects, camera);
+}
+
+color scatter_color(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor) {
+	return scatter_color_kernel<ALL_FEATURES>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, splitting_factor);
+}
+
+color ray_color(const ray& ray_in, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor) {
+	return ray_color_kernel<ALL_FEATURES>(ray_in, depth, scene_objects, background_color, sample_objects, camera, splitting_factor);
+}
+
+color hit_color(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor) {
+	return hit_color_kernel<ALL_FEATURES>(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, splitting_factor);
+}
+
+// Features the scene actually uses, the path tracer runs the kernel compiled for exactly these
+int detect_scene_features(const camera& camera, const std::vector<scene_object>& scene_objects) {
+	int features = (camera.defocus_angle > 0.0) ? FEATURE_DEPTH_OF_FIELD : 0;
+	for (const scene_object& obj : scene_objects) {
+		if (obj.constant_density_medium) {
+			features |= FEATURE_MEDIA;
+		}
+		switch (object_material(obj).material) {
+		case DIELECTRIC:
+			features |= FEATURE_DIELECTRICS;
+		break;
+		case LIGHT:
+			features |= FEATURE_EMITTERS;
+		break;
+		default:
+		break;
+		}
+	}
+	return features;
+}
+
+std::ostream& print_scene_features(std::ostream& os, int features) {
+	os << "Kernel features:";
+	os << ((features & FEATURE_MEDIA) ? " media" : "");
+	os << ((features & FEATURE_DIELECTRICS) ? " dielectrics" : "");
+	os << ((features & FEATURE_DEPTH_OF_FIELD) ? " depth-of-field" : "");
+	os << ((features & FEATURE_EMITTERS) ? " emitters" : "");
+	os << ((features & FEATURE_SINGLE_PRECISION) ? " single-precision" : "");
+	os << ((features == 0) ? " none" : "") << std::endl;
+	return os;
+}
+
+// Multi-sample a pixel with the kernel specialized on the scene features, taking its primary samples first_sample up to first_sample + nr_samples
+// Samples are clamped when the camera asks for it and splatted into the interleaved sub-buffers of the pixels the filter reaches
+// The first intersection is found here instead of in ray color, so the aovs are recorded from it without tracing again
+template <int features>
+void render_pixel(int i, int j, int first_sample, int nr_samples, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, sample_buffers& path_samples, aov_buffers& aovs) {
+	long long nr_clamped = 0;
+	double removed_luminance = 0.0;
+	double total_luminance = 0.0;
+	bool record_aovs = (aovs.enabled != 0);
+
+	for (int sample = first_sample; sample < first_sample + nr_samples; sample++) {
+		double offset_x = -0.5 + random_double(0.0, 1.0);
+		double offset_y = -0.5 + random_double(0.0, 1.0);
+		ray ray = camera_ray_kernel<features>(i, j, offset_x, offset_y, camera);
+		hit_record rec;
+		color sample_color = color(0.0, 0.0, 0.0);
+		if (camera.max_depth <= 0) {
+			// Nothing to trace, the sample stays black like in ray color
+		}
+		else if (find_intersection_kernel<features & GEOMETRY_FEATURES>(ray, { 0.001, infinity }, rec, scene_objects)) {
+			sample_color = hit_color_kernel<features>(ray, rec, camera.max_depth, scene_objects, background_color, sample_objects, camera, camera.splitting_factor);
+			if (record_aovs) {
+				record_first_hit(aovs, i, j, rec, rec.time * glm::length(ray.direction));
+			}
+		}
+		else {
+			sample_color = background_radiance(camera.environment.get(), ray.direction, background_color);
+			if (record_aovs) {
+				record_first_miss(aovs, i, j);
+			}
+		}
+		splat_sample(path_samples, i, j, offset_x, offset_y, sample % path_samples.nr_buffers, clamp_sample(sample_color, camera.sample_clamp, nr_clamped, removed_luminance, total_luminance));
+	}
+
+	record_clamp_statistics(nr_samples, nr_clamped, removed_luminance, total_luminance);
+}
+
+typedef void (*render_pixel_function)(int, int, int, int, const camera&, const std::vector<scene_object>&, const color&, const std::vector<scene_object>&, sample_buffers&, aov_buffers&);
+
+// One instantiation for every combination of features in both precisions, indexed by the feature bits
+const render_pixel_function render_pixel_kernels[(ALL_FEATURES | FEATURE_SINGLE_PRECISION) + 1] = {
+	render_pixel<0>, render_pixel<1>, render_pixel<2>, render_pixel<3>,
+	render_pixel<4>, render_pixel<5>, render_pixel<6>, render_pixel<7>,
+	render_pixel<8>, render_pixel<9>, render_pixel<10>, render_pixel<11>,
+	render_pixel<12>, render_pixel<13>, render_pixel<14>, render_pixel<15>,
+	render_pixel<16>, render_pixel<17>, render_pixel<18>, render_pixel<19>,
+	render_pixel<20>, render_pixel<21>, render_pixel<22>, render_pixel<23>,
+	render_pixel<24>, render_pixel<25>, render_pixel<26>, render_pixel<27>,
+	render_pixel<28>, render_pixel<29>, render_pixel<30>, render_pixel<31>
+};
+
+// Aovs for the integrators that don't record them while rendering, a few jittered camera rays per pixel are traced to their first hit
+void trace_first_hit_aovs(const camera& camera, const std::vector<scene_object>& scene_objects, int aov_samples, aov_buffers& aovs) {
+	std::vector<std::future<void>> futures;
+	for (int i = 0; i < camera.image_height; i++) {
+		futures.emplace_back(std::async(std::launch::async, [=, &camera, &scene_objects, &aovs]() {
+			re_seed_random_generator();
+			for (int j = 0; j < camera.image_width; j++) {
+				for (int sample = 0; sample < aov_samples; sample++) {
+					ray ray = get_multisample_ray(i, j, camera);
+					hit_record rec;
+					if (find_intersection(ray, { 0.001, infinity }, rec, scene_objects)) {
+						record_first_hit(aovs, i, j, rec, rec.time * glm::length(ray.direction));
+					}
+					else {
+						record_first_miss(aovs, i, j);
+					}
+				}
+			}
+		}));
+	}
+	for (std::future<void>& future : futures) {
+		future.wait();
+	}
+}
+
+// Camera rays needed per pixel when each of them is split into several continuations
+int primary_samples_per_pixel(const camera& camera) {
+	int splitting_factor = (camera.splitting_factor < 1) ? 1 : camera.splitting_factor;
+	return (camera.samples_per_pixel + splitting_factor - 1) / splitting_factor;
+}
+
+// Path tracing into a framebuffer in a memory mapped file, for images too large for memory
+// Each hardware thread renders its share of the framebuffer tiles one after the other, merging the samples of a tile into the tiles they reach
+// The gaussian filter runs tile by tile into a second mapped framebuffer, then the image is streamed out in bands of rows
+// The median of means, aovs, the denoiser, checkpoints, the render cache and regions need whole image buffers and are left out
+void render_mapped(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, render_pixel_function render_pixel_kernel, int primary_samples) {
+	if (camera.median_of_means_buffers > 1 || camera.aovs != 0 || camera.denoise.iterations > 0 || camera.checkpoint_interval > 0.0 || camera.resume || camera.render_cache || camera.region_width > 0) {
+		std::cout << "Median of means, aovs, denoising, checkpoints, the render cache and regions are skipped with a mapped framebuffer" << std::endl;
+	}
+
+	bool half_precision = (camera.framebuffer == MAPPED_HALF_FRAMEBUFFER);
+	mapped_framebuffer framebuffer;
+	if (!create_mapped_framebuffer(framebuffer, "output_framebuffer.tmp", camera.image_width, camera.image_height, half_precision)) {
+		std::cerr << "Failed to create the mapped framebuffer" << std::endl;
+		close_mapped_framebuffer(framebuffer);
+		return;
+	}
+
+	sample_buffers image_layout; // Size and filter of the image the tile buffers are cut from, it holds no samples itself
+	image_layout.width = camera.image_width;
+	image_layout.height = camera.image_height;
+	image_layout.filter = camera.pixel_filter;
+	aov_buffers no_aovs;
+	reset_clamp_statistics();
+
+	parallel_for_rows(framebuffer.tiles_x * framebuffer.tiles_y, [&](int tile) {
+		re_seed_random_generator(); // Re-seed each thread
+
+		int row_begin = (tile / framebuffer.tiles_x) * framebuffer_tile_size;
+		int column_begin = (tile % framebuffer.tiles_x) * framebuffer_tile_size;
+		int row_end = std::min(row_begin + framebuffer_tile_size, camera.image_height);
+		int column_end = std::min(column_begin + framebuffer_tile_size, camera.image_width);
+
+		sample_buffers tile_samples;
+		initialize_tile_sample_buffers(tile_samples, image_layout, row_begin, row_end, column_begin, column_end);
+		for (int row = row_begin; row < row_end; row++) {
+			for (int column = column_begin; column < column_end; column++) {
+				render_pixel_kernel(row, column, 0, primary_samples, camera, scene_objects, background_color, sample_objects, tile_samples, no_aovs);
+			}
+		}
+		accumulate_framebuffer(framebuffer, tile_samples);
+	});
+	print_texture_cache_statistics(std::cout);
+	print_clamp_statistics(std::cout);
+
+	mapped_framebuffer filtered;
+	mapped_framebuffer* result = &framebuffer;
+	if (camera.filter_sigma > 0.0) {
+		std::cout << "Applying gaussian filter..." << std::endl;
+		if (create_mapped_framebuffer(filtered, "output_filtered.tmp", camera.image_width, camera.image_height, half_precision)) {
+			gaussian_filter_framebuffer(framebuffer, filtered, camera.filter_sigma);
+			result = &filtered;
+		}
+		else {
+			std::cerr << "Failed to create the filtered framebuffer, writing the image unfiltered" << std::endl;
+			close_mapped_framebuffer(filtered);
+		}
+	}
+
+	// Bands of rows are read from the tiles and written one after the other, formats that store rows bottom up start from the last band
+	std::cout << "Writing the image..." << std::endl;
+	const int band_rows = 32;
+	int nr_bands = (camera.image_height + band_rows - 1) / band_rows;
+	image_stream stream;
+	begin_image_stream(stream, "output", camera.image_width, camera.image_height, camera.output_format, camera.display);
+	std::vector<color> band;
+	for (int band_index = 0; band_index < nr_bands; band_index++) {
+		int row_begin = (image_rows_bottom_up(camera.output_format) ? nr_bands - 1 - band_index : band_index) * band_rows;
+		int row_end = std::min(row_begin + band_rows, camera.image_height);
+		read_framebuffer(*result, row_begin, row_end, 0, camera.image_width, band);
+		write_image_band(stream, band, row_end - row_begin, 1.0);
+	}
+	end_image_stream(stream);
+
+	close_mapped_framebuffer(framebuffer);
+	if (result == &filtered) {
+		close_mapped_framebuffer(filtered);
+	}
+
+	std::cout << "Done.\n";
+}
+
+// Hash of everything that decides the path traced samples of a render, a checkpoint is only resumed by a render with the same hash
+// Samples per pixel and the steps after the samples are resolved are left out, so they can change between the render and its extension
+uint64_t render_fingerprint(const camera& camera, int features, const color& background_color, const std::vector<scene_object>& scene_objects) {
+	uint64_t hash = 14695981039346656037ull;
+	auto hash_value = [&hash](const auto& value) { hash = fingerprint_bytes(hash, &value, sizeof(value)); };
+	auto hash_vector = [&hash_value](const glm::dvec3& vector) { hash_value(vector.x); hash_value(vector.y); hash_value(vector.z); };
+
+	hash_value(camera.image_width);
+	hash_value(camera.image_height);
+	hash_value(camera.max_depth);
+	hash_value(camera.vertical_field_of_view);
+	hash_vector(camera.look_from);
+	hash_vector(camera.look_at);
+	hash_vector(camera.camera_up);
+	hash_value(camera.defocus_angle);
+	hash_value(camera.focus_distance);
+	hash_value(camera.sample_clamp);
+	hash_value(camera.splitting_factor);
+	hash_value(camera.fast_math);
+	hash_value(features);
+	bool environment_lit = (camera.environment != nullptr);
+	hash_value(environment_lit);
+	if (environment_lit) {
+		hash_value(camera.environment->width);
+		hash_value(camera.environment->height);
+		hash = fingerprint_bytes(hash, camera.environment->texels.data(), camera.environment->texels.size() * sizeof(color));
+	}
+	hash_vector(background_color);
+
+	for (const scene_object& object : scene_objects) {
+		hash_value(object.object_type);
+		hash_value(object.dielectric_shell);
+		hash_value(object.shell_inner_scale);
+		hash_value(object.medium_priority);
+		// Only the fields of the object type are set, the others are left uninitialized
+		switch (object.object_type) {
+		case SPHERE:
+			hash_vector(object.sphere_center);
+			hash_value(object.sphere_radius);
+		break;
+		case QUAD:
+			for (int k = 0; k < object.nr_quad_triangles; k++) {
+				for (const glm::dvec3& vertex : object.quad_triangles[k].vertices) {
+					hash_vector(vertex);
+				}
+			}
+		break;
+		case CUBE:
+		case ASYMMETRIC_CUBE:
+			for (int k = 0; k < object.nr_cube_triangles; k++) {
+				for (const glm::dvec3& vertex : object.cube_triangles[k].vertices) {
+					hash_vector(vertex);
+				}
 			}
 		break;
 		default:
-			return color(0.0, 0.0, 0.0);
 		break;
+		}
+		hash_value(object.constant_density_medium);
+		if (object.constant_density_medium) {
+			hash_value(object.density);
+			// Jittered media scale their density by a grid, its cells stand in for the jitter that built it
+			bool has_grid = (object.medium_grid != nullptr);
+			hash_value(has_grid);
+			if (has_grid) {
+				const density_grid& grid = *object.medium_grid;
+				hash_vector(grid.lower);
+				hash_vector(grid.upper);
+				hash_value(grid.resolution);
+				hash_value(grid.bricks);
+				hash = fingerprint_bytes(hash, grid.brick_offsets.data(), grid.brick_offsets.size() * sizeof(int));
+				hash = fingerprint_bytes(hash, grid.densities.data(), grid.densities.size() * sizeof(float));
+			}
+		}
+		const material_properties& material = object_material(object);
+		hash_value(material.material);
+		hash_vector(material.material_color);
+		hash_value(material.metal_fuzz);
+		hash_value(material.refraction_index);
+		hash_value(material.inner_refraction_index);
+		const texture& texture = material.material_texture;
+		hash_value(texture.texture_type);
+		hash_vector(texture.even_color);
+		hash_vector(texture.odd_color);
+		hash_value(texture.scale);
+		if (texture.texture_type == IMAGE_TEXTURE) {
+			hash_value(image_texture_hash(texture.image_index)); // Texels of the image, so a replaced image file is a new render
+		}
+	}
+	return hash;
+}
+
+// Rows and columns of the image a render covers, the whole image unless the camera sets a region
+struct image_region {
+	int row_begin;
+	int row_end;
+	int column_begin;
+	int column_end;
+};
+
+image_region camera_region(const camera& camera) {
+	if (camera.region_width <= 0 || camera.region_height <= 0) {
+		return { 0, camera.image_height, 0, camera.image_width };
+	}
+	image_region region;
+	region.row_begin = std::min(std::max(camera.region_top, 0), camera.image_height - 1);
+	region.row_end = std::min(region.row_begin + camera.region_height, camera.image_height);
+	region.column_begin = std::min(std::max(camera.region_left, 0), camera.image_width - 1);
+	region.column_end = std::min(region.column_begin + camera.region_width, camera.image_width);
+	return region;
+}
+
+// Fewest and most primary samples taken by a pixel of the region
+void region_sample_range(const image_region& region, int image_width, const std::vector<int>& sample_counts, int& fewest, int& most) {
+	fewest = std::numeric_limits<int>::max();
+	most = 0;
+	for (int i = region.row_begin; i < region.row_end; i++) {
+		for (int j = region.column_begin; j < region.column_end; j++) {
+			int count = sample_counts[static_cast<size_t>(i) * image_width + j];
+			fewest = std::min(fewest, count);
+			most = std::max(most, count);
+		}
+	}
+}
+
+// One progressive pass of the path tracer, every pixel below the target takes up to pass_samples more primary samples after the ones it has
+// Pixels are rendered asynchronously with the box filter, in tiles merged into the image buffers with the other filters
+void render_path_traced_pass(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, render_pixel_function render_pixel_kernel, const image_region& region, int target_samples, int pass_samples, std::vector<int>& sample_counts, sample_buffers& path_samples, aov_buffers& aovs) {
+	std::vector<std::future<void>> futures;
+	int tile_size = (camera.tile_size < 1) ? 1 : camera.tile_size;
+
+	if (camera.pixel_filter.filter_type != BOX_FILTER) {
+		// Samples splat into the neighbouring pixels, so tiles render into buffers of their own, merged into the image when the tile is done
+		for (int i = region.row_begin; i < region.row_end; i += tile_size) {
+			for (int j = region.column_begin; j < region.column_end; j += tile_size) {
+				int row_end = std::min(i + tile_size, region.row_end);
+				int column_end = std::min(j + tile_size, region.column_end);
+				futures.emplace_back(std::async(std::launch::async, [=, &camera, &scene_objects, &sample_objects, &sample_counts, &path_samples, &aovs]() {
+					re_seed_random_generator(); // Re-seed each thread
+
+					sample_buffers tile_samples;
+					initialize_tile_sample_buffers(tile_samples, path_samples, i, row_end, j, column_end);
+					for (int row = i; row < row_end; row++) {
+						for (int column = j; column < column_end; column++) {
+							int& taken = sample_counts[static_cast<size_t>(row) * camera.image_width + column];
+							int nr_samples = std::min(pass_samples, target_samples - taken);
+							if (nr_samples > 0) {
+								render_pixel_kernel(row, column, taken, nr_samples, camera, scene_objects, background_color, sample_objects, tile_samples, aovs);
+								taken += nr_samples;
+							}
+						}
+					}
+					merge_sample_buffers(path_samples, tile_samples);
+				}));
+			}
+		}
+	}
+	else {
+		for (int i = region.row_begin; i < region.row_end; i++) {
+			for (int j = region.column_begin; j < region.column_end; j++) {
+				int& taken = sample_counts[static_cast<size_t>(i) * camera.image_width + j];
+				int nr_samples = std::min(pass_samples, target_samples - taken);
+				if (nr_samples <= 0) {
+					continue;
+				}
+				// Aysnchronous processing of pixels
+				// Add a thread that computes the multi-sampled pixel color
+				futures.emplace_back(std::async(std::launch::async, [=, &camera, &scene_objects, &sample_objects, &taken, &path_samples, &aovs]() {
+					re_seed_random_generator(); // Re-seed each thread
+
+					// Multi-sample a pixel
+					render_pixel_kernel(i, j, taken, nr_samples, camera, scene_objects, background_color, sample_objects, path_samples, aovs);
+					taken += nr_samples;
+				}));
+			}
+			std::cout << "\rScanlines remaining: " << ((region.row_end - 1) - i) << ' ' << std::flush;
+		}
+	}
+
+	for (std::future<void>& future : futures) {
+		future.wait();
 	}
 }
 
@@ -176,43 +789,132 @@ void render(camera& camera) {
 	std::vector<scene_object> scene_objects = create_scene(camera, background_color); // Set up scene objects, camera, background color
 
 	// Get the sample objects in the scene by filtering them out of all scene objects
-	std::vector<scene_object> sample_objects = create_scene(camera, background_color); 
-	for (auto it = sample_objects.begin(); it != sample_objects.end();) {
-		if (it->material != DIELECTRIC && it->material != LIGHT) {
-			it = sample_objects.erase(it);
+	std::vector<scene_object> sample_objects;
+	for (const scene_object& object : scene_objects) {
+		if (object_material(object).material == DIELECTRIC || object_material(object).material == LIGHT) {
+			sample_objects.push_back(object);
 		}
-		else {
-			++it;
+	}
+
+	// Lights alone are the candidates for resampled direct lighting
+	std::vector<scene_object> light_objects;
+	for (const scene_object& sample_object : sample_objects) {
+		if (object_material(sample_object).material == LIGHT) {
+			light_objects.push_back(sample_object);
 		}
 	}
 
+	prepare_single_precision_surfaces(scene_objects); // Float copies of the surfaces for single precision tracing
+
 	initialize(camera); // Set up camera, create viewport from scene creation configurations or default configuration
 
-	std::ofstream output("output.ppm"); // Initialize output stream to ppm file
+	int primary_samples = primary_samples_per_pixel(camera); // Camera rays per pixel, fewer than samples per pixel when paths are split
 
-	output << "P3\n" << camera.image_width << ' ' << camera.image_height << "\n255\n"; // Define file format
+	int features = detect_scene_features(camera, scene_objects) | (camera.single_precision ? FEATURE_SINGLE_PRECISION : 0);
+	render_pixel_function render_pixel_kernel = render_pixel_kernels[features];
+
+	// Images too large for memory are path traced into a mapped framebuffer and never held as a whole
+	if (camera.framebuffer != MEMORY_FRAMEBUFFER) {
+		if (camera.integrator == PATH_TRACING) {
+			print_scene_features(std::cout, features);
+			render_mapped(camera, scene_objects, background_color, sample_objects, render_pixel_kernel, primary_samples);
+			return;
+		}
+		std::cout << "Mapped framebuffers are only filled by the path tracer, rendering in memory" << std::endl;
+	}
 
 	std::vector<std::future<void>> futures; // Create a vector of futures to store the multi-sample ray process for each pixel in
 
 	// Matrix to store the image in, to avoid race conditions
 	std::vector<std::vector<color>> pixel_colors(camera.image_height, std::vector<color>(camera.image_width, color(0.0, 0.0, 0.0)));
 
-	for (int i = 0; i < camera.image_height; i++) {
-		for (int j = 0; j < camera.image_width; j++) {
-			// Aysnchronous processing of pixels
-			// Add a thread that computes the multi-sampled pixel color
-			futures.emplace_back(std::async(std::launch::async, [=, &camera, &scene_objects, &output, &pixel_colors]() {
-				color pixel_color(0.0f, 0.0f, 0.0f); // Initial color for each pixel
-				re_seed_random_generator(); // Re-seed each thread
-
-				// Multi-sample a pixel
-				for (int sample = 0; sample < camera.samples_per_pixel; sample++) {
-					const ray& ray = get_multisample_ray(i, j, camera);
-					pixel_colors[i][j] += ray_color(ray, camera.max_depth, scene_objects, background_color, sample_objects, camera);
-				}
-			}));
+	int tile_size = (camera.tile_size < 1) ? 1 : camera.tile_size;
+
+	sample_buffers path_samples; // Sub-buffers of the path tracer, resolved into the pixel colors once all pixels are done
+	aov_buffers aovs; // First hits of the path tracer samples, recorded for the requested aovs and the guides of the denoiser
+	int enabled_aovs = camera.aovs | ((camera.denoise.iterations > 0) ? (AOV_NORMAL | AOV_ALBEDO | AOV_DEPTH) : 0);
+	if (enabled_aovs != 0) {
+		initialize_aov_buffers(aovs, camera.image_width, camera.image_height, enabled_aovs);
+	}
+	bool resumed = false; // The path tracer continued from a checkpoint
+	reset_clamp_statistics();
+
+	switch (camera.integrator) {
+	case RESAMPLED_DIRECT_LIGHTING:
+		// Resampled direct lighting reuses reservoirs between neighbouring pixels, so tiles are processed asynchronously instead of pixels
+		for (int i = 0; i < camera.image_height; i += tile_size) {
+			for (int j = 0; j < camera.image_width; j += tile_size) {
+				int row_end = std::min(i + tile_size, camera.image_height);
+				int column_end = std::min(j + tile_size, camera.image_width);
+				futures.emplace_back(std::async(std::launch::async, [=, &camera, &scene_objects, &sample_objects, &light_objects, &pixel_colors]() {
+					render_tile_resampled(i, row_end, j, column_end, camera, scene_objects, background_color, sample_objects, light_objects, pixel_colors);
+				}));
+			}
+		}
+	break;
+	case PHOTON_MAPPING:
+		// Photon passes run one after the other, each pass renders all tiles against its own photon map
+		render_photon_passes(camera, scene_objects, background_color, sample_objects, light_objects, pixel_colors);
+	break;
+	case PATH_GUIDING:
+		// Guiding passes also run one after the other since each pass learns from the previous one
+		render_guided_passes(camera, scene_objects, background_color, pixel_colors);
+	break;
+	case BIDIRECTIONAL:
+		// Light subpaths splat into pixels other tiles own, so the splats are kept apart until all tiles are done
+		render_bidirectional(camera, scene_objects, background_color, pixel_colors);
+	break;
+	default: {
+		print_scene_features(std::cout, features);
+		initialize_sample_buffers(path_samples, camera.image_width, camera.image_height, camera.median_of_means_buffers, camera.pixel_filter);
+		std::vector<int> sample_counts(static_cast<size_t>(camera.image_width) * camera.image_height, 0); // Primary samples taken in each pixel
+		uint64_t fingerprint = render_fingerprint(camera, features, background_color, scene_objects);
+
+		// Cached renders keep their samples in the entry of their fingerprint and buffer layout, which is also their checkpoint
+		// Samples per pixel and the region are not part of the key, so a render with more samples or another region continues the same entry
+		std::string checkpoint_path = "output_checkpoint.bin";
+		if (camera.render_cache) {
+			uint64_t key = fingerprint;
+			key = fingerprint_bytes(key, &camera.median_of_means_buffers, sizeof(camera.median_of_means_buffers));
+			key = fingerprint_bytes(key, &camera.pixel_filter.filter_type, sizeof(camera.pixel_filter.filter_type));
+			key = fingerprint_bytes(key, &camera.pixel_filter.radius, sizeof(camera.pixel_filter.radius));
+			checkpoint_path = render_cache_path("render_cache", key);
 		}
-		std::cout << "\rScanlines remaining: " << ((camera.image_height - 1) - i) << ' ' << std::flush;
+
+		// Progressive renders take the samples in passes and keep a checkpoint, so a killed render resumes and a finished one can be extended
+		bool progressive = (camera.checkpoint_interval > 0.0 || camera.resume || camera.render_cache);
+		image_region region = camera_region(camera);
+		int fewest_samples, most_samples;
+		if ((camera.resume || camera.render_cache) && read_checkpoint(checkpoint_path, fingerprint, path_samples, sample_counts)) {
+			region_sample_range(region, camera.image_width, sample_counts, fewest_samples, most_samples);
+			std::cout << (camera.render_cache ? "Render cache holds " : "Resuming from ") << fewest_samples << " of " << primary_samples << " primary samples per pixel" << std::endl;
+			resumed = (most_samples > 0);
+		}
+		else if (camera.resume || camera.render_cache) {
+			std::cout << "Rendering from the start" << std::endl;
+		}
+		aov_buffers no_aovs; // First hits of the samples in the checkpoint are not kept, so the aovs of a resumed render are traced afterwards
+		int pass_samples = progressive ? std::max(camera.samples_per_pass, 1) : primary_samples;
+
+		std::chrono::steady_clock::time_point last_checkpoint = std::chrono::steady_clock::now();
+		bool checkpoint_current = resumed;
+		region_sample_range(region, camera.image_width, sample_counts, fewest_samples, most_samples);
+		while (fewest_samples < primary_samples) {
+			render_path_traced_pass(camera, scene_objects, background_color, sample_objects, render_pixel_kernel, region, primary_samples, pass_samples, sample_counts, path_samples, resumed ? no_aovs : aovs);
+			checkpoint_current = false;
+			if (camera.checkpoint_interval > 0.0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - last_checkpoint).count() >= camera.checkpoint_interval) {
+				std::cout << std::endl;
+				checkpoint_current = write_checkpoint(checkpoint_path, path_samples, sample_counts, fingerprint);
+				last_checkpoint = std::chrono::steady_clock::now();
+			}
+			region_sample_range(region, camera.image_width, sample_counts, fewest_samples, most_samples);
+		}
+		if (progressive && !checkpoint_current) {
+			std::cout << std::endl;
+			write_checkpoint(checkpoint_path, path_samples, sample_counts, fingerprint);
+		}
+	}
+	break;
 	}
 
 	// Resolve all futures computing pixel color values
@@ -220,29 +922,61 @@ void render(camera& camera) {
 	for (std::future<void>& future : futures) {
 		future.wait();
 	}
-	
-	// Log of image width taken from empirical tests
-	double sigma = glm::log(static_cast<double>(camera.image_width));
+	print_texture_cache_statistics(std::cout);
 
-	// Kernel size formula from: https://medium.com/jun94-devpblog/cv-2-gaussian-and-median-filter-separable-2d-filter-2d11ee022c66
-	int kernel_size = 2 * static_cast<int>(glm::ceil(3.0 * sigma)) + 1;
+	// Median of the filter weighted means of the path tracer sub-buffers, scaled so the sum matches samples per pixel, which the color writer divides by
+	if (!path_samples.sums.empty()) {
+		resolve_sample_buffers(path_samples, camera.median_of_means_gini, static_cast<double>(camera.samples_per_pixel), pixel_colors);
+		print_clamp_statistics(std::cout);
+	}
+
+	// Flat row by row copy of the image for post-processing and output
+	std::vector<color> image(static_cast<size_t>(camera.image_width) * camera.image_height);
+	for (int i = 0; i < camera.image_height; i++) {
+		std::copy(pixel_colors[i].begin(), pixel_colors[i].end(), image.begin() + static_cast<size_t>(i) * camera.image_width);
+	}
+
+	// Aovs of the first hits, which the path tracer recorded while rendering and the other integrators have traced afterwards
+	if (aovs.enabled != 0) {
+		bool traced_afterwards = path_samples.sums.empty() || resumed;
+		if (traced_afterwards) {
+			trace_first_hit_aovs(camera, scene_objects, 4, aovs);
+		}
+		resolve_aov_buffers(aovs);
+		if (traced_afterwards) {
+			std::fill(aovs.sample_counts.begin(), aovs.sample_counts.end(), camera.samples_per_pixel); // Samples the integrator took, not the aov rays
+		}
+		write_aov_images(aovs, camera.aovs, "output");
+	}
+
+	// Edge-aware denoising guided by the normal, albedo and depth aovs
+	if (camera.denoise.iterations > 0) {
+		std::cout << "Denoising..." << std::endl;
+		atrous_denoise(image, aovs, camera.denoise, 1.0 / static_cast<double>(camera.samples_per_pixel));
+	}
 
 	// Application of gaussian filter to smooth out image and remove artifacts
-	std::cout << "Applying gaussian filter..." << std::endl;
-	std::vector<std::vector<color>> filtered_pixel_colors = gaussian_filter(pixel_colors, kernel_size, sigma, camera);
+	if (camera.filter_sigma > 0.0) {
+		std::cout << "Applying gaussian filter..." << std::endl;
+		gaussian_filter(image, camera.image_width, camera.image_height, camera.filter_sigma);
+	}
 
-	// Write pixel values from color matrix to output stream
-	std::cout << "Writing pixel colors from matrix to output stream..." << std::endl;
-	for (int i = 0; i < camera.image_height; i++) {
-		for (int j = 0; j < camera.image_width; j++) {
-			const color& pixel_color = pixel_colors[i][j];
-			{
-				write_color(output, pixel_color, camera.samples_per_pixel);
-			}
+	// Only the region is written, cut out of the image after post-processing so filters see the pixels around it as in the whole image
+	image_region region = camera_region(camera);
+	int output_width = region.column_end - region.column_begin;
+	int output_height = region.row_end - region.row_begin;
+	if (output_width != camera.image_width || output_height != camera.image_height) {
+		std::vector<color> region_image(static_cast<size_t>(output_width) * output_height);
+		for (int i = region.row_begin; i < region.row_end; i++) {
+			const color* row = &image[static_cast<size_t>(i) * camera.image_width];
+			std::copy(row + region.column_begin, row + region.column_end, region_image.begin() + static_cast<size_t>(i - region.row_begin) * output_width);
 		}
+		image.swap(region_image);
 	}
 
-	output.close(); // Close output stream
+	// Quantize or convert the whole image and write it to the output file at once
+	std::cout << "Writing the image..." << std::endl;
+	write_image("output", image, output_width, output_height, 1.0 / static_cast<double>(camera.samples_per_pixel), camera.output_format, camera.display);
 
 	std::cout << "Done.\n";
 }
\ No newline at end of file
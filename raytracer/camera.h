@@ -1,8 +1,23 @@
 #pragma once
 #include "util.h"
 #include "geometry.h"
+#include "environment.h"
+#include "post_processing.h"
+#include "accumulation.h"
+#include "image_output.h"
+#include "mapped_framebuffer.h"
+
+// Enum for the integrator used to render the image
+enum integrator_enum {
+	PATH_TRACING,
+	RESAMPLED_DIRECT_LIGHTING,
+	PHOTON_MAPPING,
+	PATH_GUIDING,
+	BIDIRECTIONAL
+};
 
 struct camera {
+	std::string scene_file; // Scene description file rendered instead of the scene function in scene_creation.cpp, compiled to scene_file.cache on its first load, empty renders the scene function
 	double aspect_ratio = 1.0; // Ratio of image width over height
 	int image_width = 100; // Rendered image width in pixel count
 	int samples_per_pixel = 10; // Count of random samples for each pixel
@@ -13,6 +28,41 @@ struct camera {
 	glm::dvec3 camera_up = glm::dvec3(0.0, 1.0, 0.0); // Camera-relative "up" direction
 	double defocus_angle = 0.0; // Variation angle of rays through each pixel, 0.0 turns off depth-of-field
 	double focus_distance = 10.0; // Distance from camera lookfrom point to plane of perfect focus
+	reconstruction_filter pixel_filter; // Filter path traced samples are splatted through to the pixels around them, rendered in tiles unless it is the box filter
+	int median_of_means_buffers = 1; // Interleaved sub-buffers the samples of each path traced pixel are split between, combined with the median of their means to reject fireflies, 1 keeps the plain mean
+	double median_of_means_gini = 0.25; // Inequality of the buffer means, as a gini index, above which a pixel takes their median instead of the plain mean
+	denoise_parameters denoise; // Edge-aware a-trous denoiser guided by the first hit of each pixel, applied before the gaussian filter, 0 iterations turns it off
+	framebuffer_enum framebuffer = MEMORY_FRAMEBUFFER; // Where the image is accumulated, mapped framebuffers keep the tiles of path traced images too large for memory in a file
+	image_format_enum output_format = PPM_IMAGE; // File format the image is written in, as output with the extension of the format
+	tone_mapping display; // Exposure, curve, transfer function, dithering and bit depth of the ppm and png output
+	double checkpoint_interval = 0.0; // Seconds between checkpoints of the path tracer to output_checkpoint.bin, written after the pass that ends past it and when the render is done, 0.0 turns off checkpointing
+	int samples_per_pass = 16; // Camera rays per pixel the path tracer takes in each pass of a checkpointed render
+	bool resume = false; // Continue the path tracer from output_checkpoint.bin, its samples count towards samples per pixel, so a higher count only adds the missing samples, only resumed when the render fingerprint matches: image size, depth, view, focus, clamp, splitting, fast math, kernel features, background, environment texels, every object with its geometry, material, texture, image texels and density grid, the buffers and the filter
+	bool render_cache = false; // Keep the path traced samples in render_cache/ under a hash of the scene, camera and sampling settings, a repeated render reads them back and a render with more samples or another region extends them
+	int region_left = 0; // First column of the region of the image the path tracer renders and the output holds
+	int region_top = 0; // First row of the region
+	int region_width = 0; // Columns of the region, 0 renders the whole image
+	int region_height = 0; // Rows of the region, 0 renders the whole image
+	int aovs = 0; // Bits of aov_enum written as output_<name>.pfm next to the beauty image, 0 writes the beauty image alone
+	double filter_sigma = 0.0; // Standard deviation in pixels of the gaussian filter applied to the image before it is written, 0.0 writes it unfiltered
+	double sample_clamp = 0.0; // Largest luminance a single path traced sample may carry, brighter samples are scaled down to it and reported, 0.0 turns off clamping
+	int splitting_factor = 1; // Secondary continuations traced from each camera ray hit, samples per pixel is divided between them, 1 turns off path splitting
+	int tile_size = 16; // Width and height in pixels of the tiles rendered by tile based integrators
+	integrator_enum integrator = PATH_TRACING; // Integrator used to render the image
+	int light_candidates = 32; // Light samples resampled into the reservoir of each camera ray hit
+	int spatial_reuse_neighbours = 4; // Reservoirs of neighbouring pixels in the same tile combined into each pixel, 0 turns off spatial reuse
+	bool unbiased_reuse = true; // Re-check visibility from neighbouring hits when combining reservoirs, removes the darkening bias near shadow edges
+	int photons_per_pass = 200000; // Photons emitted from the lights for each photon map
+	int photon_passes = 16; // Photon maps traced per render, samples per pixel are divided between them
+	double photon_radius = 0.0; // Initial gather radius of photon lookups, 0.0 derives it from the size of the scene
+	double photon_radius_alpha = 0.7; // Fraction of photons kept when the gather radius shrinks between passes
+	int guiding_training_passes = 6; // Passes with doubling sample counts that train the path guide, the remaining samples use the last learned guide
+	int guiding_spatial_threshold = 4000; // Samples recorded in a region of the path guide in one pass before it is split
+	double guiding_quadtree_threshold = 0.01; // Fraction of the energy in a direction quadrant before it is split
+	std::shared_ptr<const environment_map> environment; // HDR environment lighting the scene, rays that leave the scene see the background color when empty
+	int texture_cache_megabytes = 256; // Memory for image texture tiles shared by all threads, tiles beyond it are evicted and read again from disk
+	bool fast_math = true; // Bounded error approximations of sin, cos, log and acos in sampling routines, false uses the standard library
+	bool single_precision = false; // Path tracing searches the closest surface with float rays and refines the hit in double, radiance is still accumulated in double
 
 	int image_height; // Rendered image height
 	point3 center; // Camera center
@@ -26,8 +76,15 @@ struct camera {
 
 std::ostream& print_camera_configuration(std::ostream& os, const camera& camera);
 void initialize(camera& camera);
-point3 pixel_sample_square(const camera& camera);
 point3 defocus_disk_sample(const camera& camera);
-const ray& get_multisample_ray(int i, int j, const camera& camera);
-color ray_color(const ray& ray, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera);
+ray get_multisample_ray(int i, int j, const camera& camera);
+color glossy_metal_color(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera);
+color environment_direct_light(const hit_record& rec, const std::vector<scene_object>& scene_objects, const camera& camera);
+color environment_mis_ray_color(const ray& scattered_ray, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera);
+color scatter_color(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor);
+color ray_color(const ray& ray, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor = 1);
+color hit_color(const ray& ray_in, const hit_record& rec, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera, int splitting_factor);
+int detect_scene_features(const camera& camera, const std::vector<scene_object>& scene_objects);
+std::ostream& print_scene_features(std::ostream& os, int features);
+int primary_samples_per_pixel(const camera& camera);
 void render(camera& camera);
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "checkpoint.h"
+#include "image_output.h"
+
+const char checkpoint_magic[8] = { 'R', 'T', 'C', 'H', 'E', 'C', 'K', '1' };
+
+// Fixed size start of a checkpoint file, followed by the deflated payload
+struct checkpoint_header {
+	char magic[8];
+	uint64_t fingerprint;
+	int32_t width;
+	int32_t height;
+	int32_t nr_buffers;
+	int32_t filter_type;
+	double filter_radius;
+	uint64_t payload_size; // Bytes of the payload before it was deflated
+	uint32_t payload_adler; // Adler-32 of the payload before it was deflated
+	uint32_t reserved;
+};
+
+// 64 bit FNV-1a, start from 14695981039346656037 and hash every field on its own so padding never enters the hash
+uint64_t fingerprint_bytes(uint64_t hash, const void* data, size_t size) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t k = 0; k < size; k++) {
+		hash = (hash ^ bytes[k]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// Byte k of every value becomes plane k, so the sign and exponent bytes of neighbouring values follow each other
+void split_byte_planes(const unsigned char* values, size_t nr_values, size_t value_size, unsigned char* planes) {
+	for (size_t byte = 0; byte < value_size; byte++) {
+		for (size_t k = 0; k < nr_values; k++) {
+			planes[byte * nr_values + k] = values[k * value_size + byte];
+		}
+	}
+}
+
+void join_byte_planes(const unsigned char* planes, size_t nr_values, size_t value_size, unsigned char* values) {
+	for (size_t byte = 0; byte < value_size; byte++) {
+		for (size_t k = 0; k < nr_values; k++) {
+			values[k * value_size + byte] = planes[byte * nr_values + k];
+		}
+	}
+}
+
+// The payload is the sample counts, then the sums and weights as byte planes, written to a temporary file that replaces the checkpoint once complete
+bool write_checkpoint(const std::string& path, const sample_buffers& samples, const std::vector<int>& sample_counts, uint64_t fingerprint) {
+	size_t nr_values = samples.weights.size();
+	size_t counts_size = sample_counts.size() * sizeof(int32_t);
+	std::vector<unsigned char> payload(counts_size + nr_values * 4 * sizeof(double));
+	for (size_t k = 0; k < sample_counts.size(); k++) {
+		int32_t count = sample_counts[k];
+		std::memcpy(&payload[k * sizeof(int32_t)], &count, sizeof(int32_t));
+	}
+	std::vector<double> channels(nr_values * 3);
+	for (size_t k = 0; k < nr_values; k++) {
+		channels[3 * k] = samples.sums[k].x;
+		channels[3 * k + 1] = samples.sums[k].y;
+		channels[3 * k + 2] = samples.sums[k].z;
+	}
+	split_byte_planes(reinterpret_cast<const unsigned char*>(channels.data()), channels.size(), sizeof(double), &payload[counts_size]);
+	split_byte_planes(reinterpret_cast<const unsigned char*>(samples.weights.data()), nr_values, sizeof(double), &payload[counts_size + channels.size() * sizeof(double)]);
+
+	checkpoint_header header = {};
+	std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+	header.fingerprint = fingerprint;
+	header.width = samples.width;
+	header.height = samples.height;
+	header.nr_buffers = samples.nr_buffers;
+	header.filter_type = samples.filter.filter_type;
+	header.filter_radius = samples.filter.radius;
+	header.payload_size = payload.size();
+	header.payload_adler = adler32(1, payload.data(), payload.size());
+
+	std::vector<unsigned char> file(reinterpret_cast<const unsigned char*>(&header), reinterpret_cast<const unsigned char*>(&header) + sizeof(header));
+	deflate_parts(payload.data(), payload.size(), file);
+	file.push_back(0x03); // Final empty fixed huffman block
+	file.push_back(0x00);
+
+	std::string temporary_path = path + ".tmp";
+	if (!write_file(temporary_path, file) || !replace_file(temporary_path, path)) {
+		std::cerr << "Failed to write the checkpoint " << path << std::endl;
+		std::remove(temporary_path.c_str());
+		return false;
+	}
+	std::cout << "Wrote checkpoint " << path << " (" << file.size() << " bytes, " << payload.size() << " uncompressed)" << std::endl;
+	return true;
+}
+
+// Samples must already be initialized with the layout and filter of the render, it is only filled when everything matches
+bool read_checkpoint(const std::string& path, uint64_t fingerprint, sample_buffers& samples, std::vector<int>& sample_counts) {
+	std::ifstream input(path, std::ios::binary);
+	if (!input) {
+		std::cerr << "No checkpoint " << path << " to resume from" << std::endl;
+		return false;
+	}
+	std::vector<unsigned char> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	checkpoint_header header;
+	if (file.size() < sizeof(header)) {
+		std::cerr << "The checkpoint " << path << " is truncated" << std::endl;
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0) {
+		std::cerr << path << " is not a checkpoint" << std::endl;
+		return false;
+	}
+	if (header.fingerprint != fingerprint) {
+		std::cerr << "The checkpoint " << path << " was rendered with another scene or camera" << std::endl;
+		return false;
+	}
+	if (header.width != samples.width || header.height != samples.height || header.nr_buffers != samples.nr_buffers || header.filter_type != samples.filter.filter_type || header.filter_radius != samples.filter.radius) {
+		std::cerr << "The checkpoint " << path << " has another image size, median of means buffers or filter" << std::endl;
+		return false;
+	}
+
+	size_t nr_pixels = static_cast<size_t>(samples.width) * samples.height;
+	size_t nr_values = samples.weights.size();
+	size_t counts_size = nr_pixels * sizeof(int32_t);
+	std::vector<unsigned char> payload;
+	payload.reserve(header.payload_size);
+	if (header.payload_size != counts_size + nr_values * 4 * sizeof(double) || !inflate_blocks(&file[sizeof(header)], file.size() - sizeof(header), payload) || payload.size() != header.payload_size || adler32(1, payload.data(), payload.size()) != header.payload_adler) {
+		std::cerr << "The checkpoint " << path << " is damaged" << std::endl;
+		return false;
+	}
+
+	sample_counts.resize(nr_pixels);
+	for (size_t k = 0; k < nr_pixels; k++) {
+		int32_t count;
+		std::memcpy(&count, &payload[k * sizeof(int32_t)], sizeof(int32_t));
+		sample_counts[k] = count;
+	}
+	std::vector<double> channels(nr_values * 3);
+	join_byte_planes(&payload[counts_size], channels.size(), sizeof(double), reinterpret_cast<unsigned char*>(channels.data()));
+	join_byte_planes(&payload[counts_size + channels.size() * sizeof(double)], nr_values, sizeof(double), reinterpret_cast<unsigned char*>(samples.weights.data()));
+	for (size_t k = 0; k < nr_values; k++) {
+		samples.sums[k] = color(channels[3 * k], channels[3 * k + 1], channels[3 * k + 2]);
+	}
+	return true;
+}
+
+// Entries of the render cache are checkpoints named by their key, the directory is created with the first entry
+std::string render_cache_path(const std::string& directory, uint64_t key) {
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return directory + "/" + name;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "accumulation.h"
+
+// Progress of a path traced render, the filter weighted sample sums and the primary samples taken in each pixel
+// Written between passes so a killed render resumes from the last checkpoint and a finished render can be extended to more samples
+// The sample counts are deflated as they are and the sums and weights as byte planes, the high bytes of doubles compress well apart from the noisy low bytes
+// A checkpoint is only read back into a render with the same fingerprint, buffer layout and filter, on a machine with the same byte order
+
+uint64_t fingerprint_bytes(uint64_t hash, const void* data, size_t size);
+bool write_checkpoint(const std::string& path, const sample_buffers& samples, const std::vector<int>& sample_counts, uint64_t fingerprint);
+bool read_checkpoint(const std::string& path, uint64_t fingerprint, sample_buffers& samples, std::vector<int>& sample_counts);
+std::string render_cache_path(const std::string& directory, uint64_t key);
@@ -3,5 +3,5 @@
 #include "glm.hpp"
 #include "util.h"
 
-double linear_to_gamma(double linear_component);
-void write_color(std::ostream& out, color pixel_color, int samples_per_pixel);
\ No newline at end of file
+double luminance(const color& color);
+double linear_to_gamma(double linear_component);
\ No newline at end of file
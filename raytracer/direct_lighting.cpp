@@ -0,0 +1,451 @@
+#include <vector>
+#include <algorithm>
+#include "direct_lighting.h"
+#include "geometry.h"
+#include "geometry_util.h"
+#include "volume.h"
+#include "material.h"
+#include "camera.h"
+#include "color.h"
+#include "util.h"
+#include "glm.hpp"
+
+// Reservoir-based resampled direct lighting
+// Each lambertian camera ray hit streams light candidates through a weighted reservoir and keeps one of them in proportion to its unshadowed contribution
+// Reservoirs of neighbouring pixels in the same tile are then combined, so every pixel effectively sees the candidates of its neighbours as well
+// Only the single kept sample per pixel pays for a shadow ray
+
+// Neighbours are only picked within this many pixels of the pixel they are reused into
+const int spatial_reuse_radius = 8;
+
+double light_area(const scene_object& light) {
+	switch (light.object_type) {
+	case SPHERE:
+		return light.sphere_area;
+	case QUAD:
+		return light.quad_area;
+	case CUBE:
+	case ASYMMETRIC_CUBE:
+		return light.cube_area;
+	default:
+		return 1.0;
+	}
+}
+
+// Pick a triangle with probability proportional to its area and a uniform point on it
+light_sample sample_light_triangles(const triangle* triangles, int nr_triangles, double total_area) {
+	double threshold = random_double() * total_area;
+	int index = nr_triangles - 1;
+	for (int i = 0; i < nr_triangles; i++) {
+		threshold -= calculate_triangle_area(triangles[i]);
+		if (threshold <= 0.0) {
+			index = i;
+			break;
+		}
+	}
+
+	const triangle& triangle = triangles[index];
+	double u = random_double();
+	double v = random_double();
+	if (u + v > 1.0) {
+		u = 1.0 - u;
+		v = 1.0 - v;
+	}
+
+	light_sample sample;
+	sample.point = triangle.vertices[0] + u * (triangle.vertices[1] - triangle.vertices[0]) + v * (triangle.vertices[2] - triangle.vertices[0]);
+	sample.normal = triangle.normal;
+	return sample;
+}
+
+// Uniform point on the surface of a light, the area pdf is one over the light area
+light_sample sample_light(const scene_object& light) {
+	light_sample sample;
+
+	switch (light.object_type) {
+	case SPHERE: {
+		glm::dvec3 direction = random_unit_vector();
+		sample.point = light.sphere_center + light.sphere_radius * direction;
+		sample.normal = direction;
+		break;
+	}
+	case QUAD:
+		sample = sample_light_triangles(light.quad_triangles, light.nr_quad_triangles, light.quad_area);
+		break;
+	case CUBE:
+	case ASYMMETRIC_CUBE:
+		sample = sample_light_triangles(light.cube_triangles, light.nr_cube_triangles, light.cube_area);
+		break;
+	default:
+		sample.point = point3(0.0, 0.0, 0.0);
+		sample.normal = glm::dvec3(0.0, 0.0, 1.0);
+		break;
+	}
+
+	sample.emission = object_material(light).material_color;
+	return sample;
+}
+
+// Solid angle density of sample_light producing a direction from the origin
+// Every point along the line through the light maps to the same direction, so all crossings add to the density
+double light_direction_pdf(const scene_object& light, const point3& origin, const glm::dvec3& direction) {
+	ray line = create_ray(origin, glm::normalize(direction));
+	double area = light_area(light);
+	double pdf = 0.0;
+
+	switch (light.object_type) {
+	case SPHERE: {
+		glm::dvec3 oc = line.origin - light.sphere_center;
+		double half_b = glm::dot(oc, line.direction);
+		double c = glm::dot(oc, oc) - light.sphere_radius * light.sphere_radius;
+		double discriminant = half_b * half_b - c;
+		if (discriminant <= 0.0) {
+			return 0.0;
+		}
+
+		double roots[2] = { -half_b - glm::sqrt(discriminant), -half_b + glm::sqrt(discriminant) };
+		for (double distance : roots) {
+			if (distance > 0.0) {
+				glm::dvec3 normal = (ray_at(line, distance) - light.sphere_center) / light.sphere_radius;
+				pdf += distance * distance / (glm::abs(glm::dot(normal, line.direction)) * area);
+			}
+		}
+		return pdf;
+	}
+	case QUAD:
+	case CUBE:
+	case ASYMMETRIC_CUBE: {
+		const triangle* triangles = (light.object_type == QUAD) ? light.quad_triangles : light.cube_triangles;
+		int nr_triangles = (light.object_type == QUAD) ? light.nr_quad_triangles : light.nr_cube_triangles;
+		for (int i = 0; i < nr_triangles; i++) {
+			double distance;
+			if (triangle_line_intersection(line, triangles[i], distance) && distance > 0.0) {
+				pdf += distance * distance / (glm::abs(glm::dot(triangles[i].normal, line.direction)) * area);
+			}
+		}
+		return pdf;
+	}
+	default:
+		return 0.0;
+	}
+}
+
+// Emitted power of a lambertian light
+color light_power(const scene_object& light) {
+	return object_material(light).material_color * (pi * light_area(light));
+}
+
+light_distribution build_light_distribution(const std::vector<scene_object>& light_objects) {
+	light_distribution distribution;
+	for (const scene_object& light : light_objects) {
+		double weight = luminance(light_power(light));
+		distribution.weights.push_back(weight);
+		distribution.total_weight += weight;
+	}
+	return distribution;
+}
+
+// Pick a light index in proportion to its power, returns -1 if no light emits anything
+int pick_light(const light_distribution& distribution, double& probability) {
+	if (distribution.total_weight <= 0.0) {
+		probability = 0.0;
+		return -1;
+	}
+
+	int nr_lights = static_cast<int>(distribution.weights.size());
+	double threshold = random_double() * distribution.total_weight;
+	int light_index = nr_lights - 1;
+	for (int l = 0; l < nr_lights; l++) {
+		threshold -= distribution.weights[l];
+		if (threshold <= 0.0) {
+			light_index = l;
+			break;
+		}
+	}
+
+	probability = distribution.weights[light_index] / distribution.total_weight;
+	return light_index;
+}
+
+// Lambertian reflection of the light sample at the hit without visibility, in area measure
+color unshadowed_light_contribution(const hit_record& rec, const light_sample& sample) {
+	glm::dvec3 to_light = sample.point - rec.point;
+	double distance_squared = glm::dot(to_light, to_light);
+	if (distance_squared <= 0.0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	glm::dvec3 direction = to_light / glm::sqrt(distance_squared);
+
+	double cosine_surface = glm::dot(rec.normal, direction);
+	double cosine_light = glm::dot(sample.normal, -direction);
+
+	if (cosine_surface <= 0.0 || cosine_light <= 0.0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	return (rec.material_color / pi) * sample.emission * (cosine_surface * cosine_light / distance_squared);
+}
+
+// The target distribution reservoirs resample towards, proportional to the unshadowed contribution
+double light_target_pdf(const hit_record& rec, const light_sample& sample) {
+	return luminance(unshadowed_light_contribution(rec, sample));
+}
+
+// Shadow ray between two points
+bool points_visible(const point3& from, const point3& to, const std::vector<scene_object>& scene_objects) {
+	glm::dvec3 direction = to - from;
+	double distance = glm::length(direction);
+
+	hit_record occluder;
+	ray shadow_ray = create_ray(from, direction / distance);
+
+	// Direction is normalized so intersection times are distances for every geometry
+	return !find_intersection(shadow_ray, interval{ 0.001, distance - 0.001 }, occluder, scene_objects);
+}
+
+// Fraction of light passing between two points, surfaces block it entirely and media attenuate it by ratio tracking
+double points_transmittance(const point3& from, const point3& to, const std::vector<scene_object>& scene_objects) {
+	glm::dvec3 direction = to - from;
+	double distance = glm::length(direction);
+
+	hit_record occluder;
+	ray shadow_ray = create_ray(from, direction / distance);
+	interval shadow_time = interval{ 0.001, distance - 0.001 };
+
+	if (find_intersection(shadow_ray, shadow_time, occluder, scene_objects, false)) {
+		return 0.0;
+	}
+	return medium_transmittance(shadow_ray, shadow_time, scene_objects);
+}
+
+// Shadow ray from the hit to the light sample
+bool light_visible(const hit_record& rec, const light_sample& sample, const std::vector<scene_object>& scene_objects) {
+	return points_visible(rec.point, sample.point, scene_objects);
+}
+
+// Stream one candidate through the reservoir, returns true if the candidate replaced the kept sample
+bool update_reservoir(reservoir& reservoir, const light_sample& sample, double weight, double target_pdf) {
+	reservoir.weight_sum += weight;
+	reservoir.candidate_count += 1;
+
+	if (weight > 0.0 && random_double() * reservoir.weight_sum < weight) {
+		reservoir.sample = sample;
+		reservoir.target_pdf = target_pdf;
+		return true;
+	}
+
+	return false;
+}
+
+// Resampled importance sampling of light candidates at a single hit
+// Candidates pick a light uniformly and a uniform point on it
+reservoir resample_light_candidates(const hit_record& rec, const std::vector<scene_object>& light_objects, int candidate_count) {
+	reservoir reservoir;
+	int nr_lights = static_cast<int>(light_objects.size());
+
+	if (nr_lights == 0) {
+		return reservoir;
+	}
+
+	for (int candidate = 0; candidate < candidate_count; candidate++) {
+		int light_index = std::min(static_cast<int>(random_double() * nr_lights), nr_lights - 1);
+		const scene_object& light = light_objects[light_index];
+
+		light_sample sample = sample_light(light);
+		double target_pdf = light_target_pdf(rec, sample);
+		double source_pdf = 1.0 / (static_cast<double>(nr_lights) * light_area(light));
+
+		update_reservoir(reservoir, sample, target_pdf / source_pdf, target_pdf);
+	}
+
+	if (reservoir.target_pdf > 0.0) {
+		reservoir.contribution_weight = reservoir.weight_sum / (static_cast<double>(reservoir.candidate_count) * reservoir.target_pdf);
+	}
+
+	return reservoir;
+}
+
+// Combine the reservoir of a pixel, always first in the list, with reservoirs of its neighbours
+// The kept samples are re-weighted by their target function at this hit since they were resampled for other hits
+// The unbiased mode only normalizes by the candidates of neighbours that could actually have produced the kept sample, checked with a shadow ray
+reservoir combine_reservoirs(const hit_record& rec, const std::vector<const reservoir*>& reservoirs, const std::vector<const hit_record*>& reservoir_hits, const std::vector<scene_object>& scene_objects, bool unbiased) {
+	reservoir combined;
+	int candidate_count = 0;
+
+	for (int i = 0; i < static_cast<int>(reservoirs.size()); i++) {
+		const reservoir& neighbour = *reservoirs[i];
+		candidate_count += neighbour.candidate_count;
+
+		if (neighbour.contribution_weight <= 0.0) {
+			continue;
+		}
+
+		double target_pdf = light_target_pdf(rec, neighbour.sample);
+		update_reservoir(combined, neighbour.sample, target_pdf * neighbour.contribution_weight * neighbour.candidate_count, target_pdf);
+	}
+
+	combined.candidate_count = candidate_count;
+
+	if (combined.target_pdf <= 0.0) {
+		return combined;
+	}
+
+	double normalization = static_cast<double>(candidate_count);
+
+	if (unbiased) {
+		normalization = 0.0;
+		for (int i = 0; i < static_cast<int>(reservoirs.size()); i++) {
+			const hit_record& neighbour_hit = *reservoir_hits[i];
+			if (light_target_pdf(neighbour_hit, combined.sample) <= 0.0) {
+				continue;
+			}
+			// The pixel's own visibility is tested once when shading
+			if (i > 0 && !light_visible(neighbour_hit, combined.sample, scene_objects)) {
+				continue;
+			}
+			normalization += reservoirs[i]->candidate_count;
+		}
+	}
+
+	if (normalization > 0.0) {
+		combined.contribution_weight = combined.weight_sum / (normalization * combined.target_pdf);
+	}
+
+	return combined;
+}
+
+// Shade a lambertian camera ray hit, direct light comes from the reservoir and indirect light from cosine sampled continuations
+// Continuations that directly hit a light are dropped since that light is already accounted for by the reservoir
+color resampled_hit_color(const ray& ray_in, const hit_record& rec, const reservoir& reservoir, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects) {
+	color direct = color(0.0, 0.0, 0.0);
+	if (reservoir.contribution_weight > 0.0) {
+		direct = unshadowed_light_contribution(rec, reservoir.sample) * reservoir.contribution_weight * points_transmittance(rec.point, reservoir.sample.point, scene_objects);
+	}
+
+	int depth = camera.max_depth - 1;
+	if (depth <= 0) {
+		return direct;
+	}
+
+	int splitting_factor = (camera.splitting_factor < 1) ? 1 : camera.splitting_factor;
+	color indirect = color(0.0, 0.0, 0.0);
+
+	for (int split = 0; split < splitting_factor; split++) {
+		ray scattered_ray;
+		color attenuation;
+		double pdf;
+
+		if (!lambertian_scatter(ray_in, rec, attenuation, scattered_ray, pdf) || pdf <= 0.0) {
+			continue;
+		}
+
+		hit_record next_rec;
+		color incoming = background_radiance(camera.environment.get(), scattered_ray.direction, background_color);
+		if (find_intersection(scattered_ray, interval{ 0.001, infinity }, next_rec, scene_objects)) {
+			incoming = (next_rec.material == LIGHT) ? color(0.0, 0.0, 0.0) : hit_color(scattered_ray, next_rec, depth, scene_objects, background_color, sample_objects, camera, 1);
+		}
+
+		indirect += attenuation * lambertian_scatter_pdf(ray_in, rec, scattered_ray) * incoming / pdf;
+	}
+
+	return direct + indirect / static_cast<double>(splitting_factor);
+}
+
+// Render a tile with resampled direct lighting
+// Every camera sample is done for the whole tile at once so reservoirs of neighbouring pixels are available for reuse
+void render_tile_resampled(int row_begin, int row_end, int column_begin, int column_end, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const std::vector<scene_object>& light_objects, std::vector<std::vector<color>>& pixel_colors) {
+	re_seed_random_generator(); // Re-seed each thread
+
+	int tile_height = row_end - row_begin;
+	int tile_width = column_end - column_begin;
+	int nr_pixels = tile_height * tile_width;
+	int primary_samples = primary_samples_per_pixel(camera);
+
+	std::vector<ray> camera_rays(nr_pixels);
+	std::vector<hit_record> camera_hits(nr_pixels);
+	std::vector<bool> hit_anything(nr_pixels, false);
+	std::vector<bool> hit_lambertian(nr_pixels, false);
+	std::vector<reservoir> pixel_reservoirs(nr_pixels);
+	std::vector<reservoir> reused_reservoirs(nr_pixels);
+
+	std::vector<const reservoir*> reservoirs;
+	std::vector<const hit_record*> reservoir_hits;
+
+	for (int sample = 0; sample < primary_samples; sample++) {
+		// Camera rays and initial reservoirs for the whole tile
+		for (int pixel = 0; pixel < nr_pixels; pixel++) {
+			int i = row_begin + pixel / tile_width;
+			int j = column_begin + pixel % tile_width;
+
+			camera_rays[pixel] = get_multisample_ray(i, j, camera);
+			hit_anything[pixel] = find_intersection(camera_rays[pixel], interval{ 0.001, infinity }, camera_hits[pixel], scene_objects);
+			hit_lambertian[pixel] = hit_anything[pixel] && camera_hits[pixel].material == LAMBERTIAN;
+
+			if (hit_lambertian[pixel]) {
+				pixel_reservoirs[pixel] = resample_light_candidates(camera_hits[pixel], light_objects, camera.light_candidates);
+			}
+		}
+
+		// Spatial reuse from random neighbours with similar geometry, read from the initial reservoirs so the order of pixels doesn't matter
+		for (int pixel = 0; pixel < nr_pixels; pixel++) {
+			if (!hit_lambertian[pixel]) {
+				continue;
+			}
+
+			const hit_record& rec = camera_hits[pixel];
+			double distance = glm::distance(camera_rays[pixel].origin, rec.point);
+
+			reservoirs.assign(1, &pixel_reservoirs[pixel]);
+			reservoir_hits.assign(1, &rec);
+
+			for (int neighbour = 0; neighbour < camera.spatial_reuse_neighbours; neighbour++) {
+				int row = pixel / tile_width + static_cast<int>(glm::round(random_double(-spatial_reuse_radius, spatial_reuse_radius)));
+				int column = pixel % tile_width + static_cast<int>(glm::round(random_double(-spatial_reuse_radius, spatial_reuse_radius)));
+				if (row < 0 || row >= tile_height || column < 0 || column >= tile_width) {
+					continue;
+				}
+
+				int neighbour_pixel = row * tile_width + column;
+				if (neighbour_pixel == pixel || !hit_lambertian[neighbour_pixel]) {
+					continue;
+				}
+
+				// Reject neighbours on differently oriented or distant surfaces, their light samples rarely fit this hit
+				const hit_record& neighbour_rec = camera_hits[neighbour_pixel];
+				double neighbour_distance = glm::distance(camera_rays[neighbour_pixel].origin, neighbour_rec.point);
+				if (glm::dot(rec.normal, neighbour_rec.normal) < 0.9 || glm::abs(neighbour_distance - distance) > 0.1 * distance) {
+					continue;
+				}
+
+				reservoirs.push_back(&pixel_reservoirs[neighbour_pixel]);
+				reservoir_hits.push_back(&neighbour_rec);
+			}
+
+			reused_reservoirs[pixel] = (reservoirs.size() > 1) ? combine_reservoirs(rec, reservoirs, reservoir_hits, scene_objects, camera.unbiased_reuse) : pixel_reservoirs[pixel];
+		}
+
+		// Shade every pixel of the tile
+		for (int pixel = 0; pixel < nr_pixels; pixel++) {
+			int i = row_begin + pixel / tile_width;
+			int j = column_begin + pixel % tile_width;
+
+			if (!hit_anything[pixel]) {
+				pixel_colors[i][j] += background_radiance(camera.environment.get(), camera_rays[pixel].direction, background_color);
+			}
+			else if (hit_lambertian[pixel]) {
+				pixel_colors[i][j] += resampled_hit_color(camera_rays[pixel], camera_hits[pixel], reused_reservoirs[pixel], camera, scene_objects, background_color, sample_objects);
+			}
+			else {
+				pixel_colors[i][j] += hit_color(camera_rays[pixel], camera_hits[pixel], camera.max_depth, scene_objects, background_color, sample_objects, camera, camera.splitting_factor);
+			}
+		}
+	}
+
+	// Rescale so the sum matches samples per pixel, which the color writer divides by
+	for (int i = row_begin; i < row_end; i++) {
+		for (int j = column_begin; j < column_end; j++) {
+			pixel_colors[i][j] *= static_cast<double>(camera.samples_per_pixel) / static_cast<double>(primary_samples);
+		}
+	}
+}
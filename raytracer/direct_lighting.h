@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include "util.h"
+#include "geometry.h"
+#include "camera.h"
+
+// A point sampled uniformly by area on the surface of a light
+struct light_sample {
+	point3 point;
+	glm::dvec3 normal;
+	color emission; // Lights only emit from the side their geometry can be hit from, the front face of quads
+};
+
+// Lights picked in proportion to their emitted power
+struct light_distribution {
+	std::vector<double> weights;
+	double total_weight = 0.0;
+};
+
+// Weighted reservoir that keeps one light sample out of a stream of candidates
+struct reservoir {
+	light_sample sample;
+	double weight_sum = 0.0; // Sum of resampling weights of all candidates seen
+	double target_pdf = 0.0; // Target function of the kept sample at the hit owning the reservoir
+	double contribution_weight = 0.0; // Unbiased contribution weight of the kept sample
+	int candidate_count = 0; // Number of candidates the reservoir represents
+};
+
+double light_area(const scene_object& light);
+light_sample sample_light(const scene_object& light);
+double light_direction_pdf(const scene_object& light, const point3& origin, const glm::dvec3& direction);
+color light_power(const scene_object& light);
+light_distribution build_light_distribution(const std::vector<scene_object>& light_objects);
+int pick_light(const light_distribution& distribution, double& probability);
+
+color unshadowed_light_contribution(const hit_record& rec, const light_sample& sample);
+double light_target_pdf(const hit_record& rec, const light_sample& sample);
+bool points_visible(const point3& from, const point3& to, const std::vector<scene_object>& scene_objects);
+double points_transmittance(const point3& from, const point3& to, const std::vector<scene_object>& scene_objects);
+bool light_visible(const hit_record& rec, const light_sample& sample, const std::vector<scene_object>& scene_objects);
+
+bool update_reservoir(reservoir& reservoir, const light_sample& sample, double weight, double target_pdf);
+reservoir resample_light_candidates(const hit_record& rec, const std::vector<scene_object>& light_objects, int candidate_count);
+reservoir combine_reservoirs(const hit_record& rec, const std::vector<const reservoir*>& reservoirs, const std::vector<const hit_record*>& reservoir_hits, const std::vector<scene_object>& scene_objects, bool unbiased);
+
+void render_tile_resampled(int row_begin, int row_end, int column_begin, int column_end, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const std::vector<scene_object>& light_objects, std::vector<std::vector<color>>& pixel_colors);
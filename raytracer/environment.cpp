@@ -0,0 +1,195 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include "environment.h"
+#include "color.h"
+#include "util.h"
+#include "glm.hpp"
+#include "fast_math.h"
+
+// Portable float map, a text header followed by raw 32 bit floats with rows stored from the bottom up
+// The sign of the scale in the header gives the byte order, negative is little endian
+bool load_pfm(const std::string& path, int& width, int& height, std::vector<color>& texels) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cout << "Could not open environment map " << path << std::endl;
+		return false;
+	}
+
+	std::string format;
+	double scale;
+	file >> format >> width >> height >> scale;
+	file.get(); // Single whitespace character before the data
+
+	int channels = (format == "PF") ? 3 : ((format == "Pf") ? 1 : 0);
+	if (!file || channels == 0 || width <= 0 || height <= 0) {
+		std::cout << "Environment map " << path << " is not a valid PFM file" << std::endl;
+		return false;
+	}
+
+	std::vector<float> data(static_cast<size_t>(width) * height * channels);
+	file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+	if (!file) {
+		std::cout << "Environment map " << path << " is truncated" << std::endl;
+		return false;
+	}
+
+	// Swap bytes when the file order differs from the machine order
+	const uint16_t probe = 1;
+	bool machine_little_endian = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+	if ((scale < 0.0) != machine_little_endian) {
+		for (float& value : data) {
+			uint8_t bytes[4];
+			std::memcpy(bytes, &value, 4);
+			std::swap(bytes[0], bytes[3]);
+			std::swap(bytes[1], bytes[2]);
+			std::memcpy(&value, bytes, 4);
+		}
+	}
+
+	texels.resize(static_cast<size_t>(width) * height);
+	for (int row = 0; row < height; row++) {
+		const float* source = data.data() + static_cast<size_t>(height - 1 - row) * width * channels;
+		for (int column = 0; column < width; column++) {
+			const float* texel = source + column * channels;
+			texels[row * width + column] = (channels == 3) ? color(texel[0], texel[1], texel[2]) : color(texel[0], texel[0], texel[0]);
+		}
+	}
+
+	return true;
+}
+
+// Texels are weighted by their luminance times the sine of their polar angle, rows near the poles cover less solid angle
+std::shared_ptr<const environment_map> build_environment_map(int width, int height, const std::vector<color>& texels) {
+	std::shared_ptr<environment_map> environment = std::make_shared<environment_map>();
+	environment->width = width;
+	environment->height = height;
+	environment->texels = texels;
+	environment->marginal_cdf.assign(height + 1, 0.0);
+	environment->conditional_cdfs.assign(static_cast<size_t>(height) * (width + 1), 0.0);
+
+	for (int row = 0; row < height; row++) {
+		double sin_theta = glm::sin(pi * (row + 0.5) / height);
+		double* conditional = &environment->conditional_cdfs[static_cast<size_t>(row) * (width + 1)];
+		for (int column = 0; column < width; column++) {
+			conditional[column + 1] = conditional[column] + luminance(texels[row * width + column]) * sin_theta;
+		}
+		environment->marginal_cdf[row + 1] = environment->marginal_cdf[row] + conditional[width];
+	}
+
+	environment->total_weight = environment->marginal_cdf[height];
+	return environment;
+}
+
+std::shared_ptr<const environment_map> load_environment_map(const std::string& path, double intensity) {
+	int width, height;
+	std::vector<color> texels;
+	if (!load_pfm(path, width, height, texels)) {
+		return nullptr;
+	}
+
+	for (color& texel : texels) {
+		texel *= intensity;
+	}
+	return build_environment_map(width, height, texels);
+}
+
+// Procedural sky for scenes without an HDR file, a gradient from the horizon to the zenith, a dark ground and a small bright sun
+std::shared_ptr<const environment_map> create_sky_environment_map(const glm::dvec3& sun_direction, const color& sun_color, const color& zenith_color, const color& horizon_color, int width) {
+	int height = width / 2;
+	glm::dvec3 sun = glm::normalize(sun_direction);
+	double sun_cosine = glm::cos(glm::radians(2.0)); // Angular radius of the sun disk, a few texels wide at the default resolution
+	std::vector<color> texels(static_cast<size_t>(width) * height);
+
+	for (int row = 0; row < height; row++) {
+		double theta = pi * (row + 0.5) / height;
+		for (int column = 0; column < width; column++) {
+			double phi = 2.0 * pi * (column + 0.5) / width;
+			glm::dvec3 direction = glm::dvec3(glm::sin(theta) * glm::sin(phi), glm::cos(theta), -glm::sin(theta) * glm::cos(phi));
+
+			color sky = (direction.y >= 0.0) ? glm::mix(horizon_color, zenith_color, glm::sqrt(direction.y)) : 0.3 * horizon_color;
+			if (glm::dot(direction, sun) > sun_cosine) {
+				sky += sun_color;
+			}
+			texels[row * width + column] = sky;
+		}
+	}
+
+	return build_environment_map(width, height, texels);
+}
+
+// Texel the direction falls into, the map is piecewise constant so lookups and densities agree
+int environment_texel(const environment_map& environment, const glm::dvec3& direction, double& sin_theta) {
+	glm::dvec3 unit_direction = glm::normalize(direction);
+	double theta = fast_acos(glm::clamp(unit_direction.y, -1.0, 1.0));
+	double phi = glm::atan(unit_direction.x, -unit_direction.z);
+	if (phi < 0.0) {
+		phi += 2.0 * pi;
+	}
+
+	int row = std::min(static_cast<int>(theta / pi * environment.height), environment.height - 1);
+	int column = std::min(static_cast<int>(phi / (2.0 * pi) * environment.width), environment.width - 1);
+	sin_theta = glm::sin(theta);
+	return row * environment.width + column;
+}
+
+color environment_radiance(const environment_map& environment, const glm::dvec3& direction) {
+	double sin_theta;
+	return environment.texels[environment_texel(environment, direction, sin_theta)];
+}
+
+// Index of the interval of a CDF the value falls into
+int search_cdf(const double* cdf, int nr_intervals, double value) {
+	int index = static_cast<int>(std::upper_bound(cdf, cdf + nr_intervals + 1, value) - cdf) - 1;
+	return glm::clamp(index, 0, nr_intervals - 1);
+}
+
+// Pick a row from the marginal CDF, a texel in it from the conditional CDF and a uniform point in the texel
+// The density is converted from the unit square to solid angle through the sine of the polar angle
+glm::dvec3 sample_environment(const environment_map& environment, double& pdf) {
+	pdf = 0.0;
+	if (environment.total_weight <= 0.0) {
+		return glm::dvec3(0.0, 1.0, 0.0);
+	}
+
+	double row_value = random_double() * environment.total_weight;
+	int row = search_cdf(environment.marginal_cdf.data(), environment.height, row_value);
+
+	const double* conditional = &environment.conditional_cdfs[static_cast<size_t>(row) * (environment.width + 1)];
+	double column_value = random_double() * conditional[environment.width];
+	int column = search_cdf(conditional, environment.width, column_value);
+
+	double theta = pi * (row + random_double()) / environment.height;
+	double phi = 2.0 * pi * (column + random_double()) / environment.width;
+	double sin_theta, cos_theta, sin_phi, cos_phi;
+	fast_sincos(theta, sin_theta, cos_theta);
+	fast_sincos(phi, sin_phi, cos_phi);
+	if (sin_theta <= 0.0) {
+		return glm::dvec3(0.0, 1.0, 0.0);
+	}
+
+	double texel_weight = conditional[column + 1] - conditional[column];
+	pdf = texel_weight / environment.total_weight * environment.width * environment.height / (2.0 * pi * pi * sin_theta);
+	return glm::dvec3(sin_theta * sin_phi, cos_theta, -sin_theta * cos_phi);
+}
+
+double environment_pdf(const environment_map& environment, const glm::dvec3& direction) {
+	double sin_theta;
+	int texel = environment_texel(environment, direction, sin_theta);
+	if (environment.total_weight <= 0.0 || sin_theta <= 0.0) {
+		return 0.0;
+	}
+
+	int row = texel / environment.width;
+	int column = texel % environment.width;
+	const double* conditional = &environment.conditional_cdfs[static_cast<size_t>(row) * (environment.width + 1)];
+	double texel_weight = conditional[column + 1] - conditional[column];
+	return texel_weight / environment.total_weight * environment.width * environment.height / (2.0 * pi * pi * sin_theta);
+}
+
+// Radiance arriving along a ray that leaves the scene
+color background_radiance(const environment_map* environment, const glm::dvec3& direction, const color& background_color) {
+	return environment ? environment_radiance(*environment, direction) : background_color;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include "util.h"
+
+// Equirectangular HDR environment around the scene, importance sampled through a marginal and conditional CDF
+// Row 0 is straight up, column 0 looks down the negative z-axis and columns run towards the positive x-axis
+struct environment_map {
+	int width = 0;
+	int height = 0;
+	std::vector<color> texels; // Radiance of each texel, row by row from the top
+	std::vector<double> marginal_cdf; // Cumulative weight of the rows, height + 1 entries
+	std::vector<double> conditional_cdfs; // Cumulative weight of the texels in each row, width + 1 entries per row
+	double total_weight = 0.0; // Sum of the luminance of all texels weighted by the solid angle they cover
+};
+
+bool load_pfm(const std::string& path, int& width, int& height, std::vector<color>& texels);
+std::shared_ptr<const environment_map> build_environment_map(int width, int height, const std::vector<color>& texels);
+std::shared_ptr<const environment_map> load_environment_map(const std::string& path, double intensity = 1.0);
+std::shared_ptr<const environment_map> create_sky_environment_map(const glm::dvec3& sun_direction, const color& sun_color, const color& zenith_color, const color& horizon_color, int width = 512);
+
+color environment_radiance(const environment_map& environment, const glm::dvec3& direction);
+glm::dvec3 sample_environment(const environment_map& environment, double& pdf);
+double environment_pdf(const environment_map& environment, const glm::dvec3& direction);
+color background_radiance(const environment_map* environment, const glm::dvec3& direction, const color& background_color);
@@ -0,0 +1,61 @@
+#include <cmath>
+#include <cstdint>
+#include "fast_math.h"
+#include "util.h"
+
+// Approximations are on unless the camera turns them off, read on every call so a render can compare both
+static bool use_approximations = true;
+
+void configure_fast_math(bool enabled) {
+	use_approximations = enabled;
+}
+
+bool fast_math_enabled() {
+	return use_approximations;
+}
+
+// Reduced to the quadrant around the nearest multiple of pi / 2, pi / 2 is split in two parts so the reduction stays exact for the angles of a sampling routine
+// Taylor polynomials on [-pi / 4, pi / 4] with the first omitted term below 1e-11, the quadrant then swaps and negates them
+void fast_sincos(double x, double& sine, double& cosine) {
+	if (!use_approximations) {
+		sine = std::sin(x);
+		cosine = std::cos(x);
+		return;
+	}
+
+	const double half_pi_high = 1.57079632673412561417; // First 33 bits of pi / 2
+	const double half_pi_low = 6.07710050650619224932e-11; // Remainder of pi / 2
+	double scaled = x * (2.0 / pi);
+	int64_t k = static_cast<int64_t>(scaled + std::copysign(0.5, scaled)); // Rounded by truncation, floor is a library call on some targets
+	double quadrant = static_cast<double>(k);
+	double r = (x - quadrant * half_pi_high) - quadrant * half_pi_low;
+	double r2 = r * r;
+
+	double s = r + r * r2 * (-1.0 / 6.0 + r2 * (1.0 / 120.0 + r2 * (-1.0 / 5040.0 + r2 * (1.0 / 362880.0 + r2 * (-1.0 / 39916800.0)))));
+	double c = 1.0 + r2 * (-0.5 + r2 * (1.0 / 24.0 + r2 * (-1.0 / 720.0 + r2 * (1.0 / 40320.0 + r2 * (-1.0 / 3628800.0 + r2 * (1.0 / 479001600.0))))));
+
+	// Quadrant swaps and signs are blended arithmetically, random angles would mispredict branches on them
+	double odd = static_cast<double>(k & 1);
+	double swapped_sine = s + odd * (c - s);
+	double swapped_cosine = c + odd * (s - c);
+	sine = swapped_sine * static_cast<double>(1 - (k & 2));
+	cosine = swapped_cosine * static_cast<double>(1 - ((k + 1) & 2));
+}
+
+// Abramowitz and Stegun 4.4.46, acos of |x| as sqrt(1 - |x|) times a degree 7 polynomial, reflected around pi / 2 for negative arguments
+double fast_acos(double x) {
+	if (!use_approximations) {
+		return std::acos(x);
+	}
+
+	double a = std::fabs(x);
+	double polynomial = 1.5707963050 + a * (-0.2145988016 + a * (0.0889789874 + a * (-0.0501743046 + a * (0.0308918810 + a * (-0.0170881256 + a * (0.0066700901 + a * -0.0012624911))))));
+	double result = std::sqrt(glm::max(0.0, 1.0 - a)) * polynomial;
+	return (x < 0.0) ? pi - result : result;
+}
+
+// Exact up to rounding, replaces pow with an integer exponent in the fresnel terms
+double pow5(double x) {
+	double x2 = x * x;
+	return x2 * x2 * x;
+}
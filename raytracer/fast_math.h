@@ -0,0 +1,11 @@
+#pragma once
+
+// Bounded error approximations of the transcendental functions on the hot path, straight-line code apart from the switch so loops over them can vectorize
+// Maximum errors measured against the standard library over the domains below
+// fast_sincos: 7e-12 absolute for |x| <= 1e4
+// fast_acos: 2.2e-8 absolute on [-1, 1]
+void configure_fast_math(bool enabled);
+bool fast_math_enabled();
+void fast_sincos(double x, double& sine, double& cosine);
+double fast_acos(double x);
+double pow5(double x);
@@ -1,11 +1,34 @@
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include "geometry.h"
 #include "glm.hpp"
 #include "util.h"
 #include "material.h"
 #include "gtc/matrix_transform.hpp"
 #include "geometry_util.h"
+#include "volume.h"
+#include "fast_math.h"
+
+// Material of an object, looked up in the material table through its id
+const material_properties& object_material(const scene_object& object) {
+	return get_material(object.material_id);
+}
+
+// Dielectric spheres and boxes become shells so that refracted rays can leave them
+void set_object_material(scene_object& object, const material_properties& properties) {
+	object.material_id = register_material(properties);
+	object.dielectric_shell = properties.material == DIELECTRIC && object.object_type != QUAD;
+}
+
+void assign_material(scene_object& object, material_enum material, color material_color, double metal_fuzz, double refraction_index) {
+	material_properties properties;
+	properties.material = material;
+	properties.material_color = material_color;
+	properties.metal_fuzz = metal_fuzz;
+	properties.refraction_index = refraction_index;
+	set_object_material(object, properties);
+}
 
 // A sphere is an implicit surface
 scene_object create_sphere(point3 center, double radius, material_enum material, color color, double metal_fuzz, double refraction_index) {
@@ -18,10 +41,7 @@ scene_object create_sphere(point3 center, double radius, material_enum material,
 	sphere.sphere_area = 4.0 * pi * (radius * radius);
 
 	// Material properties
-	sphere.material = material;
-	sphere.material_color = color;
-	sphere.metal_fuzz = metal_fuzz;
-	sphere.refraction_index = refraction_index;
+	assign_material(sphere, material, color, metal_fuzz, refraction_index);
 
 	return sphere;
 }
@@ -32,10 +52,7 @@ scene_object create_quad(point3 top_left, point3 top_right, point3 bottom_left,
 	quad.object_type = QUAD;
 	quad.quad_center = (top_left + top_right + bottom_left + bottom_right) * 0.25;
 
-	quad.material = material;
-	quad.material_color = color;
-	quad.metal_fuzz = metal_fuzz;
-	quad.refraction_index = refraction_index;
+	assign_material(quad, material, color, metal_fuzz, refraction_index);
 
 	// Define the vertices of the quad
 	triangle triangles[2];
@@ -54,10 +71,14 @@ scene_object create_quad(point3 top_left, point3 top_right, point3 bottom_left,
 	triangles[0].normal = glm::normalize(glm::cross(triangles[0].vertices[2] - triangles[0].vertices[1], triangles[0].vertices[0] - triangles[0].vertices[1]));
 	triangles[1].normal = glm::normalize(glm::cross(triangles[1].vertices[0] - triangles[1].vertices[2], triangles[1].vertices[1] - triangles[1].vertices[2]));
 
+	// Texture coordinates span the unit square with v running from the bottom edge to the top edge
+	const double corner_coordinates[2][3][2] = { { { 1.0, 1.0 }, { 0.0, 1.0 }, { 0.0, 0.0 } }, { { 1.0, 1.0 }, { 0.0, 0.0 }, { 1.0, 0.0 } } };
+
 	// Assign the triangles to the quad
 	for (int i = 0; i < 2; i++) {
 		quad.quad_triangles[i] = triangles[i];
 		quad.quad_triangles[i].center = calculate_triangle_center(quad.quad_triangles[i]);
+		set_texture_coordinates(quad.quad_triangles[i], corner_coordinates[i]);
 	}
 
 	quad.quad_area = calculate_quad_area(quad);
@@ -71,10 +92,7 @@ scene_object create_quad(point3 center, double width, double height, material_en
 	quad.object_type = QUAD;
 	quad.quad_center = center;
 
-	quad.material = material;
-	quad.material_color = color;
-	quad.metal_fuzz = metal_fuzz;
-	quad.refraction_index = refraction_index;
+	assign_material(quad, material, color, metal_fuzz, refraction_index);
 
 	// Calculate half-width and half-height
 	double half_width = width * 0.5;
@@ -102,10 +120,14 @@ scene_object create_quad(point3 center, double width, double height, material_en
 	triangles[0].normal = glm::normalize(glm::cross(triangles[0].vertices[2] - triangles[0].vertices[1], triangles[0].vertices[0] - triangles[0].vertices[1]));
 	triangles[1].normal = glm::normalize(glm::cross(triangles[1].vertices[0] - triangles[1].vertices[2], triangles[1].vertices[1] - triangles[1].vertices[2]));
 
+	// Texture coordinates span the unit square with v running from the bottom edge to the top edge
+	const double corner_coordinates[2][3][2] = { { { 1.0, 1.0 }, { 0.0, 1.0 }, { 0.0, 0.0 } }, { { 1.0, 1.0 }, { 0.0, 0.0 }, { 1.0, 0.0 } } };
+
 	// Assign the triangles to the quad
 	for (int i = 0; i < 2; i++) {
 		quad.quad_triangles[i] = triangles[i];
 		quad.quad_triangles[i].center = calculate_triangle_center(quad.quad_triangles[i]);
+		set_texture_coordinates(quad.quad_triangles[i], corner_coordinates[i]);
 	}
 
 	quad.quad_area = calculate_quad_area(quad);
@@ -113,6 +135,21 @@ scene_object create_quad(point3 center, double width, double height, material_en
 	return quad;
 }
 
+// Box faces are mapped to the unit square by projecting along the face normal before any rotation
+void set_box_texture_coordinates(triangle& triangle, point3 center, glm::dvec3 size) {
+	int axis = (glm::abs(triangle.normal.x) > 0.5) ? 0 : ((glm::abs(triangle.normal.y) > 0.5) ? 1 : 2);
+	int u_axis = (axis == 0) ? 2 : 0;
+	int v_axis = (axis == 1) ? 2 : 1;
+
+	double coordinates[3][2];
+	for (int i = 0; i < 3; i++) {
+		glm::dvec3 local = triangle.vertices[i] - center;
+		coordinates[i][0] = local[u_axis] / size[u_axis] + 0.5;
+		coordinates[i][1] = local[v_axis] / size[v_axis] + 0.5;
+	}
+	set_texture_coordinates(triangle, coordinates);
+}
+
 // A symmetric cube defined by 12 triangles
 // Front face is by default towards positive z-axis
 scene_object create_cube(point3 center, double size, material_enum material, color color, double metal_fuzz, double refraction_index) {
@@ -162,13 +199,11 @@ scene_object create_cube(point3 center, double size, material_enum material, col
 		cube.cube_triangles[i].vertices[2] = v2;
 		cube.cube_triangles[i].normal = normal;
 		cube.cube_triangles[i].center = calculate_triangle_center(cube.cube_triangles[i]);
+		set_box_texture_coordinates(cube.cube_triangles[i], center, glm::dvec3(size));
 	}
 
 	// Material properties
-	cube.material = material;
-	cube.material_color = color;
-	cube.metal_fuzz = metal_fuzz;
-	cube.refraction_index = refraction_index;
+	assign_material(cube, material, color, metal_fuzz, refraction_index);
 
 	cube.cube_area = calculate_cube_area(cube);
 
@@ -224,40 +259,39 @@ scene_object create_asymmetric_cube(point3 center, double width, double height,
 		asymmetric_cube.cube_triangles[i].vertices[2] = v2;
 		asymmetric_cube.cube_triangles[i].normal = normal;
 		asymmetric_cube.cube_triangles[i].center = calculate_triangle_center(asymmetric_cube.cube_triangles[i]);
+		set_box_texture_coordinates(asymmetric_cube.cube_triangles[i], center, glm::dvec3(width, height, depth));
 	}
 
 	// Material properties
-	asymmetric_cube.material = material;
-	asymmetric_cube.material_color = color;
-	asymmetric_cube.metal_fuzz = metal_fuzz;
-	asymmetric_cube.refraction_index = refraction_index;
+	assign_material(asymmetric_cube, material, color, metal_fuzz, refraction_index);
 
 	asymmetric_cube.cube_area = calculate_cube_area(asymmetric_cube);
 
 	return asymmetric_cube;
 }
 
-// Sphere intersection is calculated as intersection with an implicit surface
-bool sphere_intersection(const ray& ray, interval ray_time, hit_record& rec, const scene_object& sphere) {
-	const glm::dvec3& ray_direction = ray.direction;
-	const glm::dvec3& ray_origin = ray.origin;
+// Closest root of the sphere equation within the ray time, in ray time of the unnormalized direction
+template <typename scalar>
+bool sphere_root(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, const glm::tvec3<scalar>& center, scalar radius, scalar& root) {
+	const glm::tvec3<scalar>& ray_direction = ray.direction;
+	const glm::tvec3<scalar>& ray_origin = ray.origin;
 
-	const glm::dvec3& oc = ray_origin - sphere.sphere_center;
-	double a = glm::dot(ray_direction, ray_direction);
-	double half_b = glm::dot(oc, ray_direction);
-	double c = glm::dot(oc, oc) - sphere.sphere_radius * sphere.sphere_radius;
+	const glm::tvec3<scalar>& oc = ray_origin - center;
+	scalar a = glm::dot(ray_direction, ray_direction);
+	scalar half_b = glm::dot(oc, ray_direction);
+	scalar c = glm::dot(oc, oc) - radius * radius;
 
 	// The terms under the root in the quadratic formula for sphere intersection
 	// Negative values gives no real solution i.e. no intersection
-	double discriminant = half_b * half_b - a * c;
+	scalar discriminant = half_b * half_b - a * c;
 
 	if (discriminant < 0) {
 		return false;
 	}
 
-	double sqrtd = glm::sqrt(discriminant);
+	scalar sqrtd = glm::sqrt(discriminant);
 
-	double root = (-half_b - sqrtd) / a;
+	root = (-half_b - sqrtd) / a;
 
 	if (!surrounds(ray_time, root)) {
 		root = (-half_b + sqrtd) / a;
@@ -266,89 +300,140 @@ bool sphere_intersection(const ray& ray, interval ray_time, hit_record& rec, con
 		}
 	}
 
-	// Update hit record with data from latest intersected point
-	rec.time = root;
-	rec.point = ray_at(ray, rec.time);
+	return true;
+}
 
-	glm::dvec3 outward_normal = (rec.point - sphere.sphere_center) / sphere.sphere_radius;
-	set_face_normal(ray, outward_normal, rec);
+// Sphere intersection is calculated as intersection with an implicit surface
+bool sphere_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& sphere) {
+	double root;
+	if (!sphere_root(ray, ray_time, sphere.sphere_center, sphere.sphere_radius, root)) {
+		return false;
+	}
 
+	hit.time = root;
+	hit.primitive_index = 0;
 	return true;
 }
 
 // Triangle intersection calculation using MllerTrumbore algorithm
-bool triangle_intersection(const ray& ray, interval ray_time, hit_record& rec, const triangle& triangle, bool allow_internal_intersection) {
-	const glm::dvec3& a = triangle.vertices[0];
-	const glm::dvec3& b = triangle.vertices[1];
-	const glm::dvec3& c = triangle.vertices[2];
-	const glm::dvec3& n = triangle.normal;
+template <typename scalar, typename triangle_type>
+bool triangle_intersection(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, surface_hit& hit, const triangle_type& triangle) {
+	const glm::tvec3<scalar>& a = triangle.vertices[0];
+	const glm::tvec3<scalar>& b = triangle.vertices[1];
+	const glm::tvec3<scalar>& c = triangle.vertices[2];
+	const glm::tvec3<scalar>& n = triangle.normal;
 
-	const glm::dvec3 norm_dir = glm::normalize(ray.direction);
+	const glm::tvec3<scalar> norm_dir = glm::normalize(ray.direction);
 
 	// Calculate the edge vectors
-	glm::dvec3 e1 = b - a;
-	glm::dvec3 e2 = c - a;
+	glm::tvec3<scalar> e1 = b - a;
+	glm::tvec3<scalar> e2 = c - a;
 
 	// Calculate the determinant
-	glm::dvec3 h = glm::cross(norm_dir, e2);
-	double det = glm::dot(e1, h);
+	glm::tvec3<scalar> h = glm::cross(norm_dir, e2);
+	scalar det = glm::dot(e1, h);
 
 	// Check if the ray and triangle are roughly parallel (no intersection or infinite intersections)
-	if (glm::abs(det) < 1e-8) {
+	if (glm::abs(det) < scalar(1e-8)) {
 		return false;
 	}
 
-	double inv_det = 1.0 / det;
+	scalar inv_det = scalar(1) / det;
 
 	// Calculate the vector from the ray origin to vertex a
-	glm::dvec3 t = ray.origin - a;
+	glm::tvec3<scalar> t = ray.origin - a;
 
 	// Calculate u parameter
-	double u = glm::dot(t, h) * inv_det;
+	scalar u = glm::dot(t, h) * inv_det;
 
 	// Check if u is out of range [0, 1]
-	if (u < 0.0 || u > 1.0) {
+	if (u < 0 || u > 1) {
 		return false;
 	}
 
 	// Calculate q and v parameter
-	glm::dvec3 q = glm::cross(t, e1);
-	double v = glm::dot(norm_dir, q) * inv_det;
+	glm::tvec3<scalar> q = glm::cross(t, e1);
+	scalar v = glm::dot(norm_dir, q) * inv_det;
 
 	// Check if v is out of range [0, 1] or if u + v is greater than 1
-	if (v < 0.0 || u + v > 1.0) {
+	if (v < 0 || u + v > 1) {
 		return false;
 	}
 
 	// Calculate time to find intersection point
-	double time = glm::dot(e2, q) * inv_det;
+	scalar time = glm::dot(e2, q) * inv_det;
 
 	// Make sure ray is hitting from outside the cube
-	double dot = glm::dot(norm_dir, n);
-
-	if (allow_internal_intersection ) {
-		dot = -1.0;
-	}
+	scalar dot = glm::dot(norm_dir, n);
 
 	// Check if t is positive (intersection in front of ray origin) and ray is hitting face from the outside
 	// Also check that triangle is closest triangle
-	if (time > 0.0 && dot < 0.0 && surrounds(ray_time, time)) {
-		rec.point = ray.origin + time * norm_dir;
-		rec.time = time;
-		rec.normal = n;
-		set_face_normal(ray, n, rec);
-		
+	if (time > 0 && dot < 0 && surrounds(ray_time, time)) {
+		hit.time = time;
+		hit.barycentric_u = u;
+		hit.barycentric_v = v;
 		return true;
 	}
 
 	return false;
 }
 
+// Intersection with the whole line of the ray from both sides of the triangle, in ray time of the unnormalized direction
+template <typename scalar, typename triangle_type>
+bool triangle_line_intersection(const basic_ray<scalar>& ray, const triangle_type& triangle, scalar& time) {
+	glm::tvec3<scalar> e1 = triangle.vertices[1] - triangle.vertices[0];
+	glm::tvec3<scalar> e2 = triangle.vertices[2] - triangle.vertices[0];
+	glm::tvec3<scalar> h = glm::cross(ray.direction, e2);
+	scalar det = glm::dot(e1, h);
+	if (glm::abs(det) < scalar(1e-12)) {
+		return false;
+	}
+
+	scalar inv_det = scalar(1) / det;
+	glm::tvec3<scalar> t = ray.origin - triangle.vertices[0];
+	scalar u = glm::dot(t, h) * inv_det;
+	if (u < 0 || u > 1) {
+		return false;
+	}
+
+	glm::tvec3<scalar> q = glm::cross(t, e1);
+	scalar v = glm::dot(ray.direction, q) * inv_det;
+	if (v < 0 || u + v > 1) {
+		return false;
+	}
+
+	time = glm::dot(e2, q) * inv_det;
+	return true;
+}
+
+template bool sphere_root<double>(const ray&, interval, const glm::dvec3&, double, double&);
+template bool sphere_root<float>(const basic_ray<float>&, basic_interval<float>, const glm::tvec3<float>&, float, float&);
+template bool triangle_intersection<double, triangle>(const ray&, interval, surface_hit&, const triangle&);
+template bool triangle_intersection<float, triangle_surface<float>>(const basic_ray<float>&, basic_interval<float>, surface_hit&, const triangle_surface<float>&);
+template bool triangle_line_intersection<double, triangle>(const ray&, const triangle&, double&);
+template bool triangle_line_intersection<float, triangle_surface<float>>(const basic_ray<float>&, const triangle_surface<float>&, float&);
+
+// Closest hit among a set of triangles
+template <typename scalar, typename triangle_type>
+bool triangle_set_intersection(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, surface_hit& hit, const triangle_type* triangles, int nr_triangles) {
+	bool hit_triangle = false;
+	for (int i = 0; i < nr_triangles; i++) {
+		if (triangle_intersection(ray, ray_time, hit, triangles[i])) {
+			// Update the max-time in the interval to not hit far triangle if multiple are intersected
+			ray_time.max = static_cast<scalar>(hit.time);
+			hit.primitive_index = i;
+			hit_triangle = true;
+		}
+	}
+	return hit_triangle;
+}
+
 // Iterate through all triangles in the quad and run triangle intersection test
-bool quad_intersection(const ray& ray, interval ray_time, hit_record& rec, const scene_object& quad) {
+bool quad_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& quad) {
 	for (int i = 0; i < quad.nr_quad_triangles; i++) {
 		const triangle& triangle = quad.quad_triangles[i];
-		if (triangle_intersection(ray, ray_time, rec, triangle)) {
+		if (triangle_intersection(ray, ray_time, hit, triangle)) {
+			hit.primitive_index = i;
 			return true;
 		}
 	}
@@ -356,176 +441,371 @@ bool quad_intersection(const ray& ray, interval ray_time, hit_record& rec, const
 }
 
 // Iterate through all triangles in the cube and run triangle intersection test
-bool cube_intersection(const ray& ray, interval ray_time, hit_record& rec, const scene_object& cube) {
-	bool hit_triangle = false;
-	for (int i = 0; i < cube.nr_cube_triangles; i++) {
-		const triangle& triangle = cube.cube_triangles[i];
-		if (triangle_intersection(ray, ray_time, rec, triangle)) {
-			// Update the max-time in the interval to not hit far triangle if multiple are intersected
-			ray_time.max = rec.time;
-			hit_triangle = true;
+bool cube_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& cube) {
+	return triangle_set_intersection(ray, ray_time, hit, cube.cube_triangles, cube.nr_cube_triangles);
+}
+
+// Hollow shells and dielectric boxes resolve all their surfaces in one call, from both sides since refracted rays leave through them
+// Inner surfaces are the outer surface scaled about the center, intersected by scaling the ray the other way so no second set of triangles is stored
+template <typename scalar, typename triangle_type>
+bool shell_surfaces_intersection(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, surface_hit& hit, object_enum object_type, const glm::tvec3<scalar>& center, scalar radius, const triangle_type* triangles, int nr_triangles, scalar inner_scale) {
+	int nr_surfaces = (inner_scale > 0) ? 2 : 1;
+	scalar closest = ray_time.max;
+	bool hit_surface = false;
+
+	for (int surface = 0; surface < nr_surfaces; surface++) {
+		scalar scale = (surface == 0) ? scalar(1) : inner_scale;
+
+		if (object_type == SPHERE) {
+			scalar root;
+			if (sphere_root(ray, basic_interval<scalar>{ ray_time.min, closest }, center, radius * scale, root)) {
+				closest = root;
+				hit.primitive_index = surface;
+				hit_surface = true;
+			}
+		}
+		else {
+			// Same time as the unscaled ray, converted to distance along the unit direction like other triangle hits
+			basic_ray<scalar> local_ray = { center + (ray.origin - center) / scale, ray.direction / scale };
+			scalar direction_length = glm::length(ray.direction);
+			for (int i = 0; i < nr_triangles; i++) {
+				scalar time;
+				if (triangle_line_intersection(local_ray, triangles[i], time) && surrounds(basic_interval<scalar>{ ray_time.min, closest }, time * direction_length)) {
+					closest = time * direction_length;
+					hit.primitive_index = surface * nr_triangles + i;
+					hit_surface = true;
+				}
+			}
 		}
 	}
-	return hit_triangle;
+
+	if (hit_surface) {
+		hit.time = closest;
+	}
+	return hit_surface;
 }
 
-// Needed to be able to intersect a cubical constant density medium internally
-// This is needed to get the second intersection point used in the constant density medium intersection function
-bool cube_intersection_allow_internal(const ray& ray, interval ray_time, hit_record& rec, const scene_object& cube) {
-	bool hit_triangle = false;
-	for (int i = 0; i < cube.nr_cube_triangles; i++) {
-		const triangle& triangle = cube.cube_triangles[i];
-		if (triangle_intersection(ray, ray_time, rec, triangle, true)) {
-			// Update the max-time in the interval to not hit far triangle if multiple are intersected
-			ray_time.max = rec.time;
-			hit_triangle = true;
-		}
+bool shell_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& shell) {
+	if (shell.object_type == SPHERE) {
+		return shell_surfaces_intersection(ray, ray_time, hit, shell.object_type, shell.sphere_center, shell.sphere_radius, shell.cube_triangles, 0, shell.shell_inner_scale);
 	}
-	return hit_triangle;
+	return shell_surfaces_intersection(ray, ray_time, hit, shell.object_type, shell.cube_center, 0.0, shell.cube_triangles, shell.nr_cube_triangles, shell.shell_inner_scale);
 }
 
-// A constant density medium is both a geometry and a material, it firstly has a probabilistic geometry intersection based on density combined with a uniform scattering implemented in the material
-// The ray has a chance of intersecting a point within the boundrary geometry, depending on density
-bool constant_density_medium_intersection(const ray& ray_in, interval ray_time, hit_record& rec, const scene_object& constant_density_medium) {
-	hit_record rec_first_intersection, rec_second_intersection;
+// Float copies of the surfaces, rotations and other edits happen while the scene is created so this runs once before rendering
+void prepare_single_precision_surfaces(std::vector<scene_object>& scene_objects) {
+	for (scene_object& obj : scene_objects) {
+		single_precision_surfaces& surfaces = obj.float_surfaces;
+		const triangle* triangles = nullptr;
+		surfaces.nr_triangles = 0;
 
-	switch (constant_density_medium.object_type) {
+		switch (obj.object_type) {
 		case SPHERE:
-			if (!sphere_intersection(ray_in, interval{ -infinity, infinity }, rec_first_intersection, constant_density_medium)) {
-				return false;
-			}
-			if (!sphere_intersection(ray_in, interval{ rec_first_intersection.time + 0.0001, infinity }, rec_second_intersection, constant_density_medium)) {
-				return false;
-			}
-		break;
+			surfaces.center = glm::tvec3<float>(obj.sphere_center);
+			surfaces.radius = static_cast<float>(obj.sphere_radius);
+			break;
 		case QUAD:
-			if (!quad_intersection(ray_in, interval{ -infinity, infinity }, rec_first_intersection, constant_density_medium)) {
-				return false;
-			}
-			if (!quad_intersection(ray_in, interval{ rec_first_intersection.time + 0.0001, infinity }, rec_second_intersection, constant_density_medium)) {
-				return false;
-			}
-		break;
+			surfaces.center = glm::tvec3<float>(obj.quad_center);
+			triangles = obj.quad_triangles;
+			surfaces.nr_triangles = obj.nr_quad_triangles;
+			break;
 		case CUBE:
-			if (!cube_intersection(ray_in, interval{ -infinity, infinity }, rec_first_intersection, constant_density_medium)) {
-				return false;
-				
-			}
-			if (!cube_intersection_allow_internal(ray_in, interval{ rec_first_intersection.time + 0.0001, infinity }, rec_second_intersection, constant_density_medium)) {
-				return false;
-			}
-		break;
 		case ASYMMETRIC_CUBE:
-			if (!cube_intersection(ray_in, interval{ -infinity, infinity }, rec_first_intersection, constant_density_medium)) {
-				return false;
-			}
-			if (!cube_intersection_allow_internal(ray_in, interval{ rec_first_intersection.time + 0.0001, infinity }, rec_second_intersection, constant_density_medium)) {
-				return false;
+			surfaces.center = glm::tvec3<float>(obj.cube_center);
+			triangles = obj.cube_triangles;
+			surfaces.nr_triangles = obj.nr_cube_triangles;
+			break;
+		default:
+			break;
+		}
+
+		for (int i = 0; i < surfaces.nr_triangles; i++) {
+			for (int vertex = 0; vertex < 3; vertex++) {
+				surfaces.triangles[i].vertices[vertex] = glm::tvec3<float>(triangles[i].vertices[vertex]);
 			}
-		break;
+			surfaces.triangles[i].normal = glm::tvec3<float>(triangles[i].normal);
+		}
 	}
+}
 
-	rec_first_intersection.material = constant_density_medium.material;
-	rec_first_intersection.material_color = constant_density_medium.material_color;
-	rec_first_intersection.metal_fuzz = constant_density_medium.metal_fuzz;
-	rec_first_intersection.refraction_index = constant_density_medium.refraction_index;
-
-	rec_second_intersection.material = constant_density_medium.material;
-	rec_second_intersection.material_color = constant_density_medium.material_color;
-	rec_second_intersection.metal_fuzz = constant_density_medium.metal_fuzz;
-	rec_second_intersection.refraction_index = constant_density_medium.refraction_index;
+// Surfaces of one object for a double ray
+bool object_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& obj, bool shell) {
+	if (shell) {
+		return shell_intersection(ray, ray_time, hit, obj);
+	}
+	switch (obj.object_type) {
+	case SPHERE:
+		return sphere_intersection(ray, ray_time, hit, obj);
+	case QUAD:
+		return quad_intersection(ray, ray_time, hit, obj);
+	default:
+		return cube_intersection(ray, ray_time, hit, obj);
+	}
+}
 
-	color color = rec_first_intersection.material_color;
+// Surfaces of one object for a float ray, the same tests against the single precision copy
+bool object_intersection(const basic_ray<float>& ray, basic_interval<float> ray_time, surface_hit& hit, const scene_object& obj, bool shell) {
+	const single_precision_surfaces& surfaces = obj.float_surfaces;
+	if (shell) {
+		return shell_surfaces_intersection(ray, ray_time, hit, obj.object_type, surfaces.center, surfaces.radius, surfaces.triangles, surfaces.nr_triangles, static_cast<float>(obj.shell_inner_scale));
+	}
+	if (obj.object_type == SPHERE) {
+		float root;
+		if (!sphere_root(ray, ray_time, surfaces.center, surfaces.radius, root)) {
+			return false;
+		}
+		hit.time = root;
+		hit.primitive_index = 0;
+		return true;
+	}
+	return triangle_set_intersection(ray, ray_time, hit, surfaces.triangles, surfaces.nr_triangles);
+}
 
-	if (rec_first_intersection.time < ray_time.min) {
-		rec_first_intersection.time = ray_time.min;
+// Expand the closest hit into shading data, done once per ray instead of for every candidate hit
+// Textured materials look up their color here, with a footprint that grows with distance and grazing angles
+void resolve_surface_hit(const ray& ray, const surface_hit& hit, const std::vector<scene_object>& scene_objects, hit_record& rec) {
+	const scene_object& obj = scene_objects[hit.object_index];
+	rec.time = hit.time;
+	rec.object_index = hit.object_index;
+
+	if (obj.object_type == SPHERE) {
+		rec.point = ray_at(ray, hit.time);
+		rec.inner_surface = hit.primitive_index == 1;
+		double radius = rec.inner_surface ? obj.sphere_radius * obj.shell_inner_scale : obj.sphere_radius;
+
+		// The material of a shell lies between its surfaces, so it faces the cavity from the inner surface
+		glm::dvec3 outward_normal = (rec.point - obj.sphere_center) / radius;
+		set_face_normal(ray, rec.inner_surface ? -outward_normal : outward_normal, rec);
+
+		// Latitude and longitude as texture coordinates, v runs from the bottom pole to the top pole
+		double theta = fast_acos(glm::clamp(-outward_normal.y, -1.0, 1.0));
+		double phi = glm::atan(-outward_normal.z, outward_normal.x) + pi;
+		rec.u = phi / (2.0 * pi);
+		rec.v = theta / pi;
+		rec.uv_density = 1.0 / (pi * glm::abs(radius) * glm::sqrt(2.0));
+	}
+	else {
+		// Triangle times are distances along the unit direction
+		rec.point = ray.origin + hit.time * glm::normalize(ray.direction);
+		int nr_triangles = (obj.object_type == QUAD) ? obj.nr_quad_triangles : obj.nr_cube_triangles;
+		const triangle& triangle = (obj.object_type == QUAD) ? obj.quad_triangles[hit.primitive_index] : obj.cube_triangles[hit.primitive_index % nr_triangles];
+		rec.inner_surface = hit.primitive_index >= nr_triangles;
+		set_face_normal(ray, rec.inner_surface ? -triangle.normal : triangle.normal, rec);
+
+		// Barycentric interpolation of the vertex texture coordinates
+		double w = 1.0 - hit.barycentric_u - hit.barycentric_v;
+		rec.u = w * triangle.texture_coordinates[0][0] + hit.barycentric_u * triangle.texture_coordinates[1][0] + hit.barycentric_v * triangle.texture_coordinates[2][0];
+		rec.v = w * triangle.texture_coordinates[0][1] + hit.barycentric_u * triangle.texture_coordinates[1][1] + hit.barycentric_v * triangle.texture_coordinates[2][1];
+		rec.uv_density = triangle.texture_density;
 	}
 
-	if (rec_second_intersection.time > ray_time.max) {
-		rec_second_intersection.time = ray_time.max;
+	set_hit_material(rec, obj);
+
+	const texture& material_texture = object_material(obj).material_texture;
+	if (material_texture.texture_type != SOLID_TEXTURE) {
+		double cosine = glm::dot(glm::normalize(ray.direction), rec.normal);
+		double footprint = texture_footprint(glm::length(rec.point - ray.origin), cosine, rec.uv_density);
+		rec.material_color = texture_value(material_texture, rec.u, rec.v, rec.point, footprint);
 	}
+}
 
-	if (rec_first_intersection.time >= rec_second_intersection.time) {
+// Check if a point lies inside the closed surface of a sphere or box, scaled about its center
+bool inside_surface(const scene_object& object, const point3& point, double scale) {
+	switch (object.object_type) {
+	case SPHERE:
+		return glm::length(point - object.sphere_center) < object.sphere_radius * scale;
+	case CUBE:
+	case ASYMMETRIC_CUBE: {
+		point3 local_point = object.cube_center + (point - object.cube_center) / scale;
+		for (int i = 0; i < object.nr_cube_triangles; i++) {
+			if (glm::dot(local_point - object.cube_triangles[i].vertices[0], object.cube_triangles[i].normal) > 0.0) {
+				return false;
+			}
+		}
+		return true;
+	}
+	default:
 		return false;
 	}
+}
 
-	if (rec_first_intersection.time < 0) {
-		rec_first_intersection.time = 0;
+// Nested dielectrics form a priority stack at every point, the enclosing medium with the highest priority is the one the point is in
+// The stack is rebuilt from the geometry around each dielectric hit, which gives the same media as carrying it along the path for closed surfaces
+// Returns false for interfaces inside a higher priority medium, they don't exist for the ray and are passed through
+// Otherwise the refraction index of the hit record becomes relative, the side the normal leaves over the side it points into
+bool resolve_dielectric_interface(hit_record& rec, const std::vector<scene_object>& scene_objects) {
+	const scene_object& object = scene_objects[rec.object_index];
+	const material_properties& properties = object_material(object);
+	if (properties.material != DIELECTRIC) {
+		return true;
 	}
 
-	double ray_length = glm::length(ray_in.direction);
-	double distance_inside_boundrary = (rec_second_intersection.time - rec_first_intersection.time) * ray_length;
-	double hit_distance =  (-1.0 / constant_density_medium.density) * glm::log(random_double(1e-8, 1.0));
+	bool enclosed = false;
+	int enclosing_priority = 0;
+	double enclosing_index = 1.0; // Empty space around all dielectrics
 
-	if (hit_distance > distance_inside_boundrary) {
-		return false;
-	}
+	int nr_scene_objects = scene_objects.size();
+	for (int i = 0; i < nr_scene_objects; i++) {
+		const scene_object& medium = scene_objects[i];
+		if (i == rec.object_index || !medium.dielectric_shell || (enclosed && medium.medium_priority <= enclosing_priority) || !inside_surface(medium, rec.point)) {
+			continue;
+		}
 
-	rec.time = rec_first_intersection.time + (hit_distance / ray_length);
-	rec.point = ray_at(ray_in, rec.time);
+		bool in_cavity = medium.shell_inner_scale > 0.0 && inside_surface(medium, rec.point, medium.shell_inner_scale);
+		enclosed = true;
+		enclosing_priority = medium.medium_priority;
+		const material_properties& medium_properties = object_material(medium);
+		enclosing_index = in_cavity ? medium_properties.inner_refraction_index : medium_properties.refraction_index;
+	}
 
-	rec.normal = glm::dvec3(0.0, 0.0, 1.0);
-	rec.outward_face = true;
-	rec.material_color = color;
+	if (enclosed && enclosing_priority > object.medium_priority) {
+		return false;
+	}
 
+	double outside_index = rec.inner_surface ? properties.inner_refraction_index : enclosing_index;
+	rec.refraction_index = properties.refraction_index / outside_index;
 	return true;
 }
 
-// Iterate through all scene geometries and look for intersection with current ray, returns intersection flag
-bool find_intersection(const ray& ray, interval initial_ray_time_interval, hit_record& rec, const std::vector<scene_object>& scene_objects) {
+// Closest surface along the ray, constant density mediums are left to the medium tracking
+// Only the compact hit is kept while searching, material data is never touched for hits that turn out to be occluded
+template <int features, typename scalar>
+bool closest_surface_intersection(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, surface_hit& hit, const std::vector<scene_object>& scene_objects) {
 	int nr_scene_objects = scene_objects.size();
-	hit_record temp_rec;
+	surface_hit candidate;
 	bool hit_anything = false;
-	double closest_so_far = initial_ray_time_interval.max;
-	interval local_ray_time_interval = { initial_ray_time_interval.min, closest_so_far };
+	basic_interval<scalar> local_ray_time_interval = ray_time;
 
+	for (int i = 0; i < nr_scene_objects; i++) {
+		const scene_object& obj = scene_objects[i];
+		candidate.object_index = i;
+
+		if ((features & FEATURE_MEDIA) && obj.constant_density_medium == true) {
+			continue;
+		}
+
+		bool hit_object = false;
+		switch (obj.object_type) {
+		case SPHERE:
+		case QUAD:
+		case CUBE:
+		case ASYMMETRIC_CUBE:
+			hit_object = object_intersection(ray, local_ray_time_interval, candidate, obj, (features & FEATURE_DIELECTRICS) && obj.dielectric_shell);
+			break;
+		default:
+			return false;
+			break;
+		}
+
+		if (hit_object) {
+			hit_anything = true;
+			local_ray_time_interval.max = static_cast<scalar>(candidate.time);
+			hit = candidate;
+		}
+	}
+
+	return hit_anything;
+}
+
+// Closest surface in the precision the kernel traces in
+// Float searches start above the rounding error of the origin so rays leaving a surface can't find it again
+// The object the float search picked is then intersected again in double, so shading and the next ray start from a double precision point
+template <int features>
+bool find_closest_surface(const ray& ray, interval ray_time, surface_hit& hit, const std::vector<scene_object>& scene_objects) {
+	if (!(features & FEATURE_SINGLE_PRECISION)) {
+		return closest_surface_intersection<features>(ray, ray_time, hit, scene_objects);
+	}
+
+	basic_ray<float> float_ray = convert_ray<float>(ray);
+	float origin_magnitude = glm::max(glm::max(glm::abs(float_ray.origin.x), glm::abs(float_ray.origin.y)), glm::abs(float_ray.origin.z));
+	float tolerance = 16.0f * std::numeric_limits<float>::epsilon() * origin_magnitude;
+	basic_interval<float> float_ray_time = { glm::max(static_cast<float>(ray_time.min), tolerance), static_cast<float>(glm::min(ray_time.max, static_cast<double>(std::numeric_limits<float>::max()))) };
+	if (!closest_surface_intersection<features>(float_ray, float_ray_time, hit, scene_objects)) {
+		return false;
+	}
+
+	const scene_object& obj = scene_objects[hit.object_index];
+	surface_hit refined = hit;
+	if (object_intersection(ray, ray_time, refined, obj, (features & FEATURE_DIELECTRICS) && obj.dielectric_shell)) {
+		hit = refined;
+	}
+	return true;
+}
+
+// Iterate through all scene geometries and look for intersection with current ray, returns intersection flag
+// Constant density mediums are collected as boundary intervals and tracked together once the closest surface is known
+// Scenes without media or dielectrics run a kernel with those paths compiled out
+template <int features>
+bool find_intersection_kernel(const ray& ray, interval initial_ray_time_interval, hit_record& rec, const std::vector<scene_object>& scene_objects, bool sample_media) {
+	static thread_local std::vector<medium_interval> medium_intervals;
+	medium_intervals.clear();
+
+	int nr_scene_objects = (features & FEATURE_MEDIA) ? scene_objects.size() : 0;
 	for (int i = 0; i < nr_scene_objects; i++) {
 		const scene_object& obj = scene_objects[i];
 
 		// Special case for constant density mediums since they are both a geometry and a material
 		if (obj.constant_density_medium == true) {
-			if (constant_density_medium_intersection(ray, local_ray_time_interval, temp_rec, obj)) {
-				hit_anything = true;
-				local_ray_time_interval.max = temp_rec.time;
-				update_hit_record(temp_rec, obj, rec);
+			medium_interval span = { i, 0.0, 0.0 };
+			if (sample_media && medium_boundary_interval(ray, obj, span.enter, span.exit)) {
+				medium_intervals.push_back(span);
 			}
 		}
-		else {
-			switch (obj.object_type) {
-			case SPHERE:
-				if (sphere_intersection(ray, local_ray_time_interval, temp_rec, obj)) {
-					hit_anything = true;
-					local_ray_time_interval.max = temp_rec.time;
-					update_hit_record(temp_rec, obj, rec);
-				}
-				break;
-			case QUAD:
-				if (quad_intersection(ray, local_ray_time_interval, temp_rec, obj)) {
-					hit_anything = true;
-					local_ray_time_interval.max = temp_rec.time;
-					update_hit_record(temp_rec, obj, rec);
-				}
-				break;
-			case CUBE:
-				if (cube_intersection(ray, local_ray_time_interval, temp_rec, obj)) {
-					hit_anything = true;
-					local_ray_time_interval.max = temp_rec.time;
-					update_hit_record(temp_rec, obj, rec);
-				}
-				break;
-			case ASYMMETRIC_CUBE:
-				if (cube_intersection(ray, local_ray_time_interval, temp_rec, obj)) {
-					hit_anything = true;
-					local_ray_time_interval.max = temp_rec.time;
-					update_hit_record(temp_rec, obj, rec);
-				}
-				break;
-			default:
-				return false;
-				break;
-			}
+	}
+
+	surface_hit closest_hit;
+	bool hit_anything = find_closest_surface<features>(ray, initial_ray_time_interval, closest_hit, scene_objects);
+	if (hit_anything) {
+		resolve_surface_hit(ray, closest_hit, scene_objects, rec);
+	}
+
+	// Skipped dielectric interfaces continue the search behind them, along the unit direction so sphere and triangle times agree
+	while ((features & FEATURE_DIELECTRICS) && hit_anything && !resolve_dielectric_interface(rec, scene_objects)) {
+		double direction_length = glm::length(ray.direction);
+		::ray unit_ray = create_ray(ray.origin, ray.direction / direction_length);
+		interval behind = { glm::length(rec.point - ray.origin) + 1e-6, initial_ray_time_interval.max * direction_length };
+		hit_anything = find_closest_surface<features>(unit_ray, behind, closest_hit, scene_objects);
+		if (hit_anything) {
+			resolve_surface_hit(unit_ray, closest_hit, scene_objects, rec);
 		}
 	}
 
+	if (!(features & FEATURE_MEDIA) || medium_intervals.empty()) {
+		return hit_anything;
+	}
+
+	// Triangle times are distances, so the closest surface is converted to ray time before clipping the media against it
+	double surface_time = initial_ray_time_interval.max;
+	if (hit_anything) {
+		surface_time = glm::dot(rec.point - ray.origin, ray.direction) / glm::dot(ray.direction, ray.direction);
+	}
+
+	int nr_clipped = 0;
+	for (const medium_interval& span : medium_intervals) {
+		medium_interval clipped = { span.object_index, std::max(span.enter, initial_ray_time_interval.min), std::min(span.exit, surface_time) };
+		if (clipped.enter < clipped.exit) {
+			medium_intervals[nr_clipped++] = clipped;
+		}
+	}
+	medium_intervals.resize(nr_clipped);
+
+	if (sample_medium_collision(ray, medium_intervals, scene_objects, rec)) {
+		return true;
+	}
+
 	return hit_anything;
+}
+
+template bool find_intersection_kernel<0>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<FEATURE_MEDIA>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<FEATURE_DIELECTRICS>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<FEATURE_MEDIA | FEATURE_DIELECTRICS>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<FEATURE_SINGLE_PRECISION>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<FEATURE_SINGLE_PRECISION | FEATURE_MEDIA>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<FEATURE_SINGLE_PRECISION | FEATURE_DIELECTRICS>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+template bool find_intersection_kernel<GEOMETRY_FEATURES>(const ray&, interval, hit_record&, const std::vector<scene_object>&, bool);
+
+// Intersection for callers that don't know the features of the scene
+bool find_intersection(const ray& ray, interval initial_ray_time_interval, hit_record& rec, const std::vector<scene_object>& scene_objects, bool sample_media) {
+	return find_intersection_kernel<FEATURE_MEDIA | FEATURE_DIELECTRICS>(ray, initial_ray_time_interval, rec, scene_objects, sample_media);
 }
\ No newline at end of file
@@ -6,8 +6,20 @@
 #include "glm.hpp"
 #include "material.h"
 #include "util.h"
+#include "texture.h"
 
-// Hit record to track rays
+struct density_grid;
+
+// Compact record of a candidate hit during traversal, only the closest one is expanded into a hit record
+struct surface_hit {
+	double time;
+	int object_index; // Index of the hit object in the scene objects
+	int primitive_index; // Triangle of polygons, the surfaces of hollow shells follow after the outer ones
+	double barycentric_u; // Weights of the second and third triangle vertex
+	double barycentric_v;
+};
+
+// Hit record to track rays, the shading data of the closest hit
 struct hit_record {
 	point3 point;
 	glm::dvec3 normal;
@@ -17,6 +29,11 @@ struct hit_record {
 	double refraction_index;
 	double time;
 	bool outward_face;
+	int object_index; // Index of the hit object in the scene objects
+	double u; // Texture coordinates of the hit point
+	double v;
+	double uv_density; // Change of the texture coordinates per unit of distance along the surface
+	bool inner_surface; // Hit the cavity side of a hollow dielectric shell
 };
 
 // Triangles have counter-clockwise/right-hand rule, for normals
@@ -24,6 +41,23 @@ struct triangle {
 	glm::dvec3 vertices[3];
 	glm::dvec3 normal;
 	point3 center;
+	double texture_coordinates[3][2] = {}; // Texture coordinates of each vertex
+	double texture_density = 1.0; // Texture coordinate area per surface area, square rooted
+};
+
+// Surface of a triangle in the scalar type rays are traced in
+template <typename scalar>
+struct triangle_surface {
+	glm::tvec3<scalar> vertices[3];
+	glm::tvec3<scalar> normal;
+};
+
+// Single precision copy of the surfaces of an object, searched by rays traced in float
+struct single_precision_surfaces {
+	glm::tvec3<float> center; // Sphere center or box center, inner shell surfaces are scaled about it
+	float radius = 0.0f;
+	int nr_triangles = 0; // Quad or cube triangles, spheres have none
+	triangle_surface<float> triangles[12];
 };
 
 // Enum for an intersectable object
@@ -35,16 +69,29 @@ enum object_enum {
 	CONSTANT_DENSITY_MEDIUM
 };
 
+// Features of a scene the render kernels are specialized on, kernels compiled without a feature have its code paths removed
+enum scene_feature {
+	FEATURE_MEDIA = 1 << 0,
+	FEATURE_DIELECTRICS = 1 << 1,
+	FEATURE_DEPTH_OF_FIELD = 1 << 2,
+	FEATURE_EMITTERS = 1 << 3,
+	FEATURE_SINGLE_PRECISION = 1 << 4, // Not a feature of the scene but of the render, the closest surface is searched with float rays
+	GEOMETRY_FEATURES = FEATURE_MEDIA | FEATURE_DIELECTRICS | FEATURE_SINGLE_PRECISION, // The features intersection tests are specialized on
+	ALL_FEATURES = FEATURE_MEDIA | FEATURE_DIELECTRICS | FEATURE_DEPTH_OF_FIELD | FEATURE_EMITTERS // Every scene feature, traced in double
+};
+
 // Union type for all scene objects
 struct scene_object {
 	// Enum to determine object type
 	object_enum object_type;
 
-	// Material properties, defaults to grey lambertian geometry
-	material_enum material;
-	color material_color;
-	double metal_fuzz;
-	double refraction_index;
+	// Material of the object in the material table, defaults to grey lambertian geometry
+	uint32_t material_id = 0;
+
+	// Dielectric fields, hollow shells and nested media
+	bool dielectric_shell = false; // Intersected from both sides with its inner surface, since refracted rays leave through it
+	double shell_inner_scale = 0.0; // Size of the inner surface of a hollow shell relative to the outer surface, 0.0 makes a solid object
+	int medium_priority = 0; // Where dielectrics overlap the one with the highest priority fills the overlap, surfaces of the others inside it are skipped
 
 	// Sphere fields, implicit surface
 	glm::dvec3 sphere_center;
@@ -67,6 +114,10 @@ struct scene_object {
 	// Constant density medium fields, probabilistic density
 	bool constant_density_medium = false;
 	double density;
+	std::shared_ptr<const density_grid> medium_grid; // Scales the density over its bounds, constant density when empty
+
+	// Surfaces for single precision tracing, filled in by prepare_single_precision_surfaces once the scene is built
+	single_precision_surfaces float_surfaces;
 };
 
 // Geometry creation functions
@@ -76,12 +127,27 @@ scene_object create_quad(point3 center, double width, double height, material_en
 scene_object create_cube(point3 center, double size, material_enum material = LAMBERTIAN, color color = glm::dvec3(0.5, 0.5, 0.5), double metal_fuzz = 1.0, double refraction_index = 1.0);
 scene_object create_asymmetric_cube(point3 center, double width, double height, double depth, material_enum material = LAMBERTIAN, color color = glm::dvec3(0.5, 0.5, 0.5), double metal_fuzz = 1.0, double refraction_index = 1.0);
 
-// Geometry intersection functions
-bool sphere_intersection(const ray& ray, interval ray_time, hit_record& rec, const scene_object& sphere);
-bool triangle_intersection(const ray& ray, interval ray_time, hit_record& rec, const triangle& triangle, bool allow_internal_intersection = false);
-bool quad_intersection(const ray& ray, interval ray_time, hit_record& rec, const scene_object& quad);
-bool cube_intersection(const ray& ray, interval ray_time, hit_record& rec, const scene_object& cube);
-bool constant_density_medium_intersection(const ray& ray_in, interval ray_time, hit_record& rec, const scene_object& constant_density_medium);
+const material_properties& object_material(const scene_object& object);
+void set_object_material(scene_object& object, const material_properties& properties);
+
+void prepare_single_precision_surfaces(std::vector<scene_object>& scene_objects);
+
+// Geometry intersection functions, primitive tests are instantiated for double triangles and float triangle surfaces
+template <typename scalar>
+bool sphere_root(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, const glm::tvec3<scalar>& center, scalar radius, scalar& root);
+template <typename scalar, typename triangle_type>
+bool triangle_intersection(const basic_ray<scalar>& ray, basic_interval<scalar> ray_time, surface_hit& hit, const triangle_type& triangle);
+template <typename scalar, typename triangle_type>
+bool triangle_line_intersection(const basic_ray<scalar>& ray, const triangle_type& triangle, scalar& time);
+bool sphere_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& sphere);
+bool quad_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& quad);
+bool cube_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& cube);
+bool shell_intersection(const ray& ray, interval ray_time, surface_hit& hit, const scene_object& shell);
+void resolve_surface_hit(const ray& ray, const surface_hit& hit, const std::vector<scene_object>& scene_objects, hit_record& rec);
+bool inside_surface(const scene_object& object, const point3& point, double scale = 1.0);
+bool resolve_dielectric_interface(hit_record& rec, const std::vector<scene_object>& scene_objects);
 
-// Scene intersection function
-bool find_intersection(const ray& ray, interval initial_ray_time_interval, hit_record& rec, const std::vector<scene_object>& scene_objects);
\ No newline at end of file
+// Scene intersection function, the kernel is instantiated for every combination of geometry features
+template <int features>
+bool find_intersection_kernel(const ray& ray, interval initial_ray_time_interval, hit_record& rec, const std::vector<scene_object>& scene_objects, bool sample_media = true);
+bool find_intersection(const ray& ray, interval initial_ray_time_interval, hit_record& rec, const std::vector<scene_object>& scene_objects, bool sample_media = true);
\ No newline at end of file
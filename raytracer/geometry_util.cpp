@@ -1,4 +1,5 @@
 #include "geometry_util.h"
+#include "fast_math.h"
 
 // Triangle centers are needed for rotation
 point3 calculate_triangle_center(const triangle& triangle) {
@@ -14,13 +15,13 @@ void set_face_normal(const ray& ray, const glm::dvec3& outward_normal, hit_recor
 	rec.normal = rec.outward_face ? outward_normal : -outward_normal;
 }
 
-// Utility function to update hit record
-void update_hit_record(hit_record& temp_rec, const scene_object& obj, hit_record& rec) {
-	temp_rec.material = obj.material;
-	temp_rec.material_color = obj.material_color;
-	temp_rec.metal_fuzz = obj.metal_fuzz;
-	temp_rec.refraction_index = obj.refraction_index;
-	rec = temp_rec;
+// Copy the shading data of the material of an object into a hit record
+void set_hit_material(hit_record& rec, const scene_object& obj) {
+	const material_properties& properties = object_material(obj);
+	rec.material = properties.material;
+	rec.material_color = properties.material_color;
+	rec.metal_fuzz = properties.metal_fuzz;
+	rec.refraction_index = properties.refraction_index;
 }
 
 // Utility functions for surface area calculations for polygons
@@ -38,6 +39,18 @@ double calculate_triangle_area(const triangle& triangle) {
 	return triangle_area;
 }
 
+// Assign vertex texture coordinates and the density relating texture area to surface area
+void set_texture_coordinates(triangle& triangle, const double coordinates[3][2]) {
+	for (int i = 0; i < 3; i++) {
+		triangle.texture_coordinates[i][0] = coordinates[i][0];
+		triangle.texture_coordinates[i][1] = coordinates[i][1];
+	}
+
+	double texture_area = 0.5 * glm::abs((coordinates[1][0] - coordinates[0][0]) * (coordinates[2][1] - coordinates[0][1]) - (coordinates[2][0] - coordinates[0][0]) * (coordinates[1][1] - coordinates[0][1]));
+	double surface_area = calculate_triangle_area(triangle);
+	triangle.texture_density = (surface_area > 0.0) ? glm::sqrt(texture_area / surface_area) : 1.0;
+}
+
 // Use triangle area calculation on all triangles in the cube
 double calculate_cube_area(const scene_object& cube) {
 	double total_area = 0.0;
@@ -64,6 +77,42 @@ double calculate_quad_area(const scene_object& quad) {
 	return total_area;
 }
 
+// Axis aligned bounds of all scene geometries, lower is above upper for an empty scene
+void calculate_scene_bounds(const std::vector<scene_object>& scene_objects, point3& lower, point3& upper) {
+	lower = point3(infinity, infinity, infinity);
+	upper = point3(-infinity, -infinity, -infinity);
+
+	for (const scene_object& obj : scene_objects) {
+		switch (obj.object_type) {
+		case SPHERE: {
+			double radius = glm::abs(obj.sphere_radius);
+			lower = glm::min(lower, obj.sphere_center - glm::dvec3(radius, radius, radius));
+			upper = glm::max(upper, obj.sphere_center + glm::dvec3(radius, radius, radius));
+			break;
+		}
+		case QUAD:
+			for (int i = 0; i < obj.nr_quad_triangles; i++) {
+				for (int k = 0; k < 3; k++) {
+					lower = glm::min(lower, obj.quad_triangles[i].vertices[k]);
+					upper = glm::max(upper, obj.quad_triangles[i].vertices[k]);
+				}
+			}
+			break;
+		case CUBE:
+		case ASYMMETRIC_CUBE:
+			for (int i = 0; i < obj.nr_cube_triangles; i++) {
+				for (int k = 0; k < 3; k++) {
+					lower = glm::min(lower, obj.cube_triangles[i].vertices[k]);
+					upper = glm::max(upper, obj.cube_triangles[i].vertices[k]);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
 // Utility functions for getting random points on different geometries, used for calculating pdf:s
 
 // Used for sampling spherical geometries
@@ -75,12 +124,15 @@ point3 get_random_point_on_sphere(point3 origin, const scene_object& sphere, con
 
 	// Generate random spherical coordinates
 	double theta = 2.0 * pi * uniform_distribution(gen); // Random angle in radians
-	double phi = acos(2.0 * uniform_distribution(gen) - 1.0); // Random inclination angle in radians
+	double phi = fast_acos(2.0 * uniform_distribution(gen) - 1.0); // Random inclination angle in radians
 
 	// Convert spherical coordinates to Cartesian coordinates
-	double x = sphere.sphere_center.x + sphere.sphere_radius * sin(phi) * cos(theta);
-	double y = sphere.sphere_center.y + sphere.sphere_radius * sin(phi) * sin(theta);
-	double z = sphere.sphere_center.z + sphere.sphere_radius * cos(phi);
+	double sin_theta, cos_theta, sin_phi, cos_phi;
+	fast_sincos(theta, sin_theta, cos_theta);
+	fast_sincos(phi, sin_phi, cos_phi);
+	double x = sphere.sphere_center.x + sphere.sphere_radius * sin_phi * cos_theta;
+	double y = sphere.sphere_center.y + sphere.sphere_radius * sin_phi * sin_theta;
+	double z = sphere.sphere_center.z + sphere.sphere_radius * cos_phi;
 
 	point3 random_point = point3(x, y, z);
 
@@ -4,11 +4,13 @@
 
 point3 calculate_triangle_center(const triangle& triangle);
 void set_face_normal(const ray& ray, const glm::dvec3& outward_normal, hit_record& rec);
-void update_hit_record(hit_record& temp_rec, const scene_object& obj, hit_record& rec);
+void set_hit_material(hit_record& rec, const scene_object& obj);
 
 double calculate_triangle_area(const triangle& triangle);
+void set_texture_coordinates(triangle& triangle, const double coordinates[3][2]);
 double calculate_cube_area(const scene_object& cube);
 double calculate_quad_area(const scene_object& quad);
+void calculate_scene_bounds(const std::vector<scene_object>& scene_objects, point3& lower, point3& upper);
 
 point3 get_random_point_on_sphere(point3 origin, const scene_object& sphere, const hit_record& rec);
 point3 get_random_point_on_triangle(const triangle& random_triangle);
@@ -0,0 +1,549 @@
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+#include "image_output.h"
+
+const char* image_extension(image_format_enum format) {
+	switch (format) {
+	case PFM_IMAGE:
+		return ".pfm";
+	case PNG_IMAGE:
+		return ".png";
+	default:
+		return ".ppm";
+	}
+}
+
+void append_text(std::vector<unsigned char>& file, const std::string& text) {
+	file.insert(file.end(), text.begin(), text.end());
+}
+
+// Rows of a portable float map go from the bottom of the image up, a negative scale marks little endian floats
+void encode_float_map(const std::vector<float>& values, int width, int height, int nr_channels, std::vector<unsigned char>& file) {
+	uint32_t byte_order_check = 1;
+	bool little_endian = (*reinterpret_cast<unsigned char*>(&byte_order_check) == 1);
+
+	file.clear();
+	append_text(file, std::string((nr_channels == 3) ? "PF" : "Pf") + "\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + (little_endian ? "-1.0" : "1.0") + "\n");
+	size_t header_size = file.size();
+	size_t row_size = static_cast<size_t>(width) * nr_channels * sizeof(float);
+	file.resize(header_size + row_size * height);
+	for (int row = 0; row < height; row++) {
+		std::memcpy(&file[header_size + row_size * (height - 1 - row)], &values[static_cast<size_t>(row) * width * nr_channels], row_size);
+	}
+}
+
+// Deflate bits are packed from the least significant bit of each byte up
+struct bit_writer {
+	std::vector<unsigned char> bytes;
+	uint64_t buffer = 0;
+	int nr_bits = 0;
+};
+
+void write_bits(bit_writer& writer, uint32_t bits, int count) {
+	writer.buffer |= static_cast<uint64_t>(bits) << writer.nr_bits;
+	writer.nr_bits += count;
+	while (writer.nr_bits >= 8) {
+		writer.bytes.push_back(static_cast<unsigned char>(writer.buffer & 0xff));
+		writer.buffer >>= 8;
+		writer.nr_bits -= 8;
+	}
+}
+
+// Huffman codes are defined most significant bit first, so they are reversed into the stream
+void write_huffman_code(bit_writer& writer, uint32_t code, int length) {
+	uint32_t reversed = 0;
+	for (int bit = 0; bit < length; bit++) {
+		reversed = (reversed << 1) | ((code >> bit) & 1);
+	}
+	write_bits(writer, reversed, length);
+}
+
+// Fixed huffman code of a literal, end of block or length symbol
+void write_fixed_symbol(bit_writer& writer, int symbol) {
+	if (symbol < 144) {
+		write_huffman_code(writer, 0x30 + symbol, 8);
+	}
+	else if (symbol < 256) {
+		write_huffman_code(writer, 0x190 + symbol - 144, 9);
+	}
+	else if (symbol < 280) {
+		write_huffman_code(writer, symbol - 256, 7);
+	}
+	else {
+		write_huffman_code(writer, 0xc0 + symbol - 280, 8);
+	}
+}
+
+const int length_bases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const int length_extra_bits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const int distance_bases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const int distance_extra_bits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+void write_match(bit_writer& writer, int length, int distance) {
+	int length_code = 28;
+	while (length_bases[length_code] > length) {
+		length_code--;
+	}
+	write_fixed_symbol(writer, 257 + length_code);
+	write_bits(writer, length - length_bases[length_code], length_extra_bits[length_code]);
+
+	int distance_code = 29;
+	while (distance_bases[distance_code] > distance) {
+		distance_code--;
+	}
+	write_huffman_code(writer, distance_code, 5);
+	write_bits(writer, distance - distance_bases[distance_code], distance_extra_bits[distance_code]);
+}
+
+const int deflate_window = 1 << 15;
+const int deflate_hash_size = 1 << 15;
+const int deflate_max_chain = 32; // Earlier positions with the same hash tried per match, trades compression for speed
+const int deflate_min_match = 3;
+const int deflate_max_match = 258;
+
+int deflate_hash(const unsigned char* data) {
+	return ((data[0] << 10) ^ (data[1] << 5) ^ data[2]) & (deflate_hash_size - 1);
+}
+
+// One fixed huffman block of lz77 literals and matches, found through hash chains of earlier positions with the same three bytes
+// The block is followed by an empty stored block, which ends the output on a byte boundary so independently compressed parts can be concatenated
+void deflate_part(const unsigned char* data, size_t size, bit_writer& writer) {
+	write_bits(writer, 0, 1); // Not the final block
+	write_bits(writer, 1, 2); // Fixed huffman codes
+
+	std::vector<int> head(deflate_hash_size, -1);
+	std::vector<int> previous(deflate_window, -1); // Previous position with the same hash, indexed by position modulo the window
+
+	size_t position = 0;
+	while (position < size) {
+		int best_length = 0;
+		int best_distance = 0;
+		if (position + deflate_min_match <= size) {
+			int hash = deflate_hash(data + position);
+			int max_length = static_cast<int>(std::min<size_t>(deflate_max_match, size - position));
+			int candidate = head[hash];
+			for (int chain = 0; chain < deflate_max_chain && candidate >= 0 && static_cast<int>(position) - candidate <= deflate_window; chain++) {
+				const unsigned char* match = data + candidate;
+				if (match[best_length] == data[position + best_length]) {
+					int length = 0;
+					while (length < max_length && match[length] == data[position + length]) {
+						length++;
+					}
+					if (length > best_length) {
+						best_length = length;
+						best_distance = static_cast<int>(position) - candidate;
+						if (length == max_length) {
+							break;
+						}
+					}
+				}
+				candidate = previous[candidate & (deflate_window - 1)];
+			}
+		}
+
+		int advance = 1;
+		if (best_length >= deflate_min_match) {
+			write_match(writer, best_length, best_distance);
+			advance = best_length;
+		}
+		else {
+			write_fixed_symbol(writer, data[position]);
+		}
+
+		for (size_t end = position + advance; position < end; position++) {
+			if (position + deflate_min_match <= size) {
+				int hash = deflate_hash(data + position);
+				previous[position & (deflate_window - 1)] = head[hash];
+				head[hash] = static_cast<int>(position);
+			}
+		}
+	}
+	write_fixed_symbol(writer, 256); // End of block
+
+	write_bits(writer, 0, 3); // Empty stored block, not final
+	if (writer.nr_bits > 0) {
+		write_bits(writer, 0, 8 - writer.nr_bits);
+	}
+	write_bits(writer, 0x0000, 16);
+	write_bits(writer, 0xffff, 16);
+}
+
+// Running adler-32 checksum, starts from 1
+uint32_t adler32(uint32_t adler, const unsigned char* data, size_t size) {
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	while (size > 0) {
+		size_t chunk = std::min<size_t>(size, 5552); // Largest run before the sums can overflow 32 bits
+		for (size_t k = 0; k < chunk; k++) {
+			a += data[k];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		data += chunk;
+		size -= chunk;
+	}
+	return (b << 16) | a;
+}
+
+void append_big_endian(std::vector<unsigned char>& bytes, uint32_t value) {
+	bytes.push_back(static_cast<unsigned char>(value >> 24));
+	bytes.push_back(static_cast<unsigned char>(value >> 16));
+	bytes.push_back(static_cast<unsigned char>(value >> 8));
+	bytes.push_back(static_cast<unsigned char>(value));
+}
+
+// Deflate blocks of the data, compressed in parts of at least 256 KB on all hardware threads like pigz does
+// Every part ends on a byte boundary and none is final, so the output of several calls can follow each other in one stream
+// Matches don't reach back into the previous part, which costs a little compression at the start of each part
+void deflate_parts(const unsigned char* data, size_t size, std::vector<unsigned char>& compressed) {
+	const size_t min_part_size = 1 << 18;
+	int nr_parts = static_cast<int>(std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), size / min_part_size)));
+	std::vector<bit_writer> parts(nr_parts);
+	parallel_for_rows(nr_parts, [&](int part) {
+		size_t begin = size * part / nr_parts;
+		size_t end = size * (part + 1) / nr_parts;
+		parts[part].bytes.reserve((end - begin) / 2);
+		deflate_part(data + begin, end - begin, parts[part]);
+	});
+
+	for (const bit_writer& part : parts) {
+		compressed.insert(compressed.end(), part.bytes.begin(), part.bytes.end());
+	}
+}
+
+// Deflate bits are read from the least significant bit of each byte up, reading past the end returns zeros and flags it
+struct bit_reader {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	size_t position = 0;
+	int bit = 0;
+	bool overrun = false;
+};
+
+uint32_t read_bits(bit_reader& reader, int count) {
+	uint32_t bits = 0;
+	for (int k = 0; k < count; k++) {
+		if (reader.position >= reader.size) {
+			reader.overrun = true;
+			return 0;
+		}
+		bits |= static_cast<uint32_t>((reader.data[reader.position] >> reader.bit) & 1) << k;
+		if (++reader.bit == 8) {
+			reader.bit = 0;
+			reader.position++;
+		}
+	}
+	return bits;
+}
+
+// Huffman codes are read most significant bit first
+uint32_t read_huffman_bits(bit_reader& reader, uint32_t code, int count) {
+	for (int k = 0; k < count; k++) {
+		code = (code << 1) | read_bits(reader, 1);
+	}
+	return code;
+}
+
+// Fixed huffman symbol, the 7 bit codes are tried first, then the 8 and 9 bit codes that start where they end
+int read_fixed_symbol(bit_reader& reader) {
+	uint32_t code = read_huffman_bits(reader, 0, 7);
+	if (code <= 0x17) {
+		return 256 + code;
+	}
+	code = read_huffman_bits(reader, code, 1);
+	if (code >= 0x30 && code <= 0xbf) {
+		return code - 0x30;
+	}
+	if (code >= 0xc0 && code <= 0xc7) {
+		return 280 + code - 0xc0;
+	}
+	code = read_huffman_bits(reader, code, 1);
+	return 144 + code - 0x190;
+}
+
+// Inflate a deflate stream of stored and fixed huffman blocks, the blocks deflate_parts writes, up to its final block
+// Dynamic huffman blocks are not read since nothing here writes them, false for those and for a damaged stream
+bool inflate_blocks(const unsigned char* data, size_t size, std::vector<unsigned char>& output) {
+	bit_reader reader;
+	reader.data = data;
+	reader.size = size;
+	bool final_block = false;
+	while (!final_block) {
+		final_block = (read_bits(reader, 1) == 1);
+		uint32_t block_type = read_bits(reader, 2);
+		if (block_type == 0) {
+			if (reader.bit > 0) {
+				reader.bit = 0;
+				reader.position++;
+			}
+			uint32_t length = read_bits(reader, 16);
+			uint32_t inverted_length = read_bits(reader, 16);
+			if (reader.overrun || (length ^ 0xffff) != inverted_length || reader.position + length > reader.size) {
+				return false;
+			}
+			output.insert(output.end(), reader.data + reader.position, reader.data + reader.position + length);
+			reader.position += length;
+		}
+		else if (block_type == 1) {
+			while (true) {
+				int symbol = read_fixed_symbol(reader);
+				if (reader.overrun || symbol > 285) {
+					return false;
+				}
+				if (symbol < 256) {
+					output.push_back(static_cast<unsigned char>(symbol));
+				}
+				else if (symbol == 256) {
+					break;
+				}
+				else {
+					int length = length_bases[symbol - 257] + static_cast<int>(read_bits(reader, length_extra_bits[symbol - 257]));
+					uint32_t distance_code = read_huffman_bits(reader, 0, 5);
+					if (distance_code >= 30) {
+						return false;
+					}
+					size_t distance = distance_bases[distance_code] + read_bits(reader, distance_extra_bits[distance_code]);
+					if (reader.overrun || distance > output.size()) {
+						return false;
+					}
+					size_t source = output.size() - distance;
+					for (int k = 0; k < length; k++) {
+						output.push_back(output[source + k]); // Matches may overlap the bytes they produce
+					}
+				}
+			}
+		}
+		else {
+			return false;
+		}
+	}
+	return !reader.overrun;
+}
+
+uint32_t crc32(const unsigned char* data, size_t size) {
+	static const std::vector<uint32_t> table = []() {
+		std::vector<uint32_t> entries(256);
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int bit = 0; bit < 8; bit++) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			entries[n] = c;
+		}
+		return entries;
+	}();
+
+	uint32_t c = 0xffffffffu;
+	for (size_t k = 0; k < size; k++) {
+		c = table[(c ^ data[k]) & 0xff] ^ (c >> 8);
+	}
+	return c ^ 0xffffffffu;
+}
+
+void append_png_chunk(std::vector<unsigned char>& file, const char* type, const std::vector<unsigned char>& data) {
+	append_big_endian(file, static_cast<uint32_t>(data.size()));
+	size_t type_begin = file.size();
+	file.insert(file.end(), type, type + 4);
+	file.insert(file.end(), data.begin(), data.end());
+	append_big_endian(file, crc32(&file[type_begin], file.size() - type_begin));
+}
+
+int paeth_predictor(int left, int up, int up_left) {
+	int estimate = left + up - up_left;
+	int left_distance = std::abs(estimate - left);
+	int up_distance = std::abs(estimate - up);
+	int up_left_distance = std::abs(estimate - up_left);
+	if (left_distance <= up_distance && left_distance <= up_left_distance) {
+		return left;
+	}
+	return (up_distance <= up_left_distance) ? up : up_left;
+}
+
+// Each row is filtered with the png filter that leaves the smallest sum of absolute differences, the usual heuristic
+// The first row predicts from the last row of the previous band, which is empty at the top of the image
+// Filters predict each byte from the same byte of the pixel to the left, 3 bytes back for 8 bit channels and 6 for 16 bit
+void filter_png_rows(const std::vector<unsigned char>& bytes, int width, int bytes_per_pixel, int nr_rows, const std::vector<unsigned char>& previous_row, std::vector<unsigned char>& filtered) {
+	size_t row_size = static_cast<size_t>(width) * bytes_per_pixel;
+	size_t pixel_size = static_cast<size_t>(bytes_per_pixel);
+	filtered.resize((row_size + 1) * nr_rows);
+	parallel_for_rows(nr_rows, [&](int row) {
+		const unsigned char* current = &bytes[row_size * row];
+		const unsigned char* above = (row > 0) ? &bytes[row_size * (row - 1)] : (previous_row.empty() ? nullptr : previous_row.data());
+		std::vector<unsigned char> candidate(row_size);
+		long long best_cost = -1;
+		for (int filter = 0; filter < 5; filter++) {
+			long long cost = 0;
+			for (size_t k = 0; k < row_size; k++) {
+				int left = (k >= pixel_size) ? current[k - pixel_size] : 0;
+				int up = above ? above[k] : 0;
+				int up_left = (above && k >= pixel_size) ? above[k - pixel_size] : 0;
+				int prediction = 0;
+				switch (filter) {
+				case 1:
+					prediction = left;
+				break;
+				case 2:
+					prediction = up;
+				break;
+				case 3:
+					prediction = (left + up) / 2;
+				break;
+				case 4:
+					prediction = paeth_predictor(left, up, up_left);
+				break;
+				default:
+				break;
+				}
+				candidate[k] = static_cast<unsigned char>(current[k] - prediction);
+				cost += std::abs(static_cast<signed char>(candidate[k]));
+			}
+			if (best_cost < 0 || cost < best_cost) {
+				best_cost = cost;
+				unsigned char* destination = &filtered[(row_size + 1) * row];
+				destination[0] = static_cast<unsigned char>(filter);
+				std::copy(candidate.begin(), candidate.end(), destination + 1);
+			}
+		}
+	});
+}
+
+// The whole file goes out in a single write
+bool write_file(const std::string& path, const std::vector<unsigned char>& file) {
+	std::ofstream output(path, std::ios::binary);
+	output.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return output.good();
+}
+
+// Replace a file in one step, a render killed while writing the new file leaves the previous one intact
+bool replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool image_rows_bottom_up(image_format_enum format) {
+	return format == PFM_IMAGE;
+}
+
+// The header is kept back and goes out with the first band
+bool begin_image_stream(image_stream& stream, const std::string& base_name, int width, int height, image_format_enum format, const tone_mapping& display) {
+	stream.path = base_name + image_extension(format);
+	stream.format = format;
+	stream.display = display;
+	stream.display.bits = (display.bits == 16) ? 16 : 8;
+	stream.width = width;
+	stream.height = height;
+	stream.rows_written = 0;
+	stream.previous_row.clear();
+	stream.adler = 1;
+	stream.pending.clear();
+	stream.file.open(stream.path, std::ios::binary);
+
+	switch (format) {
+	case PFM_IMAGE: {
+		uint32_t byte_order_check = 1;
+		bool little_endian = (*reinterpret_cast<unsigned char*>(&byte_order_check) == 1);
+		append_text(stream.pending, "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + (little_endian ? "-1.0" : "1.0") + "\n");
+	}
+	break;
+	case PNG_IMAGE: {
+		const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		stream.pending.assign(signature, signature + 8);
+		std::vector<unsigned char> header;
+		append_big_endian(header, static_cast<uint32_t>(width));
+		append_big_endian(header, static_cast<uint32_t>(height));
+		const unsigned char header_tail[5] = { static_cast<unsigned char>(stream.display.bits), 2, 0, 0, 0 }; // Bits per channel, rgb, deflate, adaptive filtering, no interlace
+		header.insert(header.end(), header_tail, header_tail + 5);
+		append_png_chunk(stream.pending, "IHDR", header);
+	}
+	break;
+	default:
+		append_text(stream.pending, "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n" + std::to_string((1 << stream.display.bits) - 1) + "\n");
+	break;
+	}
+	return stream.file.good();
+}
+
+// Encode a band of rows, given top to bottom, and write it in one write, scale turns the pixel values into radiance
+// Bands follow each other down the image, for formats that store rows bottom up they follow each other up the image
+// Rows are tone mapped or converted in parallel, png bands are filtered and deflated in parallel and become one IDAT chunk each
+void write_image_band(image_stream& stream, const std::vector<color>& pixels, int nr_rows, double scale) {
+	int width = stream.width;
+	switch (stream.format) {
+	case PFM_IMAGE: {
+		size_t header_size = stream.pending.size();
+		size_t row_size = static_cast<size_t>(width) * 3;
+		stream.pending.resize(header_size + row_size * nr_rows * sizeof(float));
+		float* values = reinterpret_cast<float*>(&stream.pending[header_size]);
+		parallel_for_rows(nr_rows, [&](int row) {
+			float* destination = values + row_size * (nr_rows - 1 - row); // Bottom row first
+			for (size_t k = 0; k < row_size; k++) {
+				destination[k] = static_cast<float>(pixels[static_cast<size_t>(row) * width + k / 3][k % 3] * scale);
+			}
+		});
+	}
+	break;
+	case PNG_IMAGE: {
+		std::vector<unsigned char> bytes;
+		std::vector<unsigned char> filtered;
+		int bytes_per_pixel = 3 * stream.display.bits / 8;
+		tone_map_rows(pixels, width, nr_rows, stream.rows_written, scale, stream.display, bytes);
+		filter_png_rows(bytes, width, bytes_per_pixel, nr_rows, stream.previous_row, filtered);
+		stream.previous_row.assign(bytes.end() - static_cast<size_t>(width) * bytes_per_pixel, bytes.end());
+		stream.adler = adler32(stream.adler, filtered.data(), filtered.size());
+
+		std::vector<unsigned char> compressed;
+		if (stream.rows_written == 0) {
+			compressed.push_back(0x78); // Zlib stream of deflate with a 32 KB window
+			compressed.push_back(0x01); // Fastest compression level, makes the header a multiple of 31
+		}
+		deflate_parts(filtered.data(), filtered.size(), compressed);
+		append_png_chunk(stream.pending, "IDAT", compressed);
+	}
+	break;
+	default: {
+		std::vector<unsigned char> bytes;
+		tone_map_rows(pixels, width, nr_rows, stream.rows_written, scale, stream.display, bytes);
+		stream.pending.insert(stream.pending.end(), bytes.begin(), bytes.end());
+	}
+	break;
+	}
+
+	stream.rows_written += nr_rows;
+	stream.file.write(reinterpret_cast<const char*>(stream.pending.data()), stream.pending.size());
+	stream.pending.clear();
+}
+
+bool end_image_stream(image_stream& stream) {
+	if (stream.format == PNG_IMAGE) {
+		std::vector<unsigned char> trailer = { 0x03, 0x00 }; // Final empty fixed huffman block
+		append_big_endian(trailer, stream.adler);
+		append_png_chunk(stream.pending, "IDAT", trailer);
+		append_png_chunk(stream.pending, "IEND", std::vector<unsigned char>());
+	}
+	stream.file.write(reinterpret_cast<const char*>(stream.pending.data()), stream.pending.size());
+	stream.pending.clear();
+	bool written = stream.file.good() && stream.rows_written == stream.height;
+	std::cout << (written ? "Wrote " : "Failed to write ") << stream.path << " (" << stream.file.tellp() << " bytes)" << std::endl;
+	stream.file.close();
+	return written;
+}
+
+// Write the whole image as base_name with the extension of the format, as a single band
+bool write_image(const std::string& base_name, const std::vector<color>& pixels, int width, int height, double scale, image_format_enum format, const tone_mapping& display) {
+	image_stream stream;
+	begin_image_stream(stream, base_name, width, height, format, display);
+	write_image_band(stream, pixels, height, scale);
+	return end_image_stream(stream);
+}
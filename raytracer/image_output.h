@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include "util.h"
+#include "tone_mapping.h"
+
+// Enum for the file format the rendered image is written in
+enum image_format_enum {
+	PPM_IMAGE, // Binary P6 portable pixmap, 8 or 16 bit tone mapped
+	PFM_IMAGE, // Portable float map of the linear radiance, keeps the HDR values the tone mapped formats compress
+	PNG_IMAGE // 8 or 16 bit tone mapped, compressed with our own deflate
+};
+
+// Image written band by band as its rows become available, each band goes out in one write
+struct image_stream {
+	std::ofstream file;
+	std::string path;
+	image_format_enum format = PPM_IMAGE;
+	tone_mapping display; // Conversion of the radiance for ppm and png
+	int width = 0;
+	int height = 0;
+	int rows_written = 0;
+	std::vector<unsigned char> pending; // Encoded bytes not written yet, the header waits for the first band
+	std::vector<unsigned char> previous_row; // Last tone mapped row of the previous band, png filters predict from it
+	uint32_t adler = 1; // Running checksum of the filtered png rows
+};
+
+const char* image_extension(image_format_enum format);
+uint32_t adler32(uint32_t adler, const unsigned char* data, size_t size);
+void encode_float_map(const std::vector<float>& values, int width, int height, int nr_channels, std::vector<unsigned char>& file);
+void deflate_parts(const unsigned char* data, size_t size, std::vector<unsigned char>& compressed);
+bool inflate_blocks(const unsigned char* data, size_t size, std::vector<unsigned char>& output);
+bool write_file(const std::string& path, const std::vector<unsigned char>& file);
+bool replace_file(const std::string& from, const std::string& to);
+bool image_rows_bottom_up(image_format_enum format);
+bool begin_image_stream(image_stream& stream, const std::string& base_name, int width, int height, image_format_enum format, const tone_mapping& display);
+void write_image_band(image_stream& stream, const std::vector<color>& pixels, int nr_rows, double scale);
+bool end_image_stream(image_stream& stream);
+bool write_image(const std::string& base_name, const std::vector<color>& pixels, int width, int height, double scale, image_format_enum format, const tone_mapping& display);
@@ -5,8 +5,18 @@
 #include "util.h"
 #include "create_image.h"
 #include "camera.h"
+#include "verification.h"
+
+int main(int argc, char* argv[]) {
+	// Self-checks of the render modes instead of a render, see verification.h
+	if (argc > 1 && std::string(argv[1]) == "--verify") {
+		return run_verification() ? 0 : 1;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+		benchmark_fast_math(std::cout);
+		return 0;
+	}
 
-int main() {
 	auto start = std::chrono::high_resolution_clock::now(); // Start the timer
 	create_image(); // Render the image
 	auto stop = std::chrono::high_resolution_clock::now(); // Stop the timer
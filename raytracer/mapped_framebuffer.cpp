@@ -0,0 +1,304 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "mapped_framebuffer.h"
+#include "post_processing.h"
+
+// Round to nearest even half float, values beyond the half range become infinity
+uint16_t float_to_half(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7fffff;
+	int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+
+	if (((bits >> 23) & 0xff) == 0xff) {
+		return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // Infinity or nan
+	}
+	if (exponent >= 31) {
+		return static_cast<uint16_t>(sign | 0x7c00);
+	}
+	if (exponent <= 0) {
+		// Subnormal half, the implicit leading one becomes part of the shifted mantissa
+		if (exponent < -10) {
+			return static_cast<uint16_t>(sign);
+		}
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half_mantissa = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) {
+			half_mantissa++;
+		}
+		return static_cast<uint16_t>(sign | half_mantissa);
+	}
+
+	uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		half++; // A carry out of the mantissa correctly moves on to the next exponent
+	}
+	return static_cast<uint16_t>(half);
+}
+
+float half_to_float(uint16_t half) {
+	uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	uint32_t bits;
+
+	if (exponent == 0) {
+		if (mantissa == 0) {
+			bits = sign;
+		}
+		else {
+			// Subnormal half, normalized for the wider float exponent
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				exponent--;
+			}
+			bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else if (exponent == 31) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else {
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// Tiles are rounded up to 64 KB, the granularity of mapping offsets on every platform
+bool create_mapped_framebuffer(mapped_framebuffer& framebuffer, const std::string& path, int width, int height, bool half_precision) {
+	const size_t granularity = 1 << 16;
+	framebuffer.path = path;
+	framebuffer.width = width;
+	framebuffer.height = height;
+	framebuffer.tiles_x = (width + framebuffer_tile_size - 1) / framebuffer_tile_size;
+	framebuffer.tiles_y = (height + framebuffer_tile_size - 1) / framebuffer_tile_size;
+	framebuffer.half_precision = half_precision;
+	size_t pixel_bytes = 4 * (half_precision ? sizeof(uint16_t) : sizeof(float)); // Mean color and weight
+	framebuffer.tile_bytes = (static_cast<size_t>(framebuffer_tile_size) * framebuffer_tile_size * pixel_bytes + granularity - 1) / granularity * granularity;
+	size_t nr_tiles = static_cast<size_t>(framebuffer.tiles_x) * framebuffer.tiles_y;
+	framebuffer.tile_mutexes.reset(new std::mutex[nr_tiles]);
+	uint64_t file_size = static_cast<uint64_t>(nr_tiles) * framebuffer.tile_bytes;
+
+	// The file starts out as zeros, a pixel with no weight and no color
+#ifdef _WIN32
+	framebuffer.file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, nullptr);
+	if (framebuffer.file_handle == INVALID_HANDLE_VALUE) {
+		framebuffer.file_handle = nullptr;
+		return false;
+	}
+	framebuffer.mapping_handle = CreateFileMappingA(framebuffer.file_handle, nullptr, PAGE_READWRITE, static_cast<DWORD>(file_size >> 32), static_cast<DWORD>(file_size & 0xffffffff), nullptr);
+	return framebuffer.mapping_handle != nullptr;
+#else
+	framebuffer.file_descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (framebuffer.file_descriptor < 0) {
+		return false;
+	}
+	return ftruncate(framebuffer.file_descriptor, static_cast<off_t>(file_size)) == 0;
+#endif
+}
+
+// Close and delete the file of the framebuffer
+void close_mapped_framebuffer(mapped_framebuffer& framebuffer) {
+#ifdef _WIN32
+	if (framebuffer.mapping_handle) {
+		CloseHandle(framebuffer.mapping_handle);
+		framebuffer.mapping_handle = nullptr;
+	}
+	if (framebuffer.file_handle) {
+		CloseHandle(framebuffer.file_handle);
+		framebuffer.file_handle = nullptr;
+	}
+#else
+	if (framebuffer.file_descriptor >= 0) {
+		close(framebuffer.file_descriptor);
+		framebuffer.file_descriptor = -1;
+	}
+#endif
+	std::remove(framebuffer.path.c_str());
+}
+
+void* map_tile(mapped_framebuffer& framebuffer, int tile) {
+	uint64_t offset = static_cast<uint64_t>(tile) * framebuffer.tile_bytes;
+#ifdef _WIN32
+	return MapViewOfFile(framebuffer.mapping_handle, FILE_MAP_ALL_ACCESS, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xffffffff), framebuffer.tile_bytes);
+#else
+	void* data = mmap(nullptr, framebuffer.tile_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, framebuffer.file_descriptor, static_cast<off_t>(offset));
+	return (data == MAP_FAILED) ? nullptr : data;
+#endif
+}
+
+// Unmapping lets the system write the tile back and drop its pages
+void unmap_tile(mapped_framebuffer& framebuffer, void* data) {
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap(data, framebuffer.tile_bytes);
+#endif
+}
+
+void load_pixel(const mapped_framebuffer& framebuffer, const void* tile, int pixel, color& mean, double& weight) {
+	if (framebuffer.half_precision) {
+		const uint16_t* values = static_cast<const uint16_t*>(tile) + 4 * pixel;
+		mean = color(half_to_float(values[0]), half_to_float(values[1]), half_to_float(values[2]));
+		weight = half_to_float(values[3]);
+	}
+	else {
+		const float* values = static_cast<const float*>(tile) + 4 * pixel;
+		mean = color(values[0], values[1], values[2]);
+		weight = values[3];
+	}
+}
+
+void store_pixel(const mapped_framebuffer& framebuffer, void* tile, int pixel, const color& mean, double weight) {
+	if (framebuffer.half_precision) {
+		uint16_t* values = static_cast<uint16_t*>(tile) + 4 * pixel;
+		values[0] = float_to_half(static_cast<float>(mean.x));
+		values[1] = float_to_half(static_cast<float>(mean.y));
+		values[2] = float_to_half(static_cast<float>(mean.z));
+		values[3] = float_to_half(static_cast<float>(weight));
+	}
+	else {
+		float* values = static_cast<float*>(tile) + 4 * pixel;
+		values[0] = static_cast<float>(mean.x);
+		values[1] = static_cast<float>(mean.y);
+		values[2] = static_cast<float>(mean.z);
+		values[3] = static_cast<float>(weight);
+	}
+}
+
+// Call the visitor for every pixel of a rectangle with its tile mapped and locked, tile by tile
+// The visitor gets the mapped tile, the index of the pixel in the tile and its image row and column
+template <typename pixel_visitor>
+void visit_framebuffer(mapped_framebuffer& framebuffer, int row_begin, int row_end, int column_begin, int column_end, pixel_visitor visitor) {
+	for (int tile_y = row_begin / framebuffer_tile_size; tile_y * framebuffer_tile_size < row_end; tile_y++) {
+		for (int tile_x = column_begin / framebuffer_tile_size; tile_x * framebuffer_tile_size < column_end; tile_x++) {
+			int tile = tile_y * framebuffer.tiles_x + tile_x;
+			int tile_row = tile_y * framebuffer_tile_size;
+			int tile_column = tile_x * framebuffer_tile_size;
+
+			std::lock_guard<std::mutex> lock(framebuffer.tile_mutexes[tile]);
+			void* data = map_tile(framebuffer, tile);
+			if (!data) {
+				std::cerr << "Failed to map tile " << tile << " of " << framebuffer.path << std::endl;
+				continue;
+			}
+			for (int row = std::max(row_begin, tile_row); row < std::min(row_end, tile_row + framebuffer_tile_size); row++) {
+				for (int column = std::max(column_begin, tile_column); column < std::min(column_end, tile_column + framebuffer_tile_size); column++) {
+					visitor(data, (row - tile_row) * framebuffer_tile_size + (column - tile_column), row, column);
+				}
+			}
+			unmap_tile(framebuffer, data);
+		}
+	}
+}
+
+// Merge the samples of a tile into the framebuffer, the weighted means of both are combined by their weights
+void accumulate_framebuffer(mapped_framebuffer& framebuffer, const sample_buffers& samples) {
+	visit_framebuffer(framebuffer, samples.row_offset, samples.row_offset + samples.height, samples.column_offset, samples.column_offset + samples.width, [&](void* tile, int pixel, int row, int column) {
+		size_t first = (static_cast<size_t>(row - samples.row_offset) * samples.width + (column - samples.column_offset)) * samples.nr_buffers;
+		color sum = color(0.0, 0.0, 0.0);
+		double weight = 0.0;
+		for (int buffer = 0; buffer < samples.nr_buffers; buffer++) {
+			sum += samples.sums[first + buffer];
+			weight += samples.weights[first + buffer];
+		}
+
+		color mean;
+		double stored_weight;
+		load_pixel(framebuffer, tile, pixel, mean, stored_weight);
+		double total_weight = stored_weight + weight;
+		store_pixel(framebuffer, tile, pixel, (total_weight > 0.0) ? (mean * stored_weight + sum) / total_weight : color(0.0, 0.0, 0.0), total_weight);
+	});
+}
+
+// Mean colors of a rectangle, row by row, negative filter lobes are clamped like in memory
+void read_framebuffer(mapped_framebuffer& framebuffer, int row_begin, int row_end, int column_begin, int column_end, std::vector<color>& pixels) {
+	int width = column_end - column_begin;
+	pixels.resize(static_cast<size_t>(row_end - row_begin) * width);
+	visit_framebuffer(framebuffer, row_begin, row_end, column_begin, column_end, [&](void* tile, int pixel, int row, int column) {
+		color mean;
+		double weight;
+		load_pixel(framebuffer, tile, pixel, mean, weight);
+		pixels[static_cast<size_t>(row - row_begin) * width + (column - column_begin)] = glm::max(mean, color(0.0, 0.0, 0.0));
+	});
+}
+
+void write_framebuffer(mapped_framebuffer& framebuffer, int row_begin, int row_end, int column_begin, int column_end, const std::vector<color>& pixels) {
+	int width = column_end - column_begin;
+	visit_framebuffer(framebuffer, row_begin, row_end, column_begin, column_end, [&](void* tile, int pixel, int row, int column) {
+		store_pixel(framebuffer, tile, pixel, pixels[static_cast<size_t>(row - row_begin) * width + (column - column_begin)], 1.0);
+	});
+}
+
+// Separable gaussian from one mapped framebuffer into another, one destination tile at a time on each hardware thread
+// A tile reads the source around it as far as the kernel reaches, taps outside the image are dropped and the rest renormalized like in memory
+void gaussian_filter_framebuffer(mapped_framebuffer& source, mapped_framebuffer& destination, double sigma) {
+	std::vector<double> kernel = gaussian_kernel(sigma);
+	int radius = kernel.size() / 2;
+	int nr_tiles = source.tiles_x * source.tiles_y;
+
+	parallel_for_rows(nr_tiles, [&](int tile) {
+		int row_begin = (tile / source.tiles_x) * framebuffer_tile_size;
+		int column_begin = (tile % source.tiles_x) * framebuffer_tile_size;
+		int row_end = std::min(row_begin + framebuffer_tile_size, source.height);
+		int column_end = std::min(column_begin + framebuffer_tile_size, source.width);
+		int region_row_begin = std::max(row_begin - radius, 0);
+		int region_row_end = std::min(row_end + radius, source.height);
+		int region_column_begin = std::max(column_begin - radius, 0);
+		int region_column_end = std::min(column_end + radius, source.width);
+		int region_width = region_column_end - region_column_begin;
+		int tile_width = column_end - column_begin;
+
+		std::vector<color> region;
+		read_framebuffer(source, region_row_begin, region_row_end, region_column_begin, region_column_end, region);
+
+		// Horizontal pass over every row of the region, for the columns of the tile
+		std::vector<color> horizontal(static_cast<size_t>(region_row_end - region_row_begin) * tile_width);
+		for (int row = region_row_begin; row < region_row_end; row++) {
+			for (int column = column_begin; column < column_end; column++) {
+				color sum = color(0.0, 0.0, 0.0);
+				double weight = 0.0;
+				for (int k = std::max(0, radius - column); k < std::min(static_cast<int>(kernel.size()), source.width + radius - column); k++) {
+					sum += kernel[k] * region[static_cast<size_t>(row - region_row_begin) * region_width + (column + k - radius - region_column_begin)];
+					weight += kernel[k];
+				}
+				horizontal[static_cast<size_t>(row - region_row_begin) * tile_width + (column - column_begin)] = sum / weight;
+			}
+		}
+
+		// Vertical pass for the rows of the tile
+		std::vector<color> filtered(static_cast<size_t>(row_end - row_begin) * tile_width);
+		for (int row = row_begin; row < row_end; row++) {
+			for (int column = 0; column < tile_width; column++) {
+				color sum = color(0.0, 0.0, 0.0);
+				double weight = 0.0;
+				for (int k = std::max(0, radius - row); k < std::min(static_cast<int>(kernel.size()), source.height + radius - row); k++) {
+					sum += kernel[k] * horizontal[static_cast<size_t>(row + k - radius - region_row_begin) * tile_width + column];
+					weight += kernel[k];
+				}
+				filtered[static_cast<size_t>(row - row_begin) * tile_width + column] = sum / weight;
+			}
+		}
+
+		write_framebuffer(destination, row_begin, row_end, column_begin, column_end, filtered);
+	});
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "util.h"
+#include "accumulation.h"
+
+// Enum for where the path tracer accumulates the image
+enum framebuffer_enum {
+	MEMORY_FRAMEBUFFER, // Pixel matrix in memory, used by every integrator and post-processing step
+	MAPPED_FLOAT_FRAMEBUFFER, // Tiles in a memory mapped file, 16 bytes per pixel
+	MAPPED_HALF_FRAMEBUFFER // Tiles in a memory mapped file, 8 bytes per pixel, weights above 65504 samples overflow
+};
+
+// Width and height in pixels of the tiles of a mapped framebuffer, also the tiles the path tracer renders into it
+const int framebuffer_tile_size = 128;
+
+// Image too large for memory, kept as square tiles in a file, a tile is only mapped while it is read or written
+// Each pixel holds its filter weighted mean color and the filter weight behind it, so tiles sharing a splatted border can be merged
+struct mapped_framebuffer {
+	std::string path;
+	int width = 0;
+	int height = 0;
+	int tiles_x = 0;
+	int tiles_y = 0;
+	bool half_precision = false;
+	size_t tile_bytes = 0; // Rounded up to the mapping granularity so each tile is mapped on its own
+	std::unique_ptr<std::mutex[]> tile_mutexes; // Tiles next to each other overlap where samples are splatted across their border
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#else
+	int file_descriptor = -1;
+#endif
+};
+
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t half);
+
+bool create_mapped_framebuffer(mapped_framebuffer& framebuffer, const std::string& path, int width, int height, bool half_precision);
+void close_mapped_framebuffer(mapped_framebuffer& framebuffer);
+void accumulate_framebuffer(mapped_framebuffer& framebuffer, const sample_buffers& samples);
+void read_framebuffer(mapped_framebuffer& framebuffer, int row_begin, int row_end, int column_begin, int column_end, std::vector<color>& pixels);
+void write_framebuffer(mapped_framebuffer& framebuffer, int row_begin, int row_end, int column_begin, int column_end, const std::vector<color>& pixels);
+void gaussian_filter_framebuffer(mapped_framebuffer& source, mapped_framebuffer& destination, double sigma);
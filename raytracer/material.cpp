@@ -1,11 +1,61 @@
+#include <cstring>
+#include <unordered_map>
 #include "material.h"
 #include "ray.h"
 #include "glm.hpp"
 #include "util.h"
 #include "geometry.h"
-#include "camera.h"
 #include "pdf.h"
 #include "geometry_util.h"
+#include "fast_math.h"
+
+// Material table shared by all scenes, filled while scenes are created and only read while rendering
+// Entry 0 is the default grey lambertian of objects created without a material
+std::vector<material_properties> material_table(1);
+
+bool same_texture(const texture& a, const texture& b) {
+	return a.texture_type == b.texture_type && a.even_color == b.even_color && a.odd_color == b.odd_color && a.scale == b.scale && a.image_index == b.image_index;
+}
+
+// Textures only add their type and image, entries with equal hashes are compared in full
+uint64_t material_hash(const material_properties& properties) {
+	double values[6] = { properties.material_color.x, properties.material_color.y, properties.material_color.z, properties.metal_fuzz, properties.refraction_index, properties.inner_refraction_index };
+	uint64_t hash = 14695981039346656037ull;
+	int keys[3] = { properties.material, properties.material_texture.texture_type, properties.material_texture.image_index };
+	for (int k = 0; k < 3; k++) {
+		hash = (hash ^ static_cast<uint64_t>(keys[k])) * 1099511628211ull;
+	}
+	for (int k = 0; k < 6; k++) {
+		uint64_t bits;
+		double value = (values[k] == 0.0) ? 0.0 : values[k]; // Negative zero compares equal to zero
+		std::memcpy(&bits, &value, sizeof(bits));
+		hash = (hash ^ bits) * 1099511628211ull;
+	}
+	return hash;
+}
+
+std::unordered_multimap<uint64_t, uint32_t> material_index = { { material_hash(material_properties()), 0 } }; // Entries by the hash of their look, so large scenes register materials in constant time
+
+// Objects with the same look share an entry, so the table stays small and scenes created again reuse their ids
+uint32_t register_material(const material_properties& properties) {
+	uint64_t hash = material_hash(properties);
+	auto candidates = material_index.equal_range(hash);
+	for (auto it = candidates.first; it != candidates.second; ++it) {
+		const material_properties& entry = material_table[it->second];
+		if (entry.material == properties.material && entry.material_color == properties.material_color && entry.metal_fuzz == properties.metal_fuzz &&
+			entry.refraction_index == properties.refraction_index && entry.inner_refraction_index == properties.inner_refraction_index && same_texture(entry.material_texture, properties.material_texture)) {
+			return it->second;
+		}
+	}
+
+	material_table.push_back(properties);
+	material_index.insert({ hash, static_cast<uint32_t>(material_table.size() - 1) });
+	return static_cast<uint32_t>(material_table.size() - 1);
+}
+
+const material_properties& get_material(uint32_t material_id) {
+	return material_table[material_id];
+}
 
 // Uniform lambertian scattering
 bool lambertian_scatter(const ray& ray_in, const hit_record& rec, color& attenuation, ray& scattered_ray, double& pdf) {
@@ -27,12 +77,120 @@ double lambertian_scatter_pdf(const ray& ray_in, const hit_record& rec, const ra
 	return cosine < 0.0 ? 0.0 : cosine / pi;
 }
 
+// Metals are GGX microfacet conductors, the fuzz is the perceptual roughness so the microfacet slope spread is its square
+double ggx_alpha(double metal_fuzz) {
+	return glm::max(metal_fuzz * metal_fuzz, 1e-4);
+}
+
+// Fuzz this small is indistinguishable from a mirror, so it's kept as a specular reflection
+bool metal_is_specular(double metal_fuzz) {
+	return metal_fuzz < 0.01;
+}
+
+// Trowbridge-Reitz distribution of microfacet normals, the cosine is between the microfacet normal and the surface normal
+double ggx_distribution(double cos_h, double alpha) {
+	double alpha_squared = alpha * alpha;
+	double denominator = cos_h * cos_h * (alpha_squared - 1.0) + 1.0;
+	return alpha_squared / (pi * denominator * denominator);
+}
+
+// Smith masking of one direction
+double ggx_smith_g1(double cosine, double alpha) {
+	if (cosine <= 0.0) {
+		return 0.0;
+	}
+	double alpha_squared = alpha * alpha;
+	return 2.0 * cosine / (cosine + glm::sqrt(alpha_squared + (1.0 - alpha_squared) * cosine * cosine));
+}
+
+// Schlick's approximation with the metal color as reflectance at normal incidence
+color metallic_fresnel(const color& f0, double cosine) {
+	return f0 + (color(1.0, 1.0, 1.0) - f0) * pow5(1.0 - glm::clamp(cosine, 0.0, 1.0));
+}
+
+// Sample a microfacet normal visible from the view direction, both in the local frame of the surface normal (Heitz 2018)
+// Only visible normals are generated, so no sample is wasted on microfacets facing away from the incoming ray
+glm::dvec3 sample_ggx_visible_normal(const glm::dvec3& view, double alpha) {
+	// Stretch the view direction to the configuration of a hemisphere with unit roughness
+	glm::dvec3 stretched_view = glm::normalize(glm::dvec3(alpha * view.x, alpha * view.y, view.z));
+
+	double length_squared = stretched_view.x * stretched_view.x + stretched_view.y * stretched_view.y;
+	glm::dvec3 t1 = (length_squared > 0.0) ? glm::dvec3(-stretched_view.y, stretched_view.x, 0.0) / glm::sqrt(length_squared) : glm::dvec3(1.0, 0.0, 0.0);
+	glm::dvec3 t2 = glm::cross(stretched_view, t1);
+
+	// Uniform point on the projected disk, squeezed onto the visible half
+	double r = glm::sqrt(random_double());
+	double phi = 2.0 * pi * random_double();
+	double sin_phi, cos_phi;
+	fast_sincos(phi, sin_phi, cos_phi);
+	double p1 = r * cos_phi;
+	double p2 = r * sin_phi;
+	double s = 0.5 * (1.0 + stretched_view.z);
+	p2 = (1.0 - s) * glm::sqrt(glm::max(0.0, 1.0 - p1 * p1)) + s * p2;
+
+	// Reproject onto the hemisphere and unstretch
+	glm::dvec3 hemisphere_normal = p1 * t1 + p2 * t2 + glm::sqrt(glm::max(0.0, 1.0 - p1 * p1 - p2 * p2)) * stretched_view;
+	return glm::normalize(glm::dvec3(alpha * hemisphere_normal.x, alpha * hemisphere_normal.y, glm::max(0.0, hemisphere_normal.z)));
+}
+
+// Reflect around a visible microfacet normal, the attenuation is the brdf times cosine over the pdf which reduces to fresnel times the masking of the reflection
+// Specular metals reflect in the mirror direction
 bool metallic_reflection(const ray& ray_in, const hit_record& rec, color& attenuation, ray& reflected_ray, double metallic_fuzz) {
-	// Calculate trajectory for reflected ray
-	glm::dvec3 reflected_ray_direction = reflect(glm::normalize(ray_in.direction), rec.normal);
-	reflected_ray = create_ray(rec.point, reflected_ray_direction + (metallic_fuzz * random_hemispherical_direction(rec.normal)));
-	attenuation = rec.material_color;
-	return (glm::dot(reflected_ray.direction, rec.normal) > 0.0); // Absorb rays that reflect below the surface of the object
+	glm::dvec3 unit_direction = glm::normalize(ray_in.direction);
+
+	if (metal_is_specular(metallic_fuzz)) {
+		reflected_ray = create_ray(rec.point, reflect(unit_direction, rec.normal));
+		attenuation = metallic_fresnel(rec.material_color, glm::dot(-unit_direction, rec.normal));
+		return true;
+	}
+
+	double alpha = ggx_alpha(metallic_fuzz);
+	onb onb = build_onb_from_w(rec.normal);
+	glm::dvec3 view = -unit_direction;
+	glm::dvec3 local_view = glm::dvec3(glm::dot(view, onb.u), glm::dot(view, onb.v), glm::dot(view, onb.w));
+	if (local_view.z <= 0.0) {
+		return false;
+	}
+
+	glm::dvec3 microfacet_normal = local_coord(onb, sample_ggx_visible_normal(local_view, alpha));
+	glm::dvec3 reflected_direction = reflect(unit_direction, microfacet_normal);
+	double cos_reflected = glm::dot(reflected_direction, rec.normal);
+
+	// Rough metals can still reflect below the surface off a visible microfacet, that light is lost in a single scattering model
+	if (cos_reflected <= 0.0) {
+		return false;
+	}
+
+	reflected_ray = create_ray(rec.point, reflected_direction);
+	attenuation = metallic_fresnel(rec.material_color, glm::dot(view, microfacet_normal)) * ggx_smith_g1(cos_reflected, alpha);
+	return true;
+}
+
+// Brdf times cosine of a rough metal for light arriving from the scattered direction and leaving towards the view direction
+color metallic_brdf_cosine(const hit_record& rec, const glm::dvec3& view, const glm::dvec3& scattered_direction, double metallic_fuzz) {
+	double cos_view = glm::dot(view, rec.normal);
+	double cos_scattered = glm::dot(scattered_direction, rec.normal);
+	if (cos_view <= 0.0 || cos_scattered <= 0.0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	double alpha = ggx_alpha(metallic_fuzz);
+	glm::dvec3 half_vector = glm::normalize(view + scattered_direction);
+	double d = ggx_distribution(glm::dot(half_vector, rec.normal), alpha);
+	double g = ggx_smith_g1(cos_view, alpha) * ggx_smith_g1(cos_scattered, alpha);
+	return metallic_fresnel(rec.material_color, glm::dot(view, half_vector)) * (d * g / (4.0 * cos_view));
+}
+
+// Solid angle density of visible normal sampling producing the scattered direction
+double metallic_reflection_pdf(const hit_record& rec, const glm::dvec3& view, const glm::dvec3& scattered_direction, double metallic_fuzz) {
+	double cos_view = glm::dot(view, rec.normal);
+	if (cos_view <= 0.0 || glm::dot(scattered_direction, rec.normal) <= 0.0) {
+		return 0.0;
+	}
+
+	double alpha = ggx_alpha(metallic_fuzz);
+	glm::dvec3 half_vector = glm::normalize(view + scattered_direction);
+	return ggx_smith_g1(cos_view, alpha) * ggx_distribution(glm::dot(half_vector, rec.normal), alpha) / (4.0 * cos_view);
 }
 
 // Schlick's approximation for reflectance
@@ -40,7 +198,7 @@ double reflectance(double cosine, double refraction_index) {
 	// Calculate the reflection coefficient (Fresnel reflectance) using Schlick's approximation
 	double r0 = (1.0 - refraction_index) / (1.0 + refraction_index);
 	r0 = r0 * r0;
-	return r0 + (1.0 - r0) * std::pow((1 - cosine), 5);
+	return r0 + (1.0 - r0) * pow5(1 - cosine);
 }
 
 bool dielectric_refraction(const ray& ray_in, const hit_record& rec, color& attenuation, ray& ray_out, double refraction_index) {
@@ -73,11 +231,30 @@ bool dielectric_refraction(const ray& ray_in, const hit_record& rec, color& atte
 	return true;
 }
 
-// When a constant density medium is intersected, give the point the color of the geometry and randomly scatter the ray at the geometrical intersection point
-bool constant_density_medium_scatter(const hit_record& rec, color& attenuation, ray& ray_out, const camera& camera) {
-	// So, this solution is definetly hacky but when I use rec.point as origin point for the ray, internal collison occurs with the boundrary volume
-	// I don't know what causes this and I hope to fix it in the future but for now this seems to work and isn't a hardcoded value
-	ray_out = create_ray(camera.look_at, glm::normalize(random_hemispherical_direction(rec.normal)));
+// Both branches of a dielectric interface with the fresnel reflectance as weight of the reflected branch, used for path splitting
+// Returns false on total internal reflection since there is only one branch to follow
+bool dielectric_split(const ray& ray_in, const hit_record& rec, ray& reflected_ray, ray& refracted_ray, double& reflected_weight, double refraction_index) {
+	double refraction_ratio = rec.outward_face ? (1.0 / refraction_index) : refraction_index;
+	glm::dvec3 unit_direction = glm::normalize(ray_in.direction);
+
+	double cos_theta = std::min(glm::dot(-unit_direction, rec.normal), 1.0);
+	double sin_theta = std::sqrt(1.0 - cos_theta * cos_theta);
+
+	if (refraction_ratio * sin_theta > 1.0) {
+		return false;
+	}
+
+	reflected_weight = reflectance(cos_theta, refraction_ratio);
+	reflected_ray = create_ray(rec.point, reflect(unit_direction, rec.normal));
+	refracted_ray = create_ray(rec.point, refract(unit_direction, rec.normal, refraction_ratio));
+
+	return true;
+}
+
+// When a constant density medium is intersected, give the point the color of the geometry and scatter the ray isotropically from the collision point
+// The collision point lies inside the boundary, the next intersection test clips the medium interval to start there
+bool constant_density_medium_scatter(const hit_record& rec, color& attenuation, ray& ray_out) {
+	ray_out = create_ray(rec.point, random_unit_vector());
 	
 	attenuation = rec.material_color;
 	return true;
@@ -1,6 +1,8 @@
 #pragma once
+#include <cstdint>
 #include "ray.h"
 #include "util.h"
+#include "texture.h"
 
 // Lights are an emitting material that can be put on any geometry
 enum material_enum {
@@ -11,14 +13,35 @@ enum material_enum {
 	CONSTANT_DENSITY_MEDIUM_MATERIAL
 };
 
+// Shading data of a surface, kept once in the material table and referred to by objects through its id
+struct material_properties {
+	material_enum material = LAMBERTIAN;
+	color material_color = color(0.5, 0.5, 0.5);
+	double metal_fuzz = 1.0;
+	double refraction_index = 1.0;
+	double inner_refraction_index = 1.0; // Refraction index of the medium filling the cavity of a hollow dielectric shell
+	texture material_texture; // Varies the material color over the surface, solid by default
+};
+
+uint32_t register_material(const material_properties& properties);
+const material_properties& get_material(uint32_t material_id);
+
 // To avoid circular dependency between material.h and geometry.h
 struct hit_record; 
 struct scene_object;
-struct camera;
 
 bool lambertian_scatter(const ray& ray_in, const hit_record& rec, color& attenuation, ray& scattered_ray, double& pdf);
 double lambertian_scatter_pdf(const ray& ray_in, const hit_record& rec, const ray& scattered_ray);
+double ggx_alpha(double metal_fuzz);
+bool metal_is_specular(double metal_fuzz);
+double ggx_distribution(double cos_h, double alpha);
+double ggx_smith_g1(double cosine, double alpha);
+color metallic_fresnel(const color& f0, double cosine);
+glm::dvec3 sample_ggx_visible_normal(const glm::dvec3& view, double alpha);
 bool metallic_reflection(const ray& ray_in, const hit_record& rec, color& attenuation, ray& reflected_ray, double metallic_fuzz);
+color metallic_brdf_cosine(const hit_record& rec, const glm::dvec3& view, const glm::dvec3& scattered_direction, double metallic_fuzz);
+double metallic_reflection_pdf(const hit_record& rec, const glm::dvec3& view, const glm::dvec3& scattered_direction, double metallic_fuzz);
 double reflectance(double cosine, double ref_idx);
 bool dielectric_refraction(const ray& ray_in, const hit_record& rec, color& attenuation, ray& reflected_ray, double refraction_index);
-bool constant_density_medium_scatter(const hit_record& rec, color& attenuation, ray& ray_out, const camera& camera);
\ No newline at end of file
+bool dielectric_split(const ray& ray_in, const hit_record& rec, ray& reflected_ray, ray& refracted_ray, double& reflected_weight, double refraction_index);
+bool constant_density_medium_scatter(const hit_record& rec, color& attenuation, ray& ray_out);
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include <vector>
+#include <future>
+#include <mutex>
+#include <algorithm>
+#include "path_guiding.h"
+#include "geometry.h"
+#include "geometry_util.h"
+#include "material.h"
+#include "camera.h"
+#include "color.h"
+#include "util.h"
+#include "glm.hpp"
+#include "fast_math.h"
+
+// Online path guiding with a spatial-directional tree
+// Lambertian hits record the radiance arriving from the sampled direction into a directional quadtree of the octree leaf they fall in
+// After each training pass the recorded quadtrees become the sampling distributions, quadrants holding much energy are split and busy octree leaves are split
+// Lambertian scattering then picks between the learned distribution and cosine sampling with a selection probability learned per leaf
+
+const int max_quadtree_depth = 20;
+const int max_spatial_depth = 16;
+
+// Equal-area mapping so the density over the unit square is proportional to the density over the sphere
+void direction_to_square(const glm::dvec3& direction, double& x, double& y) {
+	x = glm::clamp(0.5 * (direction.z + 1.0), 0.0, 1.0);
+	double phi = std::atan2(direction.y, direction.x);
+	y = (phi < 0.0 ? phi + 2.0 * pi : phi) / (2.0 * pi);
+	y = glm::clamp(y, 0.0, 1.0);
+}
+
+glm::dvec3 square_to_direction(double x, double y) {
+	double cos_theta = 2.0 * x - 1.0;
+	double sin_theta = glm::sqrt(glm::max(0.0, 1.0 - cos_theta * cos_theta));
+	double phi = 2.0 * pi * y;
+	double sin_phi, cos_phi;
+	fast_sincos(phi, sin_phi, cos_phi);
+	return glm::dvec3(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
+}
+
+// Quadrant of a point in the unit square, the point is moved into the unit square of the quadrant
+int descend_quadrant(double& x, double& y) {
+	int quadrant = 0;
+	if (x >= 0.5) {
+		quadrant += 1;
+		x -= 0.5;
+	}
+	if (y >= 0.5) {
+		quadrant += 2;
+		y -= 0.5;
+	}
+	x = glm::min(2.0 * x, 1.0);
+	y = glm::min(2.0 * y, 1.0);
+	return quadrant;
+}
+
+// Density over the unit square, quadrants without energy fall back to uniform density
+double quadtree_pdf(const directional_quadtree& tree, double x, double y) {
+	double density = 1.0;
+	int node_index = 0;
+
+	while (true) {
+		const quadtree_node& node = tree.nodes[node_index];
+		double total = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+		if (total <= 0.0) {
+			return density;
+		}
+
+		int quadrant = descend_quadrant(x, y);
+		density *= 4.0 * node.energy[quadrant] / total;
+
+		if (node.children[quadrant] == 0) {
+			return density;
+		}
+		node_index = node.children[quadrant];
+	}
+}
+
+// Pick quadrants in proportion to their energy down to a leaf quadrant, then a uniform point within it
+void sample_quadtree(const directional_quadtree& tree, double& x, double& y) {
+	double origin_x = 0.0;
+	double origin_y = 0.0;
+	double size = 1.0;
+	int node_index = 0;
+
+	while (true) {
+		const quadtree_node& node = tree.nodes[node_index];
+		double total = node.energy[0] + node.energy[1] + node.energy[2] + node.energy[3];
+
+		int quadrant = 0;
+		if (total <= 0.0) {
+			quadrant = std::min(static_cast<int>(random_double() * 4.0), 3);
+		}
+		else {
+			double threshold = random_double() * total;
+			for (int q = 0; q < 4; q++) {
+				if (node.energy[q] <= 0.0) {
+					continue;
+				}
+				quadrant = q; // Falls back to the last quadrant with energy on round-off
+				threshold -= node.energy[q];
+				if (threshold < 0.0) {
+					break;
+				}
+			}
+		}
+
+		size *= 0.5;
+		origin_x += (quadrant & 1) ? size : 0.0;
+		origin_y += (quadrant & 2) ? size : 0.0;
+
+		if (total <= 0.0 || node.children[quadrant] == 0) {
+			break;
+		}
+		node_index = node.children[quadrant];
+	}
+
+	x = origin_x + random_double() * size;
+	y = origin_y + random_double() * size;
+}
+
+// Add the value to every quadrant on the way down, so each quadrant holds the energy of its whole subtree
+void record_quadtree(directional_quadtree& tree, double x, double y, double value) {
+	int node_index = 0;
+	while (true) {
+		int quadrant = descend_quadrant(x, y);
+		tree.nodes[node_index].energy[quadrant] += value;
+
+		if (tree.nodes[node_index].children[quadrant] == 0) {
+			return;
+		}
+		node_index = tree.nodes[node_index].children[quadrant];
+	}
+}
+
+void refine_quadtree_node(const directional_quadtree& tree, int node_index, double total, double threshold, int depth, directional_quadtree& refined, int refined_index) {
+	for (int quadrant = 0; quadrant < 4; quadrant++) {
+		double fraction = (total > 0.0) ? tree.nodes[node_index].energy[quadrant] / total : 0.0;
+		if (fraction <= threshold || depth >= max_quadtree_depth) {
+			continue;
+		}
+
+		// Quadrants with a large share of the energy get children, existing children are refined further
+		int child_index = static_cast<int>(refined.nodes.size());
+		refined.nodes.push_back(quadtree_node());
+		refined.nodes[refined_index].children[quadrant] = child_index;
+
+		int existing_child = tree.nodes[node_index].children[quadrant];
+		if (existing_child != 0) {
+			refine_quadtree_node(tree, existing_child, total, threshold, depth + 1, refined, child_index);
+		}
+	}
+}
+
+// New empty structure for recording, subdivided where the recorded energy is concentrated and collapsed elsewhere
+directional_quadtree refine_quadtree(const directional_quadtree& tree, double threshold) {
+	const quadtree_node& root = tree.nodes[0];
+	double total = root.energy[0] + root.energy[1] + root.energy[2] + root.energy[3];
+
+	directional_quadtree refined;
+	refine_quadtree_node(tree, 0, total, threshold, 1, refined, 0);
+	return refined;
+}
+
+// Single leaf covering the scene bounds
+void initialize_path_guide(path_guide& guide, const std::vector<scene_object>& scene_objects) {
+	spatial_node root;
+	calculate_scene_bounds(scene_objects, root.lower, root.upper);
+	if (root.lower.x > root.upper.x) {
+		root.lower = point3(-1.0, -1.0, -1.0);
+		root.upper = point3(1.0, 1.0, 1.0);
+	}
+	root.leaf = 0;
+
+	guide.nodes.assign(1, root);
+	guide.leaves.assign(1, guiding_leaf());
+}
+
+int octant(const spatial_node& node, const point3& point) {
+	point3 center = 0.5 * (node.lower + node.upper);
+	return ((point.x >= center.x) ? 1 : 0) + ((point.y >= center.y) ? 2 : 0) + ((point.z >= center.z) ? 4 : 0);
+}
+
+// Points outside the bounds land in the nearest leaf
+int find_guiding_leaf(const path_guide& guide, const point3& point) {
+	int node_index = 0;
+	while (guide.nodes[node_index].children[0] != 0) {
+		node_index = guide.nodes[node_index].children[octant(guide.nodes[node_index], point)];
+	}
+	return guide.nodes[node_index].leaf;
+}
+
+void record_guiding_samples(path_guide& guide, const std::vector<guiding_record>& records) {
+	std::lock_guard<std::mutex> lock(guide.mutex);
+
+	for (const guiding_record& record : records) {
+		guiding_leaf& leaf = guide.leaves[find_guiding_leaf(guide, record.position)];
+
+		double x, y;
+		direction_to_square(record.direction, x, y);
+		record_quadtree(leaf.building, x, y, record.radiance);
+		leaf.recorded_samples++;
+
+		// Gradient of the KL divergence between the reflected radiance and the mixture with respect to the selection logit
+		if (record.selection_probability > 0.0) {
+			double mixture_pdf = record.selection_probability * record.guide_pdf + (1.0 - record.selection_probability) * record.bsdf_pdf;
+			double estimate = record.integrand / mixture_pdf;
+			double derivative = (record.guide_pdf - record.bsdf_pdf) * record.selection_probability * (1.0 - record.selection_probability);
+			leaf.selection_gradient -= estimate * derivative / mixture_pdf;
+			leaf.selection_normalization += estimate;
+		}
+	}
+}
+
+// End of a training pass, the recorded distributions are used for sampling and leaves with many samples are split
+void refine_path_guide(path_guide& guide, int spatial_threshold, double quadtree_threshold) {
+	for (guiding_leaf& leaf : guide.leaves) {
+		if (leaf.selection_normalization > 0.0) {
+			double learning_rate = 4.0;
+			leaf.selection_logit = glm::clamp(leaf.selection_logit - learning_rate * leaf.selection_gradient / leaf.selection_normalization, -3.0, 3.0);
+		}
+		leaf.selection_gradient = 0.0;
+		leaf.selection_normalization = 0.0;
+
+		if (leaf.recorded_samples > 0) {
+			leaf.sampling = leaf.building;
+		}
+		leaf.building = refine_quadtree(leaf.sampling, quadtree_threshold);
+	}
+
+	int nr_nodes = static_cast<int>(guide.nodes.size());
+	for (int node_index = 0; node_index < nr_nodes; node_index++) {
+		if (guide.nodes[node_index].children[0] != 0) {
+			continue;
+		}
+
+		int leaf_index = guide.nodes[node_index].leaf;
+		if (guide.leaves[leaf_index].recorded_samples <= spatial_threshold || guide.nodes[node_index].depth >= max_spatial_depth) {
+			guide.leaves[leaf_index].recorded_samples = 0;
+			continue;
+		}
+
+		// Every child starts out with the distributions of its parent
+		guide.leaves[leaf_index].recorded_samples = 0;
+		point3 lower = guide.nodes[node_index].lower;
+		point3 upper = guide.nodes[node_index].upper;
+		point3 center = 0.5 * (lower + upper);
+
+		for (int child = 0; child < 8; child++) {
+			spatial_node child_node;
+			child_node.lower = point3((child & 1) ? center.x : lower.x, (child & 2) ? center.y : lower.y, (child & 4) ? center.z : lower.z);
+			child_node.upper = point3((child & 1) ? upper.x : center.x, (child & 2) ? upper.y : center.y, (child & 4) ? upper.z : center.z);
+			child_node.leaf = (child == 0) ? leaf_index : static_cast<int>(guide.leaves.size());
+			child_node.depth = guide.nodes[node_index].depth + 1;
+
+			if (child != 0) {
+				guide.leaves.push_back(guide.leaves[leaf_index]);
+			}
+
+			guide.nodes[node_index].children[child] = static_cast<int>(guide.nodes.size());
+			guide.nodes.push_back(child_node);
+		}
+	}
+}
+
+double sigmoid(double x) {
+	return 1.0 / (1.0 + glm::exp(-x));
+}
+
+// Lambertian hit sampled from a mixture of the learned distribution and cosine sampling
+color guided_lambertian_color(const hit_record& rec, int depth, const path_guide& guide, std::vector<guiding_record>& records, const std::vector<scene_object>& scene_objects, const color& background_color, const camera& camera) {
+	const guiding_leaf& leaf = guide.leaves[find_guiding_leaf(guide, rec.point)];
+
+	// The guide is only used once its region has recorded any energy
+	const quadtree_node& root = leaf.sampling.nodes[0];
+	bool trained = root.energy[0] + root.energy[1] + root.energy[2] + root.energy[3] > 0.0;
+	double selection_probability = trained ? sigmoid(leaf.selection_logit) : 0.0;
+
+	glm::dvec3 direction;
+	if (random_double() < selection_probability) {
+		double x, y;
+		sample_quadtree(leaf.sampling, x, y);
+		direction = square_to_direction(x, y);
+	}
+	else {
+		onb onb = build_onb_from_w(rec.normal);
+		direction = local_coord(onb, random_cosine_direction());
+	}
+
+	double cosine = glm::dot(rec.normal, direction);
+	if (cosine <= 0.0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	double x, y;
+	direction_to_square(direction, x, y);
+	double guide_pdf = trained ? quadtree_pdf(leaf.sampling, x, y) / (4.0 * pi) : 0.0;
+	double bsdf_pdf = cosine / pi;
+	double mixture_pdf = selection_probability * guide_pdf + (1.0 - selection_probability) * bsdf_pdf;
+
+	ray scattered_ray = create_ray(rec.point, direction);
+	color incoming = guided_ray_color(scattered_ray, (depth - 1), guide, records, scene_objects, background_color, camera);
+	color reflected = rec.material_color * (cosine / pi) * incoming;
+
+	guiding_record record;
+	record.position = rec.point;
+	record.direction = direction;
+	record.radiance = luminance(incoming) / mixture_pdf;
+	record.integrand = luminance(reflected);
+	record.selection_probability = selection_probability;
+	record.guide_pdf = guide_pdf;
+	record.bsdf_pdf = bsdf_pdf;
+	records.push_back(record);
+
+	return reflected / mixture_pdf;
+}
+
+// Path tracing where lambertian hits sample from the guide, other materials scatter as usual
+color guided_ray_color(const ray& ray_in, int depth, const path_guide& guide, std::vector<guiding_record>& records, const std::vector<scene_object>& scene_objects, const color& background_color, const camera& camera) {
+	if (depth <= 0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	hit_record rec;
+	if (!find_intersection(ray_in, interval{ 0.001, infinity }, rec, scene_objects)) {
+		return background_radiance(camera.environment.get(), ray_in.direction, background_color);
+	}
+
+	ray scattered_ray;
+	color attenuation;
+
+	switch (rec.material) {
+		case LAMBERTIAN:
+			return guided_lambertian_color(rec, depth, guide, records, scene_objects, background_color, camera);
+		case METAL:
+			if (metallic_reflection(ray_in, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+				return attenuation * guided_ray_color(scattered_ray, (depth - 1), guide, records, scene_objects, background_color, camera);
+			}
+		break;
+		case DIELECTRIC:
+			if (dielectric_refraction(ray_in, rec, attenuation, scattered_ray, rec.refraction_index)) {
+				return attenuation * guided_ray_color(scattered_ray, (depth - 1), guide, records, scene_objects, background_color, camera);
+			}
+		break;
+		case LIGHT:
+			return rec.material_color;
+		case CONSTANT_DENSITY_MEDIUM_MATERIAL:
+			if (constant_density_medium_scatter(rec, attenuation, scattered_ray)) {
+				return attenuation * guided_ray_color(scattered_ray, (depth - 1), guide, records, scene_objects, background_color, camera);
+			}
+		break;
+		default:
+		break;
+	}
+
+	return color(0.0, 0.0, 0.0);
+}
+
+// Render a tile for one pass and record its lambertian vertices into the guide once the tile is done
+void render_tile_guided(int row_begin, int row_end, int column_begin, int column_end, int samples, path_guide& guide, bool training, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors) {
+	re_seed_random_generator(); // Re-seed each thread
+
+	std::vector<guiding_record> records;
+
+	for (int i = row_begin; i < row_end; i++) {
+		for (int j = column_begin; j < column_end; j++) {
+			for (int sample = 0; sample < samples; sample++) {
+				ray ray = get_multisample_ray(i, j, camera);
+				pixel_colors[i][j] += guided_ray_color(ray, camera.max_depth, guide, records, scene_objects, background_color, camera);
+			}
+		}
+	}
+
+	if (training) {
+		record_guiding_samples(guide, records);
+	}
+}
+
+// Training passes double their sample count each time, the remaining samples are rendered with the last learned guide
+void render_guided_passes(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors) {
+	int tile_size = (camera.tile_size < 1) ? 1 : camera.tile_size;
+
+	path_guide guide;
+	initialize_path_guide(guide, scene_objects);
+
+	int remaining_samples = camera.samples_per_pixel;
+	for (int pass = 0; remaining_samples > 0; pass++) {
+		bool training = pass < camera.guiding_training_passes;
+		int samples = training ? std::min(1 << std::min(pass, 20), remaining_samples) : remaining_samples;
+		remaining_samples -= samples;
+
+		std::vector<std::future<void>> futures;
+		for (int i = 0; i < camera.image_height; i += tile_size) {
+			for (int j = 0; j < camera.image_width; j += tile_size) {
+				int row_end = std::min(i + tile_size, camera.image_height);
+				int column_end = std::min(j + tile_size, camera.image_width);
+				futures.emplace_back(std::async(std::launch::async, [=, &guide, &camera, &scene_objects, &pixel_colors]() {
+					render_tile_guided(i, row_end, j, column_end, samples, guide, training, camera, scene_objects, background_color, pixel_colors);
+				}));
+			}
+		}
+
+		for (std::future<void>& future : futures) {
+			future.wait();
+		}
+
+		if (training) {
+			refine_path_guide(guide, camera.guiding_spatial_threshold, camera.guiding_quadtree_threshold);
+		}
+
+		std::cout << "\rGuiding pass " << pass << ": " << samples << " samples per pixel, " << guide.leaves.size() << " spatial leaves " << std::flush;
+	}
+}
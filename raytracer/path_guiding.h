@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include "util.h"
+#include "geometry.h"
+#include "camera.h"
+
+// Node of a directional quadtree over the equal-area cylindrical mapping of the sphere of directions to the unit square
+struct quadtree_node {
+	double energy[4] = { 0.0, 0.0, 0.0, 0.0 }; // Radiance recorded in each quadrant
+	int children[4] = { 0, 0, 0, 0 }; // Node index of each quadrant, 0 marks a leaf quadrant since the root is never a child
+};
+
+struct directional_quadtree {
+	std::vector<quadtree_node> nodes = std::vector<quadtree_node>(1);
+};
+
+// Leaf of the spatial octree, guides sampling in its region while learning the distribution for the next pass
+struct guiding_leaf {
+	directional_quadtree sampling; // Distribution learned in the previous pass
+	directional_quadtree building; // Distribution recorded in the current pass
+	int recorded_samples = 0;
+	double selection_logit = 0.0; // Logit of the probability to sample the guide instead of the bsdf
+	double selection_gradient = 0.0; // Accumulated gradient of the selection logit
+	double selection_normalization = 0.0; // Accumulated estimates used to normalize the gradient
+};
+
+struct spatial_node {
+	point3 lower;
+	point3 upper;
+	int children[8] = { 0, 0, 0, 0, 0, 0, 0, 0 }; // 0 marks a leaf node since the root is never a child
+	int leaf = 0; // Index of the guiding leaf of a leaf node
+	int depth = 0;
+};
+
+// Spatial-directional tree, an octree of directional quadtrees
+struct path_guide {
+	std::vector<spatial_node> nodes;
+	std::vector<guiding_leaf> leaves;
+	std::mutex mutex; // Guards recording into the building distributions
+};
+
+// A lambertian path vertex kept until its tile is done, then recorded into the guide
+struct guiding_record {
+	point3 position;
+	glm::dvec3 direction;
+	double radiance; // Luminance of the incident radiance divided by the mixture pdf
+	double integrand; // Luminance of the reflected radiance estimate
+	double selection_probability;
+	double guide_pdf;
+	double bsdf_pdf;
+};
+
+void direction_to_square(const glm::dvec3& direction, double& x, double& y);
+glm::dvec3 square_to_direction(double x, double y);
+
+double quadtree_pdf(const directional_quadtree& tree, double x, double y);
+void sample_quadtree(const directional_quadtree& tree, double& x, double& y);
+void record_quadtree(directional_quadtree& tree, double x, double y, double value);
+directional_quadtree refine_quadtree(const directional_quadtree& tree, double threshold);
+
+void initialize_path_guide(path_guide& guide, const std::vector<scene_object>& scene_objects);
+int find_guiding_leaf(const path_guide& guide, const point3& point);
+void record_guiding_samples(path_guide& guide, const std::vector<guiding_record>& records);
+void refine_path_guide(path_guide& guide, int spatial_threshold, double quadtree_threshold);
+
+color guided_ray_color(const ray& ray_in, int depth, const path_guide& guide, std::vector<guiding_record>& records, const std::vector<scene_object>& scene_objects, const color& background_color, const camera& camera);
+void render_guided_passes(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, std::vector<std::vector<color>>& pixel_colors);
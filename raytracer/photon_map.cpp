@@ -0,0 +1,312 @@
+#include <vector>
+#include <future>
+#include <thread>
+#include <algorithm>
+#include "photon_map.h"
+#include "direct_lighting.h"
+#include "geometry.h"
+#include "geometry_util.h"
+#include "material.h"
+#include "camera.h"
+#include "color.h"
+#include "util.h"
+#include "glm.hpp"
+
+// Progressive photon mapping for caustics
+// Photons are shot from the lights and only stored where they land on a lambertian surface after passing through glass or metal
+// Camera paths look the caustic up in the photon map at their first lambertian hit and drop paths that find a light through glass by chance instead
+// Every pass traces a new photon map and shrinks the gather radius, so the bias of the density estimate vanishes as passes are added
+
+// Extent of the scene, used to derive a default gather radius
+double scene_bounds_diagonal(const std::vector<scene_object>& scene_objects) {
+	point3 lower, upper;
+	calculate_scene_bounds(scene_objects, lower, upper);
+	return (lower.x > upper.x) ? 1.0 : glm::distance(lower, upper);
+}
+
+// Radius reduction of probabilistic progressive photon mapping, alpha is the fraction of photons kept from pass to pass
+double shrink_photon_radius(double radius, int pass, double alpha) {
+	return radius * glm::sqrt((static_cast<double>(pass) + alpha) / (static_cast<double>(pass) + 1.0));
+}
+
+// Trace photons from the lights, lights are picked in proportion to their power so all photons carry similar power
+std::vector<photon> trace_photons(const std::vector<scene_object>& light_objects, const std::vector<scene_object>& scene_objects, int nr_photons, int total_photons, int max_depth) {
+	re_seed_random_generator(); // Re-seed each thread
+
+	std::vector<photon> photons;
+	light_distribution distribution = build_light_distribution(light_objects);
+
+	if (distribution.total_weight <= 0.0) {
+		return photons;
+	}
+
+	for (int n = 0; n < nr_photons; n++) {
+		double light_probability;
+		int light_index = pick_light(distribution, light_probability);
+
+		const scene_object& light = light_objects[light_index];
+		color power = light_power(light) / (light_probability * static_cast<double>(total_photons));
+
+		// Cosine weighted emission from a uniform point on the light
+		light_sample sample = sample_light(light);
+		onb onb = build_onb_from_w(sample.normal);
+		ray photon_ray = create_ray(sample.point + 0.001 * sample.normal, local_coord(onb, random_cosine_direction()));
+
+		bool through_specular = false;
+
+		for (int depth = 0; depth < max_depth; depth++) {
+			hit_record rec;
+			if (!find_intersection(photon_ray, interval{ 0.001, infinity }, rec, scene_objects)) {
+				break;
+			}
+
+			ray scattered_ray;
+			color attenuation;
+
+			if (rec.material == DIELECTRIC) {
+				dielectric_refraction(photon_ray, rec, attenuation, scattered_ray, rec.refraction_index);
+			}
+			else if (rec.material == METAL) {
+				if (!metallic_reflection(photon_ray, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+					break;
+				}
+			}
+			else {
+				// Only caustic photons are stored, direct and diffuse indirect light is left to the path tracer
+				if (rec.material == LAMBERTIAN && through_specular) {
+					photon caustic_photon;
+					caustic_photon.position = rec.point;
+					caustic_photon.direction = glm::normalize(photon_ray.direction);
+					caustic_photon.normal = rec.normal;
+					caustic_photon.power = power;
+					photons.push_back(caustic_photon);
+				}
+				break;
+			}
+
+			power *= attenuation;
+			photon_ray = scattered_ray;
+			through_specular = true;
+		}
+	}
+
+	return photons;
+}
+
+// Parallel photon emission, every thread traces its share of the photons
+photon_map emit_photons(const std::vector<scene_object>& light_objects, const std::vector<scene_object>& scene_objects, int nr_photons, int max_depth) {
+	int nr_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	std::vector<std::future<std::vector<photon>>> futures;
+	for (int t = 0; t < nr_threads; t++) {
+		int thread_photons = nr_photons / nr_threads + ((t < nr_photons % nr_threads) ? 1 : 0);
+		futures.emplace_back(std::async(std::launch::async, [=, &light_objects, &scene_objects]() {
+			return trace_photons(light_objects, scene_objects, thread_photons, nr_photons, max_depth);
+		}));
+	}
+
+	photon_map map;
+	map.emitted_photons = nr_photons;
+	for (std::future<std::vector<photon>>& future : futures) {
+		std::vector<photon> photons = future.get();
+		map.photons.insert(map.photons.end(), photons.begin(), photons.end());
+	}
+
+	return map;
+}
+
+// Spatial hash of an integer grid cell
+int photon_cell_hash(int x, int y, int z, int table_size) {
+	unsigned int hash = (static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u) ^ (static_cast<unsigned int>(z) * 83492791u);
+	return static_cast<int>(hash % static_cast<unsigned int>(table_size));
+}
+
+int photon_cell_coordinate(double position, double cell_size) {
+	return static_cast<int>(glm::floor(position / cell_size));
+}
+
+// Counting sort of the photons into hash buckets sized for the current gather radius
+void build_photon_grid(photon_map& map, double radius) {
+	int nr_photons = static_cast<int>(map.photons.size());
+	int table_size = std::max(1, 2 * nr_photons);
+
+	map.cell_size = 2.0 * radius;
+	map.cell_starts.assign(table_size + 1, 0);
+	map.photon_indices.assign(nr_photons, 0);
+
+	std::vector<int> photon_cells(nr_photons);
+	for (int i = 0; i < nr_photons; i++) {
+		const point3& position = map.photons[i].position;
+		photon_cells[i] = photon_cell_hash(photon_cell_coordinate(position.x, map.cell_size), photon_cell_coordinate(position.y, map.cell_size), photon_cell_coordinate(position.z, map.cell_size), table_size);
+		map.cell_starts[photon_cells[i] + 1]++;
+	}
+
+	for (int cell = 0; cell < table_size; cell++) {
+		map.cell_starts[cell + 1] += map.cell_starts[cell];
+	}
+
+	std::vector<int> cell_fill(map.cell_starts.begin(), map.cell_starts.end() - 1);
+	for (int i = 0; i < nr_photons; i++) {
+		map.photon_indices[cell_fill[photon_cells[i]]++] = i;
+	}
+}
+
+// Density estimate of caustic radiance reflected by a lambertian hit, photons are gathered in a disc shaped kernel of the gather radius
+color estimate_caustic_radiance(const photon_map& map, const hit_record& rec, double radius) {
+	if (map.photons.empty()) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	int table_size = static_cast<int>(map.cell_starts.size()) - 1;
+	double radius_squared = radius * radius;
+	color flux = color(0.0, 0.0, 0.0);
+
+	int x_begin = photon_cell_coordinate(rec.point.x - radius, map.cell_size), x_end = photon_cell_coordinate(rec.point.x + radius, map.cell_size);
+	int y_begin = photon_cell_coordinate(rec.point.y - radius, map.cell_size), y_end = photon_cell_coordinate(rec.point.y + radius, map.cell_size);
+	int z_begin = photon_cell_coordinate(rec.point.z - radius, map.cell_size), z_end = photon_cell_coordinate(rec.point.z + radius, map.cell_size);
+
+	for (int x = x_begin; x <= x_end; x++) {
+		for (int y = y_begin; y <= y_end; y++) {
+			for (int z = z_begin; z <= z_end; z++) {
+				int cell = photon_cell_hash(x, y, z, table_size);
+				for (int k = map.cell_starts[cell]; k < map.cell_starts[cell + 1]; k++) {
+					const photon& photon = map.photons[map.photon_indices[k]];
+
+					// Photons must have landed on the same side of a similarly oriented surface
+					if (glm::dot(photon.normal, rec.normal) < 0.9 || glm::dot(photon.direction, rec.normal) >= 0.0) {
+						continue;
+					}
+
+					glm::dvec3 offset = photon.position - rec.point;
+					if (glm::dot(offset, offset) <= radius_squared) {
+						flux += photon.power;
+					}
+				}
+			}
+		}
+	}
+
+	return (rec.material_color / pi) * flux / (pi * radius_squared);
+}
+
+// Follow a ray from a lambertian hit without counting lights found through glass or metal, the photon map already holds that light
+color caustic_free_color(const ray& ray_in, int depth, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
+	ray current_ray = ray_in;
+	color throughput = color(1.0, 1.0, 1.0);
+	bool through_specular = false;
+
+	for (; depth > 0; depth--) {
+		hit_record rec;
+		if (!find_intersection(current_ray, interval{ 0.001, infinity }, rec, scene_objects)) {
+			return throughput * background_radiance(camera.environment.get(), current_ray.direction, background_color);
+		}
+
+		ray scattered_ray;
+		color attenuation;
+
+		if (rec.material == DIELECTRIC) {
+			dielectric_refraction(current_ray, rec, attenuation, scattered_ray, rec.refraction_index);
+		}
+		else if (rec.material == METAL) {
+			if (!metallic_reflection(current_ray, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+				return color(0.0, 0.0, 0.0);
+			}
+		}
+		else if (rec.material == LIGHT && through_specular) {
+			return color(0.0, 0.0, 0.0);
+		}
+		else {
+			return throughput * hit_color(current_ray, rec, depth, scene_objects, background_color, sample_objects, camera, 1);
+		}
+
+		throughput *= attenuation;
+		current_ray = scattered_ray;
+		through_specular = true;
+	}
+
+	return color(0.0, 0.0, 0.0);
+}
+
+// Camera path through glass and metal to the first lambertian hit, where the caustic is looked up in the photon map and the rest is path traced
+color photon_mapped_ray_color(const ray& ray_in, int depth, const photon_map& map, double radius, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera) {
+	if (depth <= 0) {
+		return color(0.0, 0.0, 0.0);
+	}
+
+	hit_record rec;
+	if (!find_intersection(ray_in, interval{ 0.001, infinity }, rec, scene_objects)) {
+		return background_radiance(camera.environment.get(), ray_in.direction, background_color);
+	}
+
+	ray scattered_ray;
+	color attenuation;
+	double pdf;
+
+	switch (rec.material) {
+		case DIELECTRIC:
+			dielectric_refraction(ray_in, rec, attenuation, scattered_ray, rec.refraction_index);
+			return attenuation * photon_mapped_ray_color(scattered_ray, (depth - 1), map, radius, scene_objects, background_color, sample_objects, camera);
+		case METAL:
+			if (metallic_reflection(ray_in, rec, attenuation, scattered_ray, rec.metal_fuzz)) {
+				return attenuation * photon_mapped_ray_color(scattered_ray, (depth - 1), map, radius, scene_objects, background_color, sample_objects, camera);
+			}
+			return color(0.0, 0.0, 0.0);
+		case LAMBERTIAN: {
+			color caustic = estimate_caustic_radiance(map, rec, radius);
+			if (!lambertian_scatter(ray_in, rec, attenuation, scattered_ray, pdf) || pdf <= 0.0) {
+				return caustic;
+			}
+			return caustic + attenuation * lambertian_scatter_pdf(ray_in, rec, scattered_ray) *
+				caustic_free_color(scattered_ray, (depth - 1), scene_objects, background_color, sample_objects, camera) / pdf;
+		}
+		default:
+			return hit_color(ray_in, rec, depth, scene_objects, background_color, sample_objects, camera, 1);
+	}
+}
+
+// Render one pass of a tile against the photon map of that pass
+void render_tile_photon_mapped(int row_begin, int row_end, int column_begin, int column_end, int samples, const photon_map& map, double radius, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, std::vector<std::vector<color>>& pixel_colors) {
+	re_seed_random_generator(); // Re-seed each thread
+
+	for (int i = row_begin; i < row_end; i++) {
+		for (int j = column_begin; j < column_end; j++) {
+			for (int sample = 0; sample < samples; sample++) {
+				ray ray = get_multisample_ray(i, j, camera);
+				pixel_colors[i][j] += photon_mapped_ray_color(ray, camera.max_depth, map, radius, scene_objects, background_color, sample_objects, camera);
+			}
+		}
+	}
+}
+
+// Render all photon passes, samples per pixel are divided between the passes and the gather radius shrinks after each of them
+void render_photon_passes(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const std::vector<scene_object>& light_objects, std::vector<std::vector<color>>& pixel_colors) {
+	int nr_passes = glm::clamp(camera.photon_passes, 1, std::max(1, camera.samples_per_pixel));
+	int tile_size = (camera.tile_size < 1) ? 1 : camera.tile_size;
+	double radius = (camera.photon_radius > 0.0) ? camera.photon_radius : 0.005 * scene_bounds_diagonal(scene_objects);
+
+	for (int pass = 0; pass < nr_passes; pass++) {
+		photon_map map = emit_photons(light_objects, scene_objects, camera.photons_per_pass, camera.max_depth);
+		build_photon_grid(map, radius);
+
+		int samples = camera.samples_per_pixel / nr_passes + ((pass < camera.samples_per_pixel % nr_passes) ? 1 : 0);
+
+		std::vector<std::future<void>> futures;
+		for (int i = 0; i < camera.image_height; i += tile_size) {
+			for (int j = 0; j < camera.image_width; j += tile_size) {
+				int row_end = std::min(i + tile_size, camera.image_height);
+				int column_end = std::min(j + tile_size, camera.image_width);
+				futures.emplace_back(std::async(std::launch::async, [=, &map, &camera, &scene_objects, &sample_objects, &pixel_colors]() {
+					render_tile_photon_mapped(i, row_end, j, column_end, samples, map, radius, camera, scene_objects, background_color, sample_objects, pixel_colors);
+				}));
+			}
+		}
+
+		for (std::future<void>& future : futures) {
+			future.wait();
+		}
+
+		std::cout << "\rPhoton passes remaining: " << (nr_passes - 1 - pass) << " (" << map.photons.size() << " caustic photons, radius " << radius << ") " << std::flush;
+
+		radius = shrink_photon_radius(radius, pass + 1, camera.photon_radius_alpha);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "util.h"
+#include "geometry.h"
+#include "camera.h"
+
+// A photon that reached a lambertian surface through at least one dielectric or metal bounce
+struct photon {
+	point3 position;
+	glm::dvec3 direction; // Direction of travel when the photon landed
+	glm::dvec3 normal; // Surface normal facing the side the photon landed on
+	color power;
+};
+
+// Caustic photons stored in a hash grid, cells are as wide as the gather diameter so a lookup touches at most 2x2x2 cells
+struct photon_map {
+	std::vector<photon> photons;
+	std::vector<int> cell_starts; // Offset into photon_indices for each hash bucket, one extra entry at the end
+	std::vector<int> photon_indices; // Photon indices sorted by hash bucket
+	double cell_size = 1.0;
+	int emitted_photons = 0;
+};
+
+double scene_bounds_diagonal(const std::vector<scene_object>& scene_objects);
+double shrink_photon_radius(double radius, int pass, double alpha);
+
+photon_map emit_photons(const std::vector<scene_object>& light_objects, const std::vector<scene_object>& scene_objects, int nr_photons, int max_depth);
+void build_photon_grid(photon_map& map, double radius);
+color estimate_caustic_radiance(const photon_map& map, const hit_record& rec, double radius);
+
+color photon_mapped_ray_color(const ray& ray_in, int depth, const photon_map& map, double radius, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const camera& camera);
+void render_tile_photon_mapped(int row_begin, int row_end, int column_begin, int column_end, int samples, const photon_map& map, double radius, const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, std::vector<std::vector<color>>& pixel_colors);
+void render_photon_passes(const camera& camera, const std::vector<scene_object>& scene_objects, const color& background_color, const std::vector<scene_object>& sample_objects, const std::vector<scene_object>& light_objects, std::vector<std::vector<color>>& pixel_colors);
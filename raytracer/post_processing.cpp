@@ -1,61 +1,171 @@
 #include <vector>
+#include <algorithm>
+#include "post_processing.h"
 #include "util.h"
 #include "glm.hpp"
-#include "camera.h"
 
-// Gaussian filtering through convolution with a gaussian kernel
-// Kernel size affects area that is averaged, sigma affects "sharpness" of gaussian curve, low sigma: sharp curve, high sigma: rounder curve
-std::vector<std::vector<color>> gaussian_filter(const std::vector<std::vector<color>>& pixel_colors, int kernel_size, double sigma, const camera& camera) {
-	int zero_padding = (kernel_size - 1) / 2; // If kernel size is 3, then kernel is 3 x 3
-
-	// Create zero-padded matrix to use for convolution
-	std::vector<std::vector<color>> zero_padded_pixel_colors(camera.image_height + zero_padding, std::vector<color>(camera.image_width + zero_padding, color(0.0, 0.0, 0.0)));
+// Sampled gaussian out to three standard deviations on each side, 2 * radius + 1 taps
+std::vector<double> gaussian_kernel(double sigma) {
+	int radius = std::max(1, static_cast<int>(glm::ceil(3.0 * sigma)));
+	std::vector<double> kernel(2 * radius + 1);
+	for (int k = -radius; k <= radius; k++) {
+		kernel[k + radius] = glm::exp(-static_cast<double>(k * k) / (2.0 * sigma * sigma));
+	}
+	return kernel;
+}
 
-	// Copy values to zero-padded matrix
-	for (int i = 0 + zero_padding; i < camera.image_height - zero_padding; i++) {
-		for (int j = 0 + zero_padding; j < camera.image_width - zero_padding; j++) {
-			const color& pixel_color = pixel_colors[i - zero_padding][j - zero_padding]; 
-			zero_padded_pixel_colors[i][j] = pixel_color; 
+// Reciprocal weight of the taps that land inside the image at each position, taps outside are dropped instead of reading padding
+std::vector<double> border_normalization(const std::vector<double>& kernel, int size) {
+	int radius = kernel.size() / 2;
+	std::vector<double> normalization(size);
+	for (int position = 0; position < size; position++) {
+		double weight = 0.0;
+		for (int k = std::max(0, radius - position); k < std::min(static_cast<int>(kernel.size()), size + radius - position); k++) {
+			weight += kernel[k];
 		}
+		normalization[position] = 1.0 / weight;
+	}
+	return normalization;
+}
+
+// Separable gaussian filter in place on a flat row by row image, a horizontal pass into a scratch image and a vertical pass back
+// O(radius) work per pixel instead of O(radius^2), both passes run in parallel over rows
+// Each tap is a multiply-add over a whole row of interleaved channels, contiguous loops the compiler vectorizes
+void gaussian_filter(std::vector<color>& pixels, int width, int height, double sigma) {
+	if (sigma <= 0.0 || width <= 0 || height <= 0) {
+		return;
 	}
 
-	double sum = 0.0;
+	std::vector<double> kernel = gaussian_kernel(sigma);
+	int radius = kernel.size() / 2;
+	int nr_taps = kernel.size();
+	int row_length = 3 * width; // Channels of a row, colors are three packed doubles
+	std::vector<double> horizontal_normalization = border_normalization(kernel, width);
+	std::vector<double> vertical_normalization = border_normalization(kernel, height);
+	std::vector<color> horizontal(pixels.size());
+
+	// Rows are copied into a buffer with radius pixels of zeros on each side, the zeros are taken out again by the normalization
+	parallel_for_rows(height, [&](int row) {
+		std::vector<double> padded(3 * (width + 2 * radius), 0.0);
+		const double* source = &pixels[static_cast<size_t>(row) * width].x;
+		std::copy(source, source + row_length, padded.begin() + 3 * radius);
 
-	// Create gaussian filter kernel
-	std::vector<std::vector<double>> gaussian_kernel(kernel_size, std::vector<double>(kernel_size, 0.0));
-	for (int i = 0; i < kernel_size; i++) {
-		for (int j = 0; j < kernel_size; j++) {
-			double gaussian_value = (1.0 / 2.0 * pi * (sigma * sigma)) * glm::exp(-static_cast<double>((i * i) + (j * j)) / 2.0 * (sigma * sigma));
-			gaussian_kernel[i][j] = gaussian_value;
-			sum += gaussian_value;
+		double* destination = &horizontal[static_cast<size_t>(row) * width].x;
+		std::fill(destination, destination + row_length, 0.0);
+		for (int k = 0; k < nr_taps; k++) {
+			const double weight = kernel[k];
+			const double* shifted = padded.data() + 3 * k;
+			for (int channel = 0; channel < row_length; channel++) {
+				destination[channel] += weight * shifted[channel];
+			}
 		}
-	}
+		for (int column = 0; column < width; column++) {
+			horizontal[static_cast<size_t>(row) * width + column] *= horizontal_normalization[column];
+		}
+	});
 
-	// Average kernel
-	for (int i = 0; i < kernel_size; i++) {
-		for (int j = 0; j < kernel_size; j++) {
-			gaussian_kernel[i][j] /= sum;
+	parallel_for_rows(height, [&](int row) {
+		double* destination = &pixels[static_cast<size_t>(row) * width].x;
+		std::fill(destination, destination + row_length, 0.0);
+		for (int k = std::max(0, radius - row); k < std::min(nr_taps, height + radius - row); k++) {
+			const double weight = kernel[k];
+			const double* source = &horizontal[static_cast<size_t>(row + k - radius) * width].x;
+			for (int channel = 0; channel < row_length; channel++) {
+				destination[channel] += weight * source[channel];
+			}
 		}
+		const double normalization = vertical_normalization[row];
+		for (int channel = 0; channel < row_length; channel++) {
+			destination[channel] *= normalization;
+		}
+	});
+}
+
+// Albedo the radiance of a pixel is divided by before filtering, channels too dark to divide by are left as they are
+color demodulation_albedo(const color& albedo) {
+	return color(albedo.x > 0.01 ? albedo.x : 1.0, albedo.y > 0.01 ? albedo.y : 1.0, albedo.z > 0.01 ? albedo.z : 1.0);
+}
+
+// Edge-avoiding a-trous wavelet denoiser (Dammertz et al. 2010) in place on a flat row by row image, guided by the normal, albedo and depth aovs
+// The radiance is divided by the first hit albedo, so texture detail skips the filter and only the noisy lighting is smoothed
+// Every iteration applies the 5x5 B3 spline kernel with its taps 2^iteration pixels apart, which widens the filter without adding taps
+// Taps are weighted down by differences in irradiance, normal, depth and albedo, so the filter stops at the edges of the geometry
+// Scale converts the pixel sums to radiance, so the color tolerance doesn't depend on the samples per pixel
+void atrous_denoise(std::vector<color>& pixels, const aov_buffers& guides, const denoise_parameters& parameters, double scale) {
+	if (parameters.iterations <= 0 || guides.normals.size() != pixels.size() || guides.albedos.size() != pixels.size() || guides.depths.size() != pixels.size()) {
+		return;
 	}
 
-	std::vector<std::vector<color>> result_matrix(camera.image_height, std::vector<color>(camera.image_width, color(0.0, 0.0, 0.0)));
+	const double spline[5] = { 1.0 / 16.0, 1.0 / 4.0, 3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0 };
+	int width = guides.width;
+	int height = guides.height;
+
+	std::vector<color> irradiance(pixels.size());
+	for (size_t pixel = 0; pixel < pixels.size(); pixel++) {
+		irradiance[pixel] = pixels[pixel] * scale / demodulation_albedo(guides.albedos[pixel]);
+	}
+	std::vector<color> filtered(pixels.size());
+
+	double color_sigma = parameters.color_sigma;
+	for (int iteration = 0; iteration < parameters.iterations; iteration++) {
+		int step = 1 << iteration;
+		double color_falloff = 1.0 / (color_sigma * color_sigma);
+		double albedo_falloff = 1.0 / (parameters.albedo_sigma * parameters.albedo_sigma);
+
+		parallel_for_rows(height, [&](int row) {
+			for (int column = 0; column < width; column++) {
+				size_t center = static_cast<size_t>(row) * width + column;
+				const color& center_color = irradiance[center];
+				const glm::dvec3& center_normal = guides.normals[center];
+				const color& center_albedo = guides.albedos[center];
+				double center_depth = guides.depths[center];
+				bool center_missed = (center_normal == glm::dvec3(0.0, 0.0, 0.0));
 
-	// Apply filter
-	for (int i = 0 + zero_padding; i < camera.image_height - zero_padding; i++) {
-		for (int j = 0 + zero_padding; j < camera.image_width - zero_padding; j++) {
+				color sum = color(0.0, 0.0, 0.0);
+				double weight_sum = 0.0;
+				for (int dy = -2; dy <= 2; dy++) {
+					int y = row + dy * step;
+					if (y < 0 || y >= height) {
+						continue;
+					}
+					for (int dx = -2; dx <= 2; dx++) {
+						int x = column + dx * step;
+						if (x < 0 || x >= width) {
+							continue;
+						}
+						size_t tap = static_cast<size_t>(y) * width + x;
 
-			color filtered_value = color(0.0, 0.0, 0.0);
+						// Pixels that missed the scene only blend with each other
+						const glm::dvec3& tap_normal = guides.normals[tap];
+						bool tap_missed = (tap_normal == glm::dvec3(0.0, 0.0, 0.0));
+						if (center_missed != tap_missed) {
+							continue;
+						}
 
-			for (int x = 0; x < kernel_size; x++) {
-				for (int y = 0; y < kernel_size; y++) {
-					filtered_value += zero_padded_pixel_colors[i + x - zero_padding][j + y - zero_padding] * gaussian_kernel[x][y];
+						glm::dvec3 color_difference = irradiance[tap] - center_color;
+						glm::dvec3 albedo_difference = guides.albedos[tap] - center_albedo;
+						double weight = spline[dy + 2] * spline[dx + 2] * glm::exp(-glm::dot(color_difference, color_difference) * color_falloff - glm::dot(albedo_difference, albedo_difference) * albedo_falloff);
+						if (!center_missed) {
+							weight *= glm::pow(glm::max(0.0, glm::dot(center_normal, tap_normal)), parameters.normal_power);
+
+							// Depth changes linearly across a slanted surface, so the tolerance grows with the tap spacing
+							double depth_difference = glm::abs(guides.depths[tap] - center_depth);
+							weight *= glm::exp(-depth_difference / (parameters.depth_sigma * glm::max(center_depth, guides.depths[tap]) * step));
+						}
+
+						sum += weight * irradiance[tap];
+						weight_sum += weight;
+					}
 				}
+				filtered[center] = (weight_sum > 0.0) ? sum / weight_sum : center_color; // The center tap always has a weight, unless it underflows
 			}
+		});
 
-			result_matrix[i][j] = filtered_value;
-
-		}
+		irradiance.swap(filtered);
+		color_sigma *= 0.5;
 	}
 
-	return result_matrix;
-}
\ No newline at end of file
+	for (size_t pixel = 0; pixel < pixels.size(); pixel++) {
+		pixels[pixel] = irradiance[pixel] * demodulation_albedo(guides.albedos[pixel]) / scale;
+	}
+}
@@ -1,5 +1,18 @@
 #pragma once
-#include<vector>
+#include <vector>
 #include "util.h"
-#include "camera.h"
-std::vector<std::vector<color>> gaussian_filter(const std::vector<std::vector<color>>& pixel_colors, int kernel_size, double sigma, const camera& camera);
\ No newline at end of file
+#include "aov.h"
+
+// Edge-stopping strengths of the a-trous denoiser
+struct denoise_parameters {
+	int iterations = 0; // Wavelet levels, each one doubles the spacing of the 5x5 kernel taps
+	double color_sigma = 1.0; // Difference in irradiance tolerated between neighbours, halved with every iteration
+	double normal_power = 64.0; // Exponent of the normal cosine, higher keeps creases sharper
+	double depth_sigma = 0.05; // Difference in distance tolerated between neighbours, relative to the distance of the pixel
+	double albedo_sigma = 0.1; // Difference in albedo tolerated between neighbours
+};
+
+std::vector<double> gaussian_kernel(double sigma);
+void gaussian_filter(std::vector<color>& pixels, int width, int height, double sigma);
+
+void atrous_denoise(std::vector<color>& pixels, const aov_buffers& guides, const denoise_parameters& parameters, double scale);
@@ -3,6 +3,7 @@
 #include <ctime>
 #include <cstdlib>
 #include "ray.h"
+#include "fast_math.h"
 
 ray create_ray(const point3& origin, const glm::dvec3& direction) {
 	ray ray;
@@ -11,7 +12,7 @@ ray create_ray(const point3& origin, const glm::dvec3& direction) {
 	return ray;
 }
 
-const point3& ray_at(ray ray, double time) {
+point3 ray_at(ray ray, double time) {
 	return ray.origin + time * ray.direction;
 }
 
@@ -24,10 +25,9 @@ glm::dvec3 random_hemispherical_direction(const glm::dvec3& normal) {
 	double phi = random_double(0.0, 2.0 * pi); // Polar angle (0 to 2*pi)
 
 	// Convert spherical coordinates to Cartesian coordinates
-	double sin_theta = std::sin(theta);
-	double cos_theta = std::cos(theta);
-	double sin_phi = std::sin(phi);
-	double cos_phi = std::cos(phi);
+	double sin_theta, cos_theta, sin_phi, cos_phi;
+	fast_sincos(theta, sin_theta, cos_theta);
+	fast_sincos(phi, sin_phi, cos_phi);
 
 	// Calculate the direction vector
 	glm::dvec3 direction(sin_theta * cos_phi, sin_theta * sin_phi, cos_theta);
@@ -2,13 +2,22 @@
 #include "glm.hpp"
 #include "util.h"
 
-struct ray {
-	point3 origin;
-	glm::dvec3 direction;
+// Rays are templated on their scalar type, scenes are stored and shaded in double and may be searched with float rays
+template <typename scalar>
+struct basic_ray {
+	glm::tvec3<scalar> origin;
+	glm::tvec3<scalar> direction;
 };
+using ray = basic_ray<double>;
+
+// Same ray in another scalar type
+template <typename scalar, typename source_scalar>
+basic_ray<scalar> convert_ray(const basic_ray<source_scalar>& ray) {
+	return basic_ray<scalar>{ glm::tvec3<scalar>(ray.origin), glm::tvec3<scalar>(ray.direction) };
+}
 
 ray create_ray(const point3& origin_, const glm::dvec3& direction_);
-const point3& ray_at(ray ray, double time);
+point3 ray_at(ray ray, double time);
 glm::dvec3 random_hemispherical_direction(const glm::dvec3& normal);
 glm::dvec3 reflect(const glm::dvec3& vector, const glm::dvec3& normal);
 glm::dvec3 refract(const glm::dvec3& unit_vector, const glm::dvec3& normal, double etai_over_etat);
\ No newline at end of file
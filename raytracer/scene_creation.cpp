@@ -4,6 +4,7 @@
 #include "util.h"
 #include "glm.hpp"
 #include "camera.h"
+#include "scene_file.h"
 #include "scene_population.h"
 
 // This file is for creating different scenes, there exists utility functions to populate the scene with geometries
@@ -336,9 +337,119 @@ void create_scene_17(std::vector<scene_object>& scene_objects, camera& camera, c
 	add_asymmetric_cubical_constant_density_medium_to_scene(scene_objects, point3(0.0, -25.0, -100.0), 5.0, 15.0, 5.0, color(1.0, 0.4118, 0.7059), 0.015, {}, {}, 90.0);
 }
 
-// Populate scene with geometries, change which scene is rendered here
+// Jittered constant density mediums with irregular boundaries, overlapping a regular one
+void create_scene_18(std::vector<scene_object>& scene_objects, camera& camera, color& background_color) {
+	camera.aspect_ratio = 1.0;
+	camera.look_from = point3(0.0, 0.0, -1.0);
+	camera.look_at = point3(0.0, 0.0, -100.0);
+	camera.vertical_field_of_view = 90.0;
+	background_color = color(0.0, 0.0, 0.0);
+
+	// Room
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, -50.0, -150.0), point3(50.0, -50.0, -150.0), point3(-50.0, -50.0, -50.0), point3(50.0, -50.0, -50.0), color(0.73, 0.73, 0.73)); // Floor
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -150.0), point3(50.0, 50.0, -150.0), point3(-50.0, -50.0, -150.0), point3(50.0, -50.0, -150.0), color(0.73, 0.73, 0.73)); // Back wall
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -50.0), point3(50.0, 50.0, -50.0), point3(-50.0, 50.0, -150.0), point3(50.0, 50.0, -150.0), color(0.73, 0.73, 0.73)); // Ceiling
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -50.0), point3(-50.0, 50.0, -150.0), point3(-50.0, -50.0, -50.0), point3(-50.0, -50.0, -150.0), color(0.12, 0.45, 0.15)); // Right wall (green)
+	add_lambertian_quad_to_scene(scene_objects, point3(50.0, 50.0, -150.0), point3(50.0, 50.0, -50.0), point3(50.0, -50.0, -150.0), point3(50.0, -50.0, -50.0), color(0.65, 0.05, 0.05)); // Left wall (red)
+	add_quad_light_to_scene(scene_objects, point3(-15.0, 49.9, -85.0), point3(15.0, 49.9, -85.0), point3(-15.0, 49.9, -115.0), point3(15.0, 49.9, -115.0), color(15.0, 15.0, 15.0)); // Light
+
+	add_spherical_constant_density_medium_to_scene(scene_objects, point3(-20.0, 15.0, -100.0), 15.0, color(0.9, 0.9, 0.9), 0.05, 0.4);
+	add_cubical_constant_density_medium_to_scene(scene_objects, point3(20.0, 15.0, -100.0), 20.0, color(1.0, 0.4980, 0.3137), 0.05, 30.0, 30.0, 0.0, 0.3);
+	add_spherical_constant_density_medium_to_scene(scene_objects, point3(0.0, -25.0, -100.0), 20.0, color(0.2, 0.9961, 1.0), 0.04, 0.5);
+	add_spherical_constant_density_medium_to_scene(scene_objects, point3(0.0, -25.0, -100.0), 10.0, color(1.0, 0.0, 0.0), 0.02);
+}
+
+// Rough metals of increasing fuzz, lit by the ceiling light they reflect
+void create_scene_19(std::vector<scene_object>& scene_objects, camera& camera, color& background_color) {
+	camera.aspect_ratio = 1.0;
+	camera.look_from = point3(0.0, 0.0, -1.0);
+	camera.look_at = point3(0.0, 0.0, -100.0);
+	camera.vertical_field_of_view = 90.0;
+	background_color = color(0.0, 0.0, 0.0);
+
+	// Room
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, -50.0, -150.0), point3(50.0, -50.0, -150.0), point3(-50.0, -50.0, -50.0), point3(50.0, -50.0, -50.0), color(0.73, 0.73, 0.73)); // Floor
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -150.0), point3(50.0, 50.0, -150.0), point3(-50.0, -50.0, -150.0), point3(50.0, -50.0, -150.0), color(0.73, 0.73, 0.73)); // Back wall
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -50.0), point3(50.0, 50.0, -50.0), point3(-50.0, 50.0, -150.0), point3(50.0, 50.0, -150.0), color(0.73, 0.73, 0.73)); // Ceiling
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -50.0), point3(-50.0, 50.0, -150.0), point3(-50.0, -50.0, -50.0), point3(-50.0, -50.0, -150.0), color(0.12, 0.45, 0.15)); // Right wall (green)
+	add_lambertian_quad_to_scene(scene_objects, point3(50.0, 50.0, -150.0), point3(50.0, 50.0, -50.0), point3(50.0, -50.0, -150.0), point3(50.0, -50.0, -50.0), color(0.65, 0.05, 0.05)); // Left wall (red)
+	add_quad_light_to_scene(scene_objects, point3(-15.0, 49.9, -85.0), point3(15.0, 49.9, -85.0), point3(-15.0, 49.9, -115.0), point3(15.0, 49.9, -115.0), color(8.0, 8.0, 8.0)); // Light
+
+	add_metal_sphere_to_scene(scene_objects, point3(-30.0, -35.0, -100.0), 15.0, color(0.8, 0.6, 0.2), 0.1);
+	add_metal_sphere_to_scene(scene_objects, point3(0.0, -35.0, -100.0), 15.0, color(0.8, 0.6, 0.2), 0.4);
+	add_metal_sphere_to_scene(scene_objects, point3(30.0, -35.0, -100.0), 15.0, color(0.8, 0.6, 0.2), 0.7);
+	add_metal_cube_to_scene(scene_objects, point3(0.0, 10.0, -120.0), 20.0, color(0.9, 0.9, 0.9), 0.3, 30.0, 30.0, 0.0);
+}
+
+// Outdoor scene lit by an HDR environment map, environment.pfm next to the executable or a procedural sky with a sun
+void create_scene_20(std::vector<scene_object>& scene_objects, camera& camera, color& background_color) {
+	camera.aspect_ratio = 16.0 / 9.0;
+	camera.look_from = point3(0.0, 12.0, 30.0);
+	camera.look_at = point3(0.0, 5.0, -20.0);
+	camera.vertical_field_of_view = 50.0;
+	background_color = color(0.0, 0.0, 0.0);
+
+	camera.environment = load_environment_map("environment.pfm");
+	if (!camera.environment) {
+		camera.environment = create_sky_environment_map(glm::dvec3(-0.5, 0.6, -0.6), color(2000.0, 1800.0, 1500.0), color(0.25, 0.45, 0.9), color(0.8, 0.85, 0.95));
+	}
+
+	add_lambertian_quad_to_scene(scene_objects, point3(-200.0, 0.0, -200.0), point3(200.0, 0.0, -200.0), point3(-200.0, 0.0, 200.0), point3(200.0, 0.0, 200.0), color(0.6, 0.6, 0.6)); // Ground
+	add_lambertian_sphere_to_scene(scene_objects, point3(-14.0, 6.0, -20.0), 6.0, color(0.7, 0.2, 0.2));
+	add_dielectric_sphere_to_scene(scene_objects, point3(0.0, 6.0, -20.0), 6.0, 1.5);
+	add_metal_sphere_to_scene(scene_objects, point3(14.0, 6.0, -20.0), 6.0, color(0.9, 0.9, 0.9), 0.2);
+	add_lambertian_cube_to_scene(scene_objects, point3(-6.0, 3.0, -5.0), 6.0, color(0.2, 0.4, 0.7), 0.0, 30.0, 0.0);
+}
+
+// Textured objects under a procedural sky, a checker floor fading to grey in the distance, marble and an image from texture.ppm next to the executable
+void create_scene_21(std::vector<scene_object>& scene_objects, camera& camera, color& background_color) {
+	camera.aspect_ratio = 16.0 / 9.0;
+	camera.look_from = point3(0.0, 12.0, 30.0);
+	camera.look_at = point3(0.0, 5.0, -20.0);
+	camera.vertical_field_of_view = 50.0;
+	background_color = color(0.0, 0.0, 0.0);
+	camera.environment = create_sky_environment_map(glm::dvec3(-0.5, 0.6, -0.6), color(2000.0, 1800.0, 1500.0), color(0.25, 0.45, 0.9), color(0.8, 0.85, 0.95));
+
+	texture image = create_image_texture("texture.ppm");
+	if (image.texture_type == SOLID_TEXTURE) {
+		image = create_noise_texture(color(0.1, 0.2, 0.5), color(0.9, 0.8, 0.4), 0.5);
+	}
+
+	add_textured_lambertian_quad_to_scene(scene_objects, point3(-200.0, 0.0, -200.0), point3(200.0, 0.0, -200.0), point3(-200.0, 0.0, 200.0), point3(200.0, 0.0, 200.0), create_checker_texture(color(0.1, 0.1, 0.1), color(0.8, 0.8, 0.8), 100.0)); // Ground
+	add_textured_lambertian_sphere_to_scene(scene_objects, point3(-14.0, 6.0, -20.0), 6.0, create_noise_texture(color(0.2, 0.15, 0.1), color(0.9, 0.9, 0.85), 0.4));
+	add_textured_lambertian_sphere_to_scene(scene_objects, point3(0.0, 6.0, -20.0), 6.0, image);
+	add_textured_lambertian_cube_to_scene(scene_objects, point3(14.0, 6.0, -20.0), 10.0, image, 0.0, 30.0, 0.0);
+}
+
+// Nested dielectrics, a glass shell filled with water and a solid glass ball half sunk into a block of water
+// The ball has the higher priority, so the water surface inside it is skipped and the glass meets the water directly
+void create_scene_22(std::vector<scene_object>& scene_objects, camera& camera, color& background_color) {
+	camera.aspect_ratio = 1.0;
+	camera.look_from = point3(0.0, 0.0, -1.0);
+	camera.look_at = point3(0.0, 0.0, -100.0);
+	camera.vertical_field_of_view = 90.0;
+	background_color = color(0.0, 0.0, 0.0);
+
+	// Room
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, -50.0, -150.0), point3(50.0, -50.0, -150.0), point3(-50.0, -50.0, -50.0), point3(50.0, -50.0, -50.0), color(0.73, 0.73, 0.73)); // Floor
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -150.0), point3(50.0, 50.0, -150.0), point3(-50.0, -50.0, -150.0), point3(50.0, -50.0, -150.0), color(0.73, 0.73, 0.73)); // Back wall
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -50.0), point3(50.0, 50.0, -50.0), point3(-50.0, 50.0, -150.0), point3(50.0, 50.0, -150.0), color(0.73, 0.73, 0.73)); // Ceiling
+	add_lambertian_quad_to_scene(scene_objects, point3(-50.0, 50.0, -50.0), point3(-50.0, 50.0, -150.0), point3(-50.0, -50.0, -50.0), point3(-50.0, -50.0, -150.0), color(0.12, 0.45, 0.15)); // Right wall (green)
+	add_lambertian_quad_to_scene(scene_objects, point3(50.0, 50.0, -150.0), point3(50.0, 50.0, -50.0), point3(50.0, -50.0, -150.0), point3(50.0, -50.0, -50.0), color(0.65, 0.05, 0.05)); // Left wall (red)
+	add_quad_light_to_scene(scene_objects, point3(-15.0, 49.9, -85.0), point3(15.0, 49.9, -85.0), point3(-15.0, 49.9, -115.0), point3(15.0, 49.9, -115.0), color(8.0, 8.0, 8.0)); // Light
+
+	add_filled_dielectric_sphere_to_scene(scene_objects, point3(-22.0, -30.0, -100.0), 20.0, 0.9, 1.5, 1.33);
+	add_dielectric_asymmetric_cube_to_scene(scene_objects, point3(25.0, -37.5, -100.0), 40.0, 25.0, 40.0, 1.33, 0.0, 0.0, 0.0, true, 0); // Water
+	add_dielectric_sphere_to_scene(scene_objects, point3(25.0, -25.0, -100.0), 12.0, 1.5, true, 1);
+	add_lambertian_cube_to_scene(scene_objects, point3(25.0, -44.0, -100.0), 8.0, color(0.2, 0.3, 0.8), 0.0, 30.0, 0.0);
+}
+
+// Populate scene with geometries, change which scene is rendered here or set the scene file of the camera
 std::vector<scene_object> create_scene(camera& camera, color& background_color) {
 	std::vector<scene_object> scene_objects = std::vector<scene_object>();
+	if (!camera.scene_file.empty() && load_scene(camera.scene_file, scene_objects, camera, background_color)) {
+		return scene_objects;
+	}
 	create_scene_5(scene_objects, camera, background_color);
 	return scene_objects;
 }
\ No newline at end of file
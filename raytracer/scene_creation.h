@@ -22,5 +22,10 @@ void create_scene_14(std::vector<scene_object>& scene_objects, camera& camera, c
 void create_scene_15(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
 void create_scene_16(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
 void create_scene_17(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
+void create_scene_18(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
+void create_scene_19(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
+void create_scene_20(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
+void create_scene_21(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
+void create_scene_22(std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
 
 std::vector<scene_object> create_scene(camera& camera, color& background_color);
\ No newline at end of file
@@ -0,0 +1,854 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <chrono>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "scene_file.h"
+#include "geometry_rotation.h"
+#include "material.h"
+#include "volume.h"
+#include "environment.h"
+#include "checkpoint.h"
+#include "image_output.h"
+
+const char* const scene_camera_key_names[NR_SCENE_CAMERA_KEYS] = {
+	"aspect_ratio", "image_width", "samples_per_pixel", "max_depth", "vertical_field_of_view",
+	"look_from", "look_at", "camera_up", "defocus_angle", "focus_distance"
+};
+
+const char* const material_names[] = { "lambertian", "metal", "dielectric", "light", "medium" };
+
+// A word of a statement, pointing into the text of the scene file
+struct scene_token {
+	const char* begin;
+	const char* end;
+};
+
+bool token_equals(const scene_token& token, const char* word) {
+	size_t length = std::strlen(word);
+	return static_cast<size_t>(token.end - token.begin) == length && std::memcmp(token.begin, word, length) == 0;
+}
+
+// Number with an optional fraction, like 16/9 or 173/255, parsed in place
+bool parse_number(const char*& position, const char* end, double& value) {
+	char buffer[64];
+	size_t length = 0;
+	while (position + length < end && position[length] != ',' && position[length] != '/' && length < sizeof(buffer) - 1) {
+		buffer[length] = position[length];
+		length++;
+	}
+	buffer[length] = '\0';
+	char* parsed_end;
+	value = std::strtod(buffer, &parsed_end);
+	if (length == 0 || parsed_end != buffer + length) {
+		return false;
+	}
+	position += length;
+
+	if (position < end && *position == '/') {
+		position++;
+		double denominator;
+		if (!parse_number(position, end, denominator) || denominator == 0.0) {
+			return false;
+		}
+		value /= denominator;
+	}
+	return true;
+}
+
+// One or three comma separated numbers, a single number fills all three components
+bool parse_vector(const scene_token& token, double values[3]) {
+	const char* position = token.begin;
+	int count = 0;
+	while (count < 3) {
+		if (!parse_number(position, token.end, values[count])) {
+			return false;
+		}
+		count++;
+		if (position == token.end) {
+			break;
+		}
+		if (*position != ',') {
+			return false;
+		}
+		position++;
+	}
+	if (position != token.end || count == 2) {
+		return false;
+	}
+	if (count == 1) {
+		values[1] = values[0];
+		values[2] = values[0];
+	}
+	return true;
+}
+
+bool parse_scalar(const scene_token& token, double& value) {
+	const char* position = token.begin;
+	return parse_number(position, token.end, value) && position == token.end;
+}
+
+bool parse_bool(const scene_token& token, bool& value) {
+	if (token_equals(token, "true") || token_equals(token, "1")) {
+		value = true;
+		return true;
+	}
+	if (token_equals(token, "false") || token_equals(token, "0")) {
+		value = false;
+		return true;
+	}
+	return false;
+}
+
+glm::dvec3 to_vector(const double values[3]) {
+	return glm::dvec3(values[0], values[1], values[2]);
+}
+
+// Properties an object statement collects before the object is created
+struct object_statement {
+	material_properties material;
+	bool has_center = false, has_radius = false, has_size = false;
+	double center[3] = {};
+	double radius = 0.0;
+	double size[3] = {};
+	int nr_corners = 0;
+	double corners[4][3] = {}; // Top left, top right, bottom left, bottom right
+	double rotation[3] = {};
+	bool caustics = false;
+	double inner_scale = -1.0; // Negative keeps the default of the material
+	int medium_priority = 0;
+	double density = 1.0;
+	double jitter = 0.0;
+};
+
+// Material keys shared by material and object statements, false when the key is not one of them
+bool parse_material_key(const scene_token& key, const scene_token& value, material_properties& material, bool& valid) {
+	valid = true;
+	if (token_equals(key, "type")) {
+		valid = false;
+		for (int k = 0; k < 5; k++) {
+			if (token_equals(value, material_names[k])) {
+				material.material = static_cast<material_enum>(k);
+				valid = true;
+			}
+		}
+	}
+	else if (token_equals(key, "color")) {
+		double values[3];
+		valid = parse_vector(value, values);
+		material.material_color = to_vector(values);
+	}
+	else if (token_equals(key, "fuzz")) {
+		valid = parse_scalar(value, material.metal_fuzz);
+	}
+	else if (token_equals(key, "refraction_index")) {
+		valid = parse_scalar(value, material.refraction_index);
+	}
+	else if (token_equals(key, "inner_refraction_index")) {
+		valid = parse_scalar(value, material.inner_refraction_index);
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+// The object is built like the scene population functions build it, rotated before the density grid of a jittered medium
+scene_object create_statement_object(const scene_token& kind, const object_statement& statement) {
+	scene_object object;
+	if (token_equals(kind, "sphere")) {
+		object = create_sphere(to_vector(statement.center), statement.radius);
+	}
+	else if (token_equals(kind, "cube")) {
+		object = create_cube(to_vector(statement.center), statement.size[0]);
+	}
+	else if (token_equals(kind, "box")) {
+		object = create_asymmetric_cube(to_vector(statement.center), statement.size[0], statement.size[1], statement.size[2]);
+	}
+	else {
+		object = create_quad(to_vector(statement.corners[0]), to_vector(statement.corners[1]), to_vector(statement.corners[2]), to_vector(statement.corners[3]));
+	}
+	set_object_material(object, statement.material);
+
+	if (statement.material.material == DIELECTRIC) {
+		object.shell_inner_scale = (statement.inner_scale >= 0.0) ? statement.inner_scale : (statement.caustics ? 0.0 : 0.95);
+	}
+	object.medium_priority = statement.medium_priority;
+	if (statement.material.material == CONSTANT_DENSITY_MEDIUM_MATERIAL) {
+		object.constant_density_medium = true;
+		object.density = statement.density;
+	}
+	if (object.object_type != SPHERE) {
+		rotate_polygon(object, statement.rotation[0], statement.rotation[1], statement.rotation[2]);
+	}
+	if (object.constant_density_medium && statement.jitter > 0.0) {
+		object.medium_grid = create_jittered_density_grid(object, statement.jitter);
+	}
+	return object;
+}
+
+// Statements are parsed straight from the text, each line split into words and key=value pairs without copying them
+bool parse_scene(const char* text, size_t size, const std::string& path, scene_settings& settings, std::vector<scene_object>& scene_objects) {
+	std::map<std::string, material_properties> materials;
+	const char* end = text + size;
+	const char* line_begin = text;
+	int line_number = 0;
+	std::vector<scene_token> tokens;
+
+	while (line_begin < end) {
+		line_number++;
+		const char* line_end = static_cast<const char*>(std::memchr(line_begin, '\n', end - line_begin));
+		line_end = line_end ? line_end : end;
+		const char* comment = static_cast<const char*>(std::memchr(line_begin, '#', line_end - line_begin));
+		const char* content_end = comment ? comment : line_end;
+
+		tokens.clear();
+		for (const char* position = line_begin; position < content_end;) {
+			while (position < content_end && std::isspace(static_cast<unsigned char>(*position))) {
+				position++;
+			}
+			const char* word_begin = position;
+			while (position < content_end && !std::isspace(static_cast<unsigned char>(*position))) {
+				position++;
+			}
+			if (position > word_begin) {
+				tokens.push_back({ word_begin, position });
+			}
+		}
+		line_begin = line_end + 1;
+		if (tokens.empty()) {
+			continue;
+		}
+
+		auto fail = [&](const std::string& message) {
+			std::cerr << path << ":" << line_number << ": " << message << std::endl;
+			return false;
+		};
+
+		const scene_token& kind = tokens[0];
+		bool is_material = token_equals(kind, "material");
+		bool is_object = token_equals(kind, "sphere") || token_equals(kind, "cube") || token_equals(kind, "box") || token_equals(kind, "quad");
+		if (!is_material && !is_object && !token_equals(kind, "camera") && !token_equals(kind, "background") && !token_equals(kind, "environment") && !token_equals(kind, "sky")) {
+			return fail("unknown statement " + std::string(kind.begin, kind.end));
+		}
+		size_t first_pair = 1;
+		std::string material_name;
+		if (is_material) {
+			if (tokens.size() < 2 || std::memchr(tokens[1].begin, '=', tokens[1].end - tokens[1].begin)) {
+				return fail("material without a name");
+			}
+			material_name.assign(tokens[1].begin, tokens[1].end);
+			first_pair = 2;
+		}
+
+		object_statement statement;
+		material_properties& material = is_material ? materials[material_name] : statement.material;
+
+		// The named material of an object is applied first, so the material keys of the line override it wherever they stand
+		if (is_object) {
+			bool named_material = false;
+			for (size_t k = first_pair; k < tokens.size(); k++) {
+				if (tokens[k].end - tokens[k].begin > 9 && std::memcmp(tokens[k].begin, "material=", 9) == 0) {
+					std::string name(tokens[k].begin + 9, tokens[k].end);
+					std::map<std::string, material_properties>::const_iterator named = materials.find(name);
+					if (named_material) {
+						return fail("more than one material");
+					}
+					if (named == materials.end()) {
+						return fail("material " + name + " is not defined above");
+					}
+					statement.material = named->second;
+					named_material = true;
+				}
+			}
+		}
+		for (size_t k = first_pair; k < tokens.size(); k++) {
+			const char* equals = static_cast<const char*>(std::memchr(tokens[k].begin, '=', tokens[k].end - tokens[k].begin));
+			if (!equals) {
+				return fail("expected key=value instead of " + std::string(tokens[k].begin, tokens[k].end));
+			}
+			scene_token key = { tokens[k].begin, equals };
+			scene_token value = { equals + 1, tokens[k].end };
+			std::string key_text(key.begin, key.end);
+			bool valid = true;
+
+			if (token_equals(kind, "camera")) {
+				int camera_key = 0;
+				while (camera_key < NR_SCENE_CAMERA_KEYS && !token_equals(key, scene_camera_key_names[camera_key])) {
+					camera_key++;
+				}
+				if (camera_key == NR_SCENE_CAMERA_KEYS) {
+					return fail("unknown camera setting " + key_text);
+				}
+				valid = parse_vector(value, settings.camera_values[camera_key]);
+				settings.camera_keys |= 1u << camera_key;
+			}
+			else if (token_equals(kind, "background") && token_equals(key, "color")) {
+				valid = parse_vector(value, settings.background);
+				settings.has_background = true;
+			}
+			else if (token_equals(kind, "environment") && token_equals(key, "file")) {
+				if (value.end - value.begin >= static_cast<std::ptrdiff_t>(sizeof(settings.environment_path))) {
+					return fail("environment path too long");
+				}
+				std::memset(settings.environment_path, 0, sizeof(settings.environment_path));
+				std::memcpy(settings.environment_path, value.begin, value.end - value.begin);
+				settings.environment_type = FILE_SCENE_ENVIRONMENT;
+			}
+			else if (token_equals(kind, "sky")) {
+				const char* sky_keys[4] = { "sun_direction", "sun", "zenith", "horizon" };
+				int sky_key = 0;
+				while (sky_key < 4 && !token_equals(key, sky_keys[sky_key])) {
+					sky_key++;
+				}
+				if (sky_key == 4) {
+					return fail("unknown sky setting " + key_text);
+				}
+				valid = parse_vector(value, settings.sky_colors[sky_key]);
+				settings.environment_type = SKY_SCENE_ENVIRONMENT;
+			}
+			else if (is_material || is_object) {
+				if (parse_material_key(key, value, material, valid)) {
+					// Material property of the statement
+				}
+				else if (!is_object) {
+					return fail("unknown material property " + key_text);
+				}
+				else if (token_equals(key, "material")) {
+					// Applied before the other keys of the line
+				}
+				else if (token_equals(key, "center")) {
+					valid = parse_vector(value, statement.center);
+					statement.has_center = true;
+				}
+				else if (token_equals(key, "radius")) {
+					valid = parse_scalar(value, statement.radius);
+					statement.has_radius = true;
+				}
+				else if (token_equals(key, "size")) {
+					valid = parse_vector(value, statement.size);
+					statement.has_size = true;
+				}
+				else if (token_equals(key, "top_left") || token_equals(key, "top_right") || token_equals(key, "bottom_left") || token_equals(key, "bottom_right")) {
+					int corner = token_equals(key, "top_left") ? 0 : token_equals(key, "top_right") ? 1 : token_equals(key, "bottom_left") ? 2 : 3;
+					valid = parse_vector(value, statement.corners[corner]);
+					statement.nr_corners++;
+				}
+				else if (token_equals(key, "rotation")) {
+					valid = parse_vector(value, statement.rotation);
+				}
+				else if (token_equals(key, "caustics")) {
+					valid = parse_bool(value, statement.caustics);
+				}
+				else if (token_equals(key, "inner_scale")) {
+					valid = parse_scalar(value, statement.inner_scale);
+				}
+				else if (token_equals(key, "priority")) {
+					double priority;
+					valid = parse_scalar(value, priority);
+					statement.medium_priority = static_cast<int>(priority);
+				}
+				else if (token_equals(key, "density")) {
+					valid = parse_scalar(value, statement.density);
+				}
+				else if (token_equals(key, "jitter")) {
+					valid = parse_scalar(value, statement.jitter);
+				}
+				else {
+					return fail("unknown object property " + key_text);
+				}
+			}
+			else {
+				return fail("unknown " + std::string(kind.begin, kind.end) + " setting " + key_text);
+			}
+
+			if (!valid) {
+				return fail("invalid value for " + key_text);
+			}
+		}
+
+		if (is_object) {
+			bool complete = token_equals(kind, "sphere") ? (statement.has_center && statement.has_radius) : token_equals(kind, "quad") ? (statement.nr_corners == 4) : (statement.has_center && statement.has_size);
+			if (!complete) {
+				return fail(std::string(kind.begin, kind.end) + " is missing its center, radius, size or corners");
+			}
+			scene_objects.push_back(create_statement_object(kind, statement));
+		}
+	}
+	return true;
+}
+
+// Compiled scenes are the built objects as plain records, read in place from a memory mapped file
+// The file is only valid on the machine and build that wrote it, the header checks the record sizes and the hash of the scene text
+const char compiled_scene_magic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '2' };
+
+struct compiled_scene_header {
+	char magic[8];
+	uint32_t object_record_size;
+	uint32_t triangle_record_size;
+	uint64_t source_hash; // Hash of the scene text the objects were built from
+	uint32_t nr_materials;
+	uint32_t nr_objects;
+	uint32_t nr_triangles;
+	uint32_t nr_grids;
+	uint64_t nr_grid_offsets;
+	uint64_t nr_grid_values;
+	scene_settings settings;
+};
+
+struct compiled_material {
+	int32_t material;
+	int32_t reserved;
+	double material_color[3];
+	double metal_fuzz;
+	double refraction_index;
+	double inner_refraction_index;
+};
+
+// Built object after rotation, its triangles follow each other in the triangle records
+struct compiled_object {
+	int32_t object_type;
+	uint32_t material_index; // Into the material records of the file
+	int32_t medium_priority;
+	int32_t dielectric_shell;
+	int32_t constant_density_medium;
+	uint32_t first_triangle;
+	uint32_t nr_triangles;
+	int32_t grid; // Density grid record of a jittered medium, -1 without one
+	double shell_inner_scale;
+	double density;
+	double center[3]; // Sphere, quad or cube center
+	double radius; // Sphere radius or cube size
+	double area;
+};
+
+// Density grid of a jittered medium, its brick offsets and its densities followed by its brick majorants lie in the grid sections
+struct compiled_grid {
+	double lower[3];
+	double upper[3];
+	int32_t resolution[3];
+	int32_t bricks[3];
+	uint64_t first_offset;
+	uint64_t nr_offsets;
+	uint64_t first_value;
+	uint64_t nr_densities;
+	uint64_t nr_majorants;
+};
+
+// Sections start at multiples of 8 bytes so the records can be read in place
+size_t align_section(size_t offset) {
+	return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+// Byte offsets of the sections of a compiled scene and the size of the whole file
+struct compiled_sections {
+	size_t materials;
+	size_t objects;
+	size_t triangles;
+	size_t grids;
+	size_t grid_offsets;
+	size_t grid_values;
+	size_t end;
+};
+
+compiled_sections compiled_section_offsets(const compiled_scene_header& header) {
+	compiled_sections sections;
+	sections.materials = align_section(sizeof(header));
+	sections.objects = align_section(sections.materials + static_cast<size_t>(header.nr_materials) * sizeof(compiled_material));
+	sections.triangles = align_section(sections.objects + static_cast<size_t>(header.nr_objects) * sizeof(compiled_object));
+	sections.grids = align_section(sections.triangles + static_cast<size_t>(header.nr_triangles) * sizeof(triangle));
+	sections.grid_offsets = align_section(sections.grids + static_cast<size_t>(header.nr_grids) * sizeof(compiled_grid));
+	sections.grid_values = align_section(sections.grid_offsets + static_cast<size_t>(header.nr_grid_offsets) * sizeof(int32_t));
+	sections.end = sections.grid_values + static_cast<size_t>(header.nr_grid_values) * sizeof(float);
+	return sections;
+}
+
+// Density grids are stored as they are, so loading a scene with jittered media doesn't evaluate their noise again
+bool write_compiled_scene(const std::string& path, uint64_t source_hash, const scene_settings& settings, const std::vector<scene_object>& scene_objects) {
+	std::vector<compiled_material> materials;
+	std::map<uint32_t, uint32_t> material_indices; // Material table id to material record
+	std::vector<compiled_object> objects;
+	std::vector<triangle> triangles;
+	std::vector<compiled_grid> grids;
+	std::map<const density_grid*, int32_t> grid_indices; // Media sharing a grid share its record
+	std::vector<int32_t> grid_offsets;
+	std::vector<float> grid_values;
+
+	for (size_t k = 0; k < scene_objects.size(); k++) {
+		const scene_object& object = scene_objects[k];
+		std::map<uint32_t, uint32_t>::const_iterator found = material_indices.find(object.material_id);
+		if (found == material_indices.end()) {
+			const material_properties& properties = object_material(object);
+			compiled_material material = {};
+			material.material = properties.material;
+			material.material_color[0] = properties.material_color.x;
+			material.material_color[1] = properties.material_color.y;
+			material.material_color[2] = properties.material_color.z;
+			material.metal_fuzz = properties.metal_fuzz;
+			material.refraction_index = properties.refraction_index;
+			material.inner_refraction_index = properties.inner_refraction_index;
+			found = material_indices.insert({ object.material_id, static_cast<uint32_t>(materials.size()) }).first;
+			materials.push_back(material);
+		}
+
+		compiled_object record = {};
+		record.object_type = object.object_type;
+		record.material_index = found->second;
+		record.medium_priority = object.medium_priority;
+		record.dielectric_shell = object.dielectric_shell;
+		record.constant_density_medium = object.constant_density_medium;
+		record.shell_inner_scale = object.shell_inner_scale;
+		record.density = object.constant_density_medium ? object.density : 0.0;
+		record.grid = -1;
+		if (object.constant_density_medium && object.medium_grid) {
+			const density_grid& grid = *object.medium_grid;
+			std::map<const density_grid*, int32_t>::const_iterator found_grid = grid_indices.find(&grid);
+			if (found_grid == grid_indices.end()) {
+				compiled_grid grid_record = {};
+				for (int axis = 0; axis < 3; axis++) {
+					grid_record.lower[axis] = grid.lower[axis];
+					grid_record.upper[axis] = grid.upper[axis];
+					grid_record.resolution[axis] = grid.resolution[axis];
+					grid_record.bricks[axis] = grid.bricks[axis];
+				}
+				grid_record.first_offset = grid_offsets.size();
+				grid_record.nr_offsets = grid.brick_offsets.size();
+				grid_record.first_value = grid_values.size();
+				grid_record.nr_densities = grid.densities.size();
+				grid_record.nr_majorants = grid.brick_majorants.size();
+				grid_offsets.insert(grid_offsets.end(), grid.brick_offsets.begin(), grid.brick_offsets.end());
+				grid_values.insert(grid_values.end(), grid.densities.begin(), grid.densities.end());
+				grid_values.insert(grid_values.end(), grid.brick_majorants.begin(), grid.brick_majorants.end());
+				found_grid = grid_indices.insert({ &grid, static_cast<int32_t>(grids.size()) }).first;
+				grids.push_back(grid_record);
+			}
+			record.grid = found_grid->second;
+		}
+		record.first_triangle = static_cast<uint32_t>(triangles.size());
+		// Only the fields of the object type are set
+		glm::dvec3 center;
+		switch (object.object_type) {
+		case SPHERE:
+			center = object.sphere_center;
+			record.radius = object.sphere_radius;
+			record.area = object.sphere_area;
+		break;
+		case QUAD:
+			center = object.quad_center;
+			record.area = object.quad_area;
+			triangles.insert(triangles.end(), object.quad_triangles, object.quad_triangles + object.nr_quad_triangles);
+		break;
+		default:
+			center = object.cube_center;
+			record.radius = (object.object_type == CUBE) ? object.cube_size : 0.0;
+			record.area = object.cube_area;
+			triangles.insert(triangles.end(), object.cube_triangles, object.cube_triangles + object.nr_cube_triangles);
+		break;
+		}
+		record.center[0] = center.x;
+		record.center[1] = center.y;
+		record.center[2] = center.z;
+		record.nr_triangles = static_cast<uint32_t>(triangles.size()) - record.first_triangle;
+		objects.push_back(record);
+	}
+
+	compiled_scene_header header = {};
+	std::memcpy(header.magic, compiled_scene_magic, sizeof(compiled_scene_magic));
+	header.object_record_size = sizeof(compiled_object);
+	header.triangle_record_size = sizeof(triangle);
+	header.source_hash = source_hash;
+	header.nr_materials = static_cast<uint32_t>(materials.size());
+	header.nr_objects = static_cast<uint32_t>(objects.size());
+	header.nr_triangles = static_cast<uint32_t>(triangles.size());
+	header.nr_grids = static_cast<uint32_t>(grids.size());
+	header.nr_grid_offsets = grid_offsets.size();
+	header.nr_grid_values = grid_values.size();
+	header.settings = settings;
+
+	compiled_sections sections = compiled_section_offsets(header);
+	std::vector<unsigned char> file(sections.end, 0);
+	std::memcpy(&file[0], &header, sizeof(header));
+	std::memcpy(&file[sections.materials], materials.data(), materials.size() * sizeof(compiled_material));
+	std::memcpy(&file[sections.objects], objects.data(), objects.size() * sizeof(compiled_object));
+	std::memcpy(&file[sections.triangles], triangles.data(), triangles.size() * sizeof(triangle));
+	std::memcpy(&file[sections.grids], grids.data(), grids.size() * sizeof(compiled_grid));
+	std::memcpy(&file[sections.grid_offsets], grid_offsets.data(), grid_offsets.size() * sizeof(int32_t));
+	std::memcpy(&file[sections.grid_values], grid_values.data(), grid_values.size() * sizeof(float));
+
+	std::string temporary_path = path + ".tmp";
+	if (!write_file(temporary_path, file) || !replace_file(temporary_path, path)) {
+		std::remove(temporary_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Read only view of a whole file
+struct mapped_scene_file {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
+
+bool map_scene_file(mapped_scene_file& file, const std::string& path) {
+#ifdef _WIN32
+	HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	file.file_handle = file_handle;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+		return false;
+	}
+	file.mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!file.mapping_handle) {
+		return false;
+	}
+	file.data = static_cast<const unsigned char*>(MapViewOfFile(file.mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	file.size = static_cast<size_t>(file_size.QuadPart);
+#else
+	int file_descriptor = open(path.c_str(), O_RDONLY);
+	if (file_descriptor < 0) {
+		return false;
+	}
+	struct stat status;
+	void* mapping = MAP_FAILED;
+	if (fstat(file_descriptor, &status) == 0 && status.st_size > 0) {
+		mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	}
+	close(file_descriptor); // The mapping keeps the file open
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	file.data = static_cast<const unsigned char*>(mapping);
+	file.size = static_cast<size_t>(status.st_size);
+#endif
+	return file.data != nullptr;
+}
+
+void unmap_scene_file(mapped_scene_file& file) {
+#ifdef _WIN32
+	if (file.data) {
+		UnmapViewOfFile(file.data);
+	}
+	if (file.mapping_handle) {
+		CloseHandle(file.mapping_handle);
+	}
+	if (file.file_handle) {
+		CloseHandle(file.file_handle);
+	}
+	file.file_handle = nullptr;
+	file.mapping_handle = nullptr;
+#else
+	if (file.data) {
+		munmap(const_cast<unsigned char*>(file.data), file.size);
+	}
+#endif
+	file.data = nullptr;
+	file.size = 0;
+}
+
+// Objects are built from the records where they lie in the mapping, with no parsing, rotation or material lookups by value
+// Each material record is registered once, density grids are copied out of the mapping once and shared by the media that use them
+bool read_compiled_scene(const mapped_scene_file& file, uint64_t source_hash, scene_settings& settings, std::vector<scene_object>& scene_objects) {
+	if (file.size < sizeof(compiled_scene_header)) {
+		return false;
+	}
+	compiled_scene_header header;
+	std::memcpy(&header, file.data, sizeof(header));
+	if (std::memcmp(header.magic, compiled_scene_magic, sizeof(compiled_scene_magic)) != 0 || header.source_hash != source_hash ||
+		header.object_record_size != sizeof(compiled_object) || header.triangle_record_size != sizeof(triangle)) {
+		return false;
+	}
+	compiled_sections sections = compiled_section_offsets(header);
+	if (file.size != sections.end) {
+		return false;
+	}
+	const compiled_material* materials = reinterpret_cast<const compiled_material*>(file.data + sections.materials);
+	const compiled_object* objects = reinterpret_cast<const compiled_object*>(file.data + sections.objects);
+	const triangle* triangles = reinterpret_cast<const triangle*>(file.data + sections.triangles);
+	const compiled_grid* grid_records = reinterpret_cast<const compiled_grid*>(file.data + sections.grids);
+	const int32_t* grid_offsets = reinterpret_cast<const int32_t*>(file.data + sections.grid_offsets);
+	const float* grid_values = reinterpret_cast<const float*>(file.data + sections.grid_values);
+
+	std::vector<std::shared_ptr<const density_grid>> grids(header.nr_grids);
+	for (uint32_t k = 0; k < header.nr_grids; k++) {
+		const compiled_grid& record = grid_records[k];
+		if (record.first_offset + record.nr_offsets > header.nr_grid_offsets || record.first_value + record.nr_densities + record.nr_majorants > header.nr_grid_values) {
+			return false;
+		}
+		std::shared_ptr<density_grid> grid = std::make_shared<density_grid>();
+		grid->lower = to_vector(record.lower);
+		grid->upper = to_vector(record.upper);
+		for (int axis = 0; axis < 3; axis++) {
+			grid->resolution[axis] = record.resolution[axis];
+			grid->bricks[axis] = record.bricks[axis];
+		}
+		grid->brick_offsets.assign(grid_offsets + record.first_offset, grid_offsets + record.first_offset + record.nr_offsets);
+		const float* values = grid_values + record.first_value;
+		grid->densities.assign(values, values + record.nr_densities);
+		grid->brick_majorants.assign(values + record.nr_densities, values + record.nr_densities + record.nr_majorants);
+		grids[k] = grid;
+	}
+
+	std::vector<uint32_t> material_ids(header.nr_materials);
+	for (uint32_t k = 0; k < header.nr_materials; k++) {
+		material_properties properties;
+		properties.material = static_cast<material_enum>(materials[k].material);
+		properties.material_color = to_vector(materials[k].material_color);
+		properties.metal_fuzz = materials[k].metal_fuzz;
+		properties.refraction_index = materials[k].refraction_index;
+		properties.inner_refraction_index = materials[k].inner_refraction_index;
+		material_ids[k] = register_material(properties);
+	}
+
+	std::vector<scene_object> loaded(header.nr_objects);
+	for (uint32_t k = 0; k < header.nr_objects; k++) {
+		const compiled_object& record = objects[k];
+		if (record.material_index >= header.nr_materials || record.grid >= static_cast<int32_t>(header.nr_grids) || record.nr_triangles > 12 || static_cast<size_t>(record.first_triangle) + record.nr_triangles > header.nr_triangles) {
+			return false;
+		}
+		scene_object& object = loaded[k];
+		object.object_type = static_cast<object_enum>(record.object_type);
+		object.material_id = material_ids[record.material_index];
+		object.medium_priority = record.medium_priority;
+		object.dielectric_shell = (record.dielectric_shell != 0);
+		object.constant_density_medium = (record.constant_density_medium != 0);
+		object.shell_inner_scale = record.shell_inner_scale;
+		object.density = record.density;
+		switch (object.object_type) {
+		case SPHERE:
+			object.sphere_center = to_vector(record.center);
+			object.sphere_radius = record.radius;
+			object.sphere_area = record.area;
+		break;
+		case QUAD:
+			object.quad_center = to_vector(record.center);
+			object.quad_area = record.area;
+			object.nr_quad_triangles = static_cast<int>(record.nr_triangles);
+			std::copy(triangles + record.first_triangle, triangles + record.first_triangle + record.nr_triangles, object.quad_triangles);
+		break;
+		default:
+			object.cube_center = to_vector(record.center);
+			object.cube_size = record.radius;
+			object.cube_area = record.area;
+			object.nr_cube_triangles = static_cast<int>(record.nr_triangles);
+			std::copy(triangles + record.first_triangle, triangles + record.first_triangle + record.nr_triangles, object.cube_triangles);
+		break;
+		}
+		if (record.grid >= 0) {
+			object.medium_grid = grids[record.grid];
+		}
+	}
+
+	settings = header.settings;
+	settings.environment_path[sizeof(settings.environment_path) - 1] = '\0';
+	scene_objects = std::move(loaded);
+	return true;
+}
+
+bool load_compiled_scene(const std::string& path, uint64_t source_hash, scene_settings& settings, std::vector<scene_object>& scene_objects) {
+	mapped_scene_file file;
+	bool loaded = map_scene_file(file, path) && read_compiled_scene(file, source_hash, settings, scene_objects);
+	unmap_scene_file(file);
+	return loaded;
+}
+
+void apply_scene_settings(const scene_settings& settings, camera& camera, color& background_color) {
+	for (int key = 0; key < NR_SCENE_CAMERA_KEYS; key++) {
+		if (!(settings.camera_keys & (1u << key))) {
+			continue;
+		}
+		const double* values = settings.camera_values[key];
+		switch (key) {
+		case SCENE_ASPECT_RATIO:
+			camera.aspect_ratio = values[0];
+		break;
+		case SCENE_IMAGE_WIDTH:
+			camera.image_width = static_cast<int>(values[0]);
+		break;
+		case SCENE_SAMPLES_PER_PIXEL:
+			camera.samples_per_pixel = static_cast<int>(values[0]);
+		break;
+		case SCENE_MAX_DEPTH:
+			camera.max_depth = static_cast<int>(values[0]);
+		break;
+		case SCENE_VERTICAL_FIELD_OF_VIEW:
+			camera.vertical_field_of_view = values[0];
+		break;
+		case SCENE_LOOK_FROM:
+			camera.look_from = to_vector(values);
+		break;
+		case SCENE_LOOK_AT:
+			camera.look_at = to_vector(values);
+		break;
+		case SCENE_CAMERA_UP:
+			camera.camera_up = to_vector(values);
+		break;
+		case SCENE_DEFOCUS_ANGLE:
+			camera.defocus_angle = values[0];
+		break;
+		default:
+			camera.focus_distance = values[0];
+		break;
+		}
+	}
+	if (settings.has_background) {
+		background_color = to_vector(settings.background);
+	}
+	if (settings.environment_type == FILE_SCENE_ENVIRONMENT) {
+		camera.environment = load_environment_map(settings.environment_path);
+	}
+	else if (settings.environment_type == SKY_SCENE_ENVIRONMENT) {
+		camera.environment = create_sky_environment_map(to_vector(settings.sky_colors[0]), to_vector(settings.sky_colors[1]), to_vector(settings.sky_colors[2]), to_vector(settings.sky_colors[3]));
+	}
+}
+
+// Load the scene file through its compiled scene at path.cache when that was built from the same text, else parse it and compile it for the next run
+// Nothing is changed when the file can't be read or has an error
+bool load_scene(const std::string& path, std::vector<scene_object>& scene_objects, camera& camera, color& background_color) {
+	std::ifstream input(path, std::ios::binary);
+	if (!input) {
+		std::cerr << "Failed to open the scene file " << path << std::endl;
+		return false;
+	}
+	std::string text((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+	uint64_t source_hash = fingerprint_bytes(14695981039346656037ull, text.data(), text.size());
+	std::string cache_path = path + ".cache";
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	scene_settings settings;
+	std::vector<scene_object> loaded;
+	bool cached = load_compiled_scene(cache_path, source_hash, settings, loaded);
+	if (!cached) {
+		if (!parse_scene(text.data(), text.size(), path, settings, loaded)) {
+			return false;
+		}
+		if (!write_compiled_scene(cache_path, source_hash, settings, loaded)) {
+			std::cerr << "Failed to write the compiled scene " << cache_path << std::endl;
+		}
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << (cached ? "Loaded the compiled scene " : "Parsed the scene file ") << path << ", " << loaded.size() << " objects in " << milliseconds << " ms" << std::endl;
+
+	apply_scene_settings(settings, camera, background_color);
+	scene_objects.insert(scene_objects.end(), std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.end()));
+	return true;
+}
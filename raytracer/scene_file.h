@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "geometry.h"
+#include "util.h"
+#include "camera.h"
+
+// Scenes described in a text file instead of a scene function, one statement per line and # starting a comment
+//   camera look_from=0,0,-1 look_at=0,0,-100 vertical_field_of_view=90 aspect_ratio=16/9
+//   background color=0.7,0.8,1.0
+//   environment file=environment.pfm or sky sun_direction=-0.5,0.6,-0.6 sun=2000,1800,1500 zenith=0.25,0.45,0.9 horizon=0.8,0.85,0.95
+//   material glass type=dielectric refraction_index=1.5
+//   sphere center=0,-29,-85 radius=20 material=glass caustics=true
+//   cube center=20,-35,-80 size=30 color=0.5 rotation=0,-30,0
+//   box center=-20,-15,-115 size=30,70,30 type=light color=8
+//   quad top_left=-15,49.9,-85 top_right=15,49.9,-85 bottom_left=-15,49.9,-115 bottom_right=15,49.9,-115 type=light color=8
+// Objects take a named material and override its type, color, fuzz, refraction_index and inner_refraction_index in place
+// Dielectrics are thin shells unless caustics=true or inner_scale is given, media take density and jitter, polygons a rotation in degrees
+// Numbers may be fractions like 16/9, vectors of one number repeat it
+
+// Camera settings a scene file can set, applied over the camera the render starts from
+enum scene_camera_key {
+	SCENE_ASPECT_RATIO,
+	SCENE_IMAGE_WIDTH,
+	SCENE_SAMPLES_PER_PIXEL,
+	SCENE_MAX_DEPTH,
+	SCENE_VERTICAL_FIELD_OF_VIEW,
+	SCENE_LOOK_FROM,
+	SCENE_LOOK_AT,
+	SCENE_CAMERA_UP,
+	SCENE_DEFOCUS_ANGLE,
+	SCENE_FOCUS_DISTANCE,
+	NR_SCENE_CAMERA_KEYS
+};
+
+enum scene_environment_enum {
+	NO_SCENE_ENVIRONMENT,
+	FILE_SCENE_ENVIRONMENT, // Equirectangular pfm loaded from environment_path
+	SKY_SCENE_ENVIRONMENT // Procedural sky with a sun
+};
+
+// Everything in a scene file apart from the objects, plain data so the compiled cache stores it as it is
+struct scene_settings {
+	uint32_t camera_keys = 0; // Bits of the scene_camera_key values the file sets
+	double camera_values[NR_SCENE_CAMERA_KEYS][3] = {};
+	bool has_background = false;
+	double background[3] = {};
+	int32_t environment_type = NO_SCENE_ENVIRONMENT;
+	char environment_path[256] = {};
+	double sky_colors[4][3] = {}; // Sun direction, sun, zenith and horizon colors
+};
+
+bool parse_scene(const char* text, size_t size, const std::string& path, scene_settings& settings, std::vector<scene_object>& scene_objects);
+bool write_compiled_scene(const std::string& path, uint64_t source_hash, const scene_settings& settings, const std::vector<scene_object>& scene_objects);
+bool load_compiled_scene(const std::string& path, uint64_t source_hash, scene_settings& settings, std::vector<scene_object>& scene_objects);
+void apply_scene_settings(const scene_settings& settings, camera& camera, color& background_color);
+bool load_scene(const std::string& path, std::vector<scene_object>& scene_objects, camera& camera, color& background_color);
@@ -1,5 +1,6 @@
 #include <memory>
 #include "geometry_rotation.h"
+#include "volume.h"
 #include "util.h"
 #include "glm.hpp"
 #include "camera.h"
@@ -23,15 +24,23 @@ void add_metal_sphere_to_scene(std::vector<scene_object>& scene_objects, point3
 	scene_objects.push_back(sphere);
 }
 
-void add_dielectric_sphere_to_scene(std::vector<scene_object>& scene_objects, point3 center, double radius, double refraction_index, bool caustics) {
-	scene_object outer_sphere = create_sphere(center, radius, DIELECTRIC, {}, {}, refraction_index);
-	scene_object inner_sphere = create_sphere(center, -(0.95 * radius), DIELECTRIC, {}, {}, refraction_index);
-
-	scene_objects.push_back(outer_sphere);
+// Dielectrics are hollow shells with a thin wall unless the caustics of a solid object are wanted
+void add_dielectric_sphere_to_scene(std::vector<scene_object>& scene_objects, point3 center, double radius, double refraction_index, bool caustics, int medium_priority) {
+	scene_object sphere = create_sphere(center, radius, DIELECTRIC, {}, {}, refraction_index);
+	sphere.shell_inner_scale = caustics ? 0.0 : 0.95;
+	sphere.medium_priority = medium_priority;
+	scene_objects.push_back(sphere);
+}
 
-	if (!caustics) {
-		scene_objects.push_back(inner_sphere);
-	}
+// Shell whose cavity is filled with another dielectric, like a glass of water
+void add_filled_dielectric_sphere_to_scene(std::vector<scene_object>& scene_objects, point3 center, double radius, double inner_scale, double refraction_index, double inner_refraction_index, int medium_priority) {
+	scene_object sphere = create_sphere(center, radius, DIELECTRIC, {}, {}, refraction_index);
+	sphere.shell_inner_scale = inner_scale;
+	material_properties properties = object_material(sphere);
+	properties.inner_refraction_index = inner_refraction_index;
+	set_object_material(sphere, properties);
+	sphere.medium_priority = medium_priority;
+	scene_objects.push_back(sphere);
 }
 
 void add_lambertian_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double size, color color, double x_rotation, double y_rotation, double z_rotation) {
@@ -46,18 +55,12 @@ void add_metal_cube_to_scene(std::vector<scene_object>& scene_objects, point3 ce
 	scene_objects.push_back(cube);
 }
 
-void add_dielectric_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double size, double refraction_index, double x_rotation, double y_rotation, double z_rotation, bool caustics) {
-	scene_object outer_cube = create_cube(center, size, DIELECTRIC, {}, {}, refraction_index);
-	scene_object inner_cube = create_cube(center, -(0.95 * size), DIELECTRIC, {}, {}, refraction_index);
-
-	rotate_polygon(outer_cube, x_rotation, y_rotation, z_rotation);
-	rotate_polygon(inner_cube, x_rotation, y_rotation, z_rotation);
-
-	scene_objects.push_back(outer_cube);
-
-	if (!caustics) {
-		scene_objects.push_back(inner_cube);
-	}
+void add_dielectric_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double size, double refraction_index, double x_rotation, double y_rotation, double z_rotation, bool caustics, int medium_priority) {
+	scene_object cube = create_cube(center, size, DIELECTRIC, {}, {}, refraction_index);
+	cube.shell_inner_scale = caustics ? 0.0 : 0.95;
+	cube.medium_priority = medium_priority;
+	rotate_polygon(cube, x_rotation, y_rotation, z_rotation);
+	scene_objects.push_back(cube);
 }
 
 void add_lambertian_asymmetric_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double width, double height, double depth, color color, double x_rotation, double y_rotation, double z_rotation) {
@@ -72,18 +75,39 @@ void add_metal_asymmetric_cube_to_scene(std::vector<scene_object>& scene_objects
 	scene_objects.push_back(cube);
 }
 
-void add_dielectric_asymmetric_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double width, double height, double depth, double refraction_index, double x_rotation, double y_rotation, double z_rotation, bool caustics) {
-	scene_object outer_cube = create_asymmetric_cube(center, width, height, depth, DIELECTRIC, {}, {}, refraction_index);
-	scene_object inner_cube = create_asymmetric_cube(center, (-0.95 * width), (-0.95 * height), (-0.95 * depth), DIELECTRIC, {}, {}, refraction_index);
+void add_dielectric_asymmetric_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double width, double height, double depth, double refraction_index, double x_rotation, double y_rotation, double z_rotation, bool caustics, int medium_priority) {
+	scene_object cube = create_asymmetric_cube(center, width, height, depth, DIELECTRIC, {}, {}, refraction_index);
+	cube.shell_inner_scale = caustics ? 0.0 : 0.95;
+	cube.medium_priority = medium_priority;
+	rotate_polygon(cube, x_rotation, y_rotation, z_rotation);
+	scene_objects.push_back(cube);
+}
 
-	rotate_polygon(outer_cube, x_rotation, y_rotation, z_rotation);
-	rotate_polygon(inner_cube, x_rotation, y_rotation, z_rotation);
+// Textured lambertians take their color from the texture, the material color stays as the fallback of solid textures
+void add_textured_lambertian_quad_to_scene(std::vector<scene_object>& scene_objects, point3 top_left, point3 top_right, point3 bottom_left, point3 bottom_right, const texture& texture, double x_rotation, double y_rotation, double z_rotation) {
+	scene_object quad = create_quad(top_left, top_right, bottom_left, bottom_right, LAMBERTIAN);
+	material_properties properties = object_material(quad);
+	properties.material_texture = texture;
+	set_object_material(quad, properties);
+	rotate_polygon(quad, x_rotation, y_rotation, z_rotation);
+	scene_objects.push_back(quad);
+}
 
-	scene_objects.push_back(outer_cube);
+void add_textured_lambertian_sphere_to_scene(std::vector<scene_object>& scene_objects, point3 center, double radius, const texture& texture) {
+	scene_object sphere = create_sphere(center, radius, LAMBERTIAN);
+	material_properties properties = object_material(sphere);
+	properties.material_texture = texture;
+	set_object_material(sphere, properties);
+	scene_objects.push_back(sphere);
+}
 
-	if (!caustics) {
-		scene_objects.push_back(inner_cube);
-	}
+void add_textured_lambertian_cube_to_scene(std::vector<scene_object>& scene_objects, point3 center, double size, const texture& texture, double x_rotation, double y_rotation, double z_rotation) {
+	scene_object cube = create_cube(center, size, LAMBERTIAN);
+	material_properties properties = object_material(cube);
+	properties.material_texture = texture;
+	set_object_material(cube, properties);
+	rotate_polygon(cube, x_rotation, y_rotation, z_rotation);
+	scene_objects.push_back(cube);
 }
 
 void add_quad_light_to_scene(std::vector<scene_object>& scene_objects, point3 top_left, point3 top_right, point3 bottom_left, point3 bottom_right, color color, double x_rotation, double y_rotation, double z_rotation) {
@@ -109,30 +133,45 @@ void add_asymmetric_cube_light_to_scene(std::vector<scene_object>& scene_objects
 	scene_objects.push_back(asymmetric_cube_light);
 }
 
-void add_spherical_constant_density_medium_to_scene(std::vector<scene_object>& scene_objects, point3 center, double radius, color color, double density) {
+void add_spherical_constant_density_medium_to_scene(std::vector<scene_object>& scene_objects, point3 center, double radius, color color, double density, double jitter) {
 	scene_object sphere = create_sphere(center, radius, CONSTANT_DENSITY_MEDIUM_MATERIAL, color);
 	sphere.constant_density_medium = true;
 	sphere.density = density;
 
+	// Jittered mediums get an irregular boundary from a density grid around the sphere
+	if (jitter > 0.0) {
+		sphere.medium_grid = create_jittered_density_grid(sphere, jitter);
+	}
+
 	scene_objects.push_back(sphere);
 }
 
-void add_cubical_constant_density_medium_to_scene(std::vector<scene_object>& scene_objects, point3 center, double size, color color, double density, double x_rotation, double y_rotation, double z_rotation) {
+void add_cubical_constant_density_medium_to_scene(std::vector<scene_object>& scene_objects, point3 center, double size, color color, double density, double x_rotation, double y_rotation, double z_rotation, double jitter) {
 	scene_object cube = create_cube(center, size, CONSTANT_DENSITY_MEDIUM_MATERIAL, color);
 	cube.constant_density_medium = true;
 	cube.density = density;
 
 	rotate_polygon(cube, x_rotation, y_rotation, z_rotation);
 
+	// The grid is built after rotation so it follows the rotated faces
+	if (jitter > 0.0) {
+		cube.medium_grid = create_jittered_density_grid(cube, jitter);
+	}
+
 	scene_objects.push_back(cube);
 }
 
-void add_asymmetric_cubical_constant_density_medium_to_scene(std::vector<scene_object>& scene_objects, point3 center, double width, double height, double depth, color color, double density, double x_rotation, double y_rotation, double z_rotation) {
+void add_asymmetric_cubical_constant_density_medium_to_scene(std::vector<scene_object>& scene_objects, point3 center, double width, double height, double depth, color color, double density, double x_rotation, double y_rotation, double z_rotation, double jitter) {
 	scene_object cube = create_asymmetric_cube(center, width, height, depth, CONSTANT_DENSITY_MEDIUM_MATERIAL, color);
 	cube.constant_density_medium = true;
 	cube.density = density;
 
 	rotate_polygon(cube, x_rotation, y_rotation, z_rotation);
 
+	// The grid is built after rotation so it follows the rotated faces
+	if (jitter > 0.0) {
+		cube.medium_grid = create_jittered_density_grid(cube, jitter);
+	}
+
 	scene_objects.push_back(cube);
 }
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include "texture.h"
+#include "environment.h"
+#include "util.h"
+#include "glm.hpp"
+#include "checkpoint.h"
+
+// Image textures
+// Images are turned into mip pyramids once when registered, written tile by tile to an anonymous temporary file and dropped from memory
+// Lookups fetch tiles through a cache shared by all threads with a bounded number of tiles, so scenes with many large textures fit in memory
+
+// Square block of texels of one mip level, rgb floats row by row
+struct texture_tile {
+	float texels[texture_tile_size * texture_tile_size * 3];
+};
+
+// Temporary file holding the tiles of one image, reads seek so they are serialized per file
+struct tile_file {
+	std::FILE* file = nullptr;
+	std::mutex mutex;
+};
+
+// Tiles are evicted with the clock algorithm, a tile gets a second chance if it was used since the hand last passed it
+struct cache_entry {
+	uint64_t key;
+	std::shared_ptr<const texture_tile> tile;
+	bool referenced;
+};
+
+// The cache is split into shards with their own lock so threads fetching different tiles rarely wait on each other
+struct cache_shard {
+	std::mutex mutex;
+	std::unordered_map<uint64_t, int> slots; // Tile key to index in entries
+	std::vector<cache_entry> entries;
+	int clock_hand = 0;
+	long long hits = 0; // Counted under the lock of the shard, lookups served by the last tile of a thread don't reach the shards
+	long long misses = 0;
+};
+
+const int nr_cache_shards = 16;
+
+struct texture_cache {
+	cache_shard shards[nr_cache_shards];
+	size_t shard_capacity = 64; // Tiles each shard holds before it starts evicting
+};
+
+std::mutex image_registry_mutex;
+std::vector<image_texture> registered_images;
+std::vector<std::unique_ptr<tile_file>> tile_files;
+texture_cache tile_cache;
+double texture_footprint_spread = 0.0; // Angle a pixel covers, footprints grow with it along the distance a ray travels
+
+// The most recently used tile of each thread, neighbouring texels of a lookup nearly always share a tile
+thread_local uint64_t last_tile_key = UINT64_MAX;
+thread_local std::shared_ptr<const texture_tile> last_tile;
+
+texture create_checker_texture(const color& even_color, const color& odd_color, double scale) {
+	texture checker;
+	checker.texture_type = CHECKER_TEXTURE;
+	checker.even_color = even_color;
+	checker.odd_color = odd_color;
+	checker.scale = scale;
+	return checker;
+}
+
+texture create_noise_texture(const color& low_color, const color& high_color, double scale) {
+	texture noise;
+	noise.texture_type = NOISE_TEXTURE;
+	noise.even_color = low_color;
+	noise.odd_color = high_color;
+	noise.scale = scale;
+	return noise;
+}
+
+// Falls back to a solid texture when the image can't be loaded, the object keeps its material color
+texture create_image_texture(const std::string& path) {
+	texture image;
+	image.image_index = register_image_texture(path);
+	image.texture_type = (image.image_index < 0) ? SOLID_TEXTURE : IMAGE_TEXTURE;
+	return image;
+}
+
+// PPM images are gamma encoded like the images this ray tracer writes, PFM images are linear
+bool load_image(const std::string& path, int& width, int& height, std::vector<color>& texels) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cout << "Could not open texture " << path << std::endl;
+		return false;
+	}
+
+	std::string format;
+	file >> format;
+	if (format == "PF" || format == "Pf") {
+		file.close();
+		return load_pfm(path, width, height, texels);
+	}
+
+	int max_value;
+	file >> width >> height >> max_value;
+	file.get(); // Single whitespace character before the data
+	if (!file || (format != "P3" && format != "P6") || width <= 0 || height <= 0 || max_value <= 0 || max_value > 255) {
+		std::cout << "Texture " << path << " is not an 8 bit PPM or a PFM file" << std::endl;
+		return false;
+	}
+
+	texels.resize(static_cast<size_t>(width) * height);
+	for (color& texel : texels) {
+		int values[3];
+		for (int channel = 0; channel < 3; channel++) {
+			if (format == "P6") {
+				values[channel] = file.get();
+			}
+			else {
+				file >> values[channel];
+			}
+		}
+		glm::dvec3 encoded = glm::dvec3(values[0], values[1], values[2]) / static_cast<double>(max_value);
+		texel = encoded * encoded;
+	}
+
+	if (!file) {
+		std::cout << "Texture " << path << " is truncated" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Box filter a level down to half its size, odd sizes let the last texel of a row or column stand in for the missing neighbour
+std::vector<color> downsample(const std::vector<color>& texels, int width, int height, int& half_width, int& half_height) {
+	half_width = std::max(1, width / 2);
+	half_height = std::max(1, height / 2);
+	std::vector<color> half(static_cast<size_t>(half_width) * half_height);
+
+	for (int y = 0; y < half_height; y++) {
+		for (int x = 0; x < half_width; x++) {
+			int x0 = std::min(2 * x, width - 1);
+			int x1 = std::min(2 * x + 1, width - 1);
+			int y0 = std::min(2 * y, height - 1);
+			int y1 = std::min(2 * y + 1, height - 1);
+			half[y * half_width + x] = 0.25 * (texels[y0 * width + x0] + texels[y0 * width + x1] + texels[y1 * width + x0] + texels[y1 * width + x1]);
+		}
+	}
+
+	return half;
+}
+
+// Write every tile of one level, texels past the edge of the level are padding that lookups never read
+void write_level_tiles(std::FILE* file, const std::vector<color>& texels, const mip_level& level) {
+	texture_tile tile;
+	for (int tile_y = 0; tile_y < level.tiles_y; tile_y++) {
+		for (int tile_x = 0; tile_x < level.tiles_x; tile_x++) {
+			for (int y = 0; y < texture_tile_size; y++) {
+				for (int x = 0; x < texture_tile_size; x++) {
+					int texel_x = std::min(tile_x * texture_tile_size + x, level.width - 1);
+					int texel_y = std::min(tile_y * texture_tile_size + y, level.height - 1);
+					const color& texel = texels[texel_y * level.width + texel_x];
+					float* destination = tile.texels + (y * texture_tile_size + x) * 3;
+					destination[0] = static_cast<float>(texel.x);
+					destination[1] = static_cast<float>(texel.y);
+					destination[2] = static_cast<float>(texel.z);
+				}
+			}
+			std::fwrite(&tile, sizeof(texture_tile), 1, file);
+		}
+	}
+}
+
+// Register an image once per path, returns its index or -1 when it can't be loaded
+int register_image_texture(const std::string& path) {
+	std::lock_guard<std::mutex> lock(image_registry_mutex);
+
+	for (int i = 0; i < static_cast<int>(registered_images.size()); i++) {
+		if (registered_images[i].path == path) {
+			return i;
+		}
+	}
+
+	int width, height;
+	std::vector<color> texels;
+	if (!load_image(path, width, height, texels)) {
+		return -1;
+	}
+
+	std::unique_ptr<tile_file> tiles(new tile_file());
+	tiles->file = std::tmpfile();
+	if (!tiles->file) {
+		std::cout << "Could not create a tile file for texture " << path << std::endl;
+		return -1;
+	}
+
+	image_texture image;
+	image.path = path;
+	image.file_index = static_cast<int>(tile_files.size());
+	image.content_hash = fingerprint_bytes(14695981039346656037ull, texels.data(), texels.size() * sizeof(color));
+
+	long long nr_tiles = 0;
+	while (true) {
+		mip_level level;
+		level.width = width;
+		level.height = height;
+		level.tiles_x = (width + texture_tile_size - 1) / texture_tile_size;
+		level.tiles_y = (height + texture_tile_size - 1) / texture_tile_size;
+		level.first_tile = nr_tiles;
+		nr_tiles += static_cast<long long>(level.tiles_x) * level.tiles_y;
+
+		write_level_tiles(tiles->file, texels, level);
+		image.levels.push_back(level);
+
+		if (width == 1 && height == 1) {
+			break;
+		}
+		texels = downsample(texels, width, height, width, height);
+	}
+	std::fflush(tiles->file);
+
+	tile_files.push_back(std::move(tiles));
+	registered_images.push_back(image);
+	return static_cast<int>(registered_images.size()) - 1;
+}
+
+uint64_t image_texture_hash(int image_index) {
+	std::lock_guard<std::mutex> lock(image_registry_mutex);
+	return registered_images[image_index].content_hash;
+}
+
+// Footprints are measured in texture coordinates, the pixel spread over the distance travelled, stretched by grazing angles
+void configure_textures(double footprint_spread, int cache_megabytes) {
+	texture_footprint_spread = footprint_spread;
+
+	size_t capacity = static_cast<size_t>(std::max(cache_megabytes, 1)) * 1024 * 1024 / sizeof(texture_tile);
+	tile_cache.shard_capacity = std::max<size_t>(1, capacity / nr_cache_shards);
+	for (cache_shard& shard : tile_cache.shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.slots.clear();
+		shard.entries.clear();
+		shard.clock_hand = 0;
+		shard.hits = 0;
+		shard.misses = 0;
+	}
+}
+
+double texture_footprint(double distance, double cosine, double uv_density) {
+	return texture_footprint_spread * distance / glm::sqrt(glm::max(glm::abs(cosine), 0.01)) * uv_density;
+}
+
+std::shared_ptr<const texture_tile> read_tile(const image_texture& image, long long tile_index) {
+	std::shared_ptr<texture_tile> tile = std::make_shared<texture_tile>();
+	tile_file& file = *tile_files[image.file_index];
+
+	std::lock_guard<std::mutex> lock(file.mutex);
+	long long offset = tile_index * static_cast<long long>(sizeof(texture_tile));
+#ifdef _WIN32
+	_fseeki64(file.file, offset, SEEK_SET); // Long is 32 bits on Windows
+#else
+	fseeko(file.file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+	if (std::fread(tile.get(), sizeof(texture_tile), 1, file.file) != 1) {
+		std::fill(tile->texels, tile->texels + texture_tile_size * texture_tile_size * 3, 0.0f);
+	}
+	return tile;
+}
+
+// Look up a tile in its shard, misses read the tile outside the lock and then claim a slot, evicting with the clock hand when full
+std::shared_ptr<const texture_tile> fetch_tile(int image_index, long long tile_index) {
+	uint64_t key = (static_cast<uint64_t>(image_index) << 40) | static_cast<uint64_t>(tile_index);
+	if (key == last_tile_key) {
+		return last_tile;
+	}
+
+	cache_shard& shard = tile_cache.shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		std::unordered_map<uint64_t, int>::iterator slot = shard.slots.find(key);
+		if (slot != shard.slots.end()) {
+			cache_entry& entry = shard.entries[slot->second];
+			entry.referenced = true;
+			shard.hits++;
+			last_tile_key = key;
+			last_tile = entry.tile;
+			return last_tile;
+		}
+	}
+
+	std::shared_ptr<const texture_tile> tile = read_tile(registered_images[image_index], tile_index);
+
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.misses++;
+		// Another thread may have loaded the same tile in the meantime
+		if (shard.slots.find(key) == shard.slots.end()) {
+			if (shard.entries.size() < tile_cache.shard_capacity) {
+				shard.slots[key] = static_cast<int>(shard.entries.size());
+				shard.entries.push_back(cache_entry{ key, tile, true });
+			}
+			else {
+				while (shard.entries[shard.clock_hand].referenced) {
+					shard.entries[shard.clock_hand].referenced = false;
+					shard.clock_hand = (shard.clock_hand + 1) % static_cast<int>(shard.entries.size());
+				}
+				cache_entry& victim = shard.entries[shard.clock_hand];
+				shard.slots.erase(victim.key);
+				victim = cache_entry{ key, tile, true };
+				shard.slots[key] = shard.clock_hand;
+				shard.clock_hand = (shard.clock_hand + 1) % static_cast<int>(shard.entries.size());
+			}
+		}
+	}
+
+	last_tile_key = key;
+	last_tile = tile;
+	return tile;
+}
+
+// Texel of a level with repeating wrap around the edges
+color fetch_texel(int image_index, int level_index, int x, int y) {
+	const mip_level& level = registered_images[image_index].levels[level_index];
+	x = ((x % level.width) + level.width) % level.width;
+	y = ((y % level.height) + level.height) % level.height;
+
+	long long tile_index = level.first_tile + static_cast<long long>(y / texture_tile_size) * level.tiles_x + (x / texture_tile_size);
+	std::shared_ptr<const texture_tile> tile = fetch_tile(image_index, tile_index);
+	const float* texel = tile->texels + ((y % texture_tile_size) * texture_tile_size + (x % texture_tile_size)) * 3;
+	return color(texel[0], texel[1], texel[2]);
+}
+
+// Bilinear interpolation between texel centers, v runs up the image
+color bilinear_lookup(int image_index, int level_index, double u, double v) {
+	const mip_level& level = registered_images[image_index].levels[level_index];
+	double x = u * level.width - 0.5;
+	double y = (1.0 - v) * level.height - 0.5;
+	int x0 = static_cast<int>(glm::floor(x));
+	int y0 = static_cast<int>(glm::floor(y));
+	double fx = x - x0;
+	double fy = y - y0;
+
+	return (1.0 - fy) * ((1.0 - fx) * fetch_texel(image_index, level_index, x0, y0) + fx * fetch_texel(image_index, level_index, x0 + 1, y0)) +
+		fy * ((1.0 - fx) * fetch_texel(image_index, level_index, x0, y0 + 1) + fx * fetch_texel(image_index, level_index, x0 + 1, y0 + 1));
+}
+
+// Trilinear filtering, the level is picked so one texel covers the footprint
+color image_lookup(int image_index, double u, double v, double footprint) {
+	const image_texture& image = registered_images[image_index];
+	int max_level = static_cast<int>(image.levels.size()) - 1;
+	double texels_covered = footprint * std::max(image.levels[0].width, image.levels[0].height);
+	double level = glm::clamp(glm::log(glm::max(texels_covered, 1.0)) / glm::log(2.0), 0.0, static_cast<double>(max_level));
+
+	int lower_level = static_cast<int>(level);
+	int upper_level = std::min(lower_level + 1, max_level);
+	double fraction = level - lower_level;
+
+	color lower = bilinear_lookup(image_index, lower_level, u, v);
+	if (fraction <= 0.0 || upper_level == lower_level) {
+		return lower;
+	}
+	return (1.0 - fraction) * lower + fraction * bilinear_lookup(image_index, upper_level, u, v);
+}
+
+// Procedural textures
+
+// Checker squares in texture coordinates, fades to the average color once a footprint spans several squares
+color checker_value(const texture& checker, double u, double v, double footprint) {
+	int sum = static_cast<int>(glm::floor(u * checker.scale)) + static_cast<int>(glm::floor(v * checker.scale));
+	color square = (sum % 2 == 0) ? checker.even_color : checker.odd_color;
+	double blend = glm::clamp(2.0 * footprint * checker.scale - 1.0, 0.0, 1.0);
+	return (1.0 - blend) * square + blend * 0.5 * (checker.even_color + checker.odd_color);
+}
+
+// Marble-like veins of fractal noise in world space, so the pattern runs continuously across faces
+color noise_value(const texture& noise, const point3& point) {
+	point3 scaled = point * noise.scale;
+	double t = 0.5 * (1.0 + glm::sin(scaled.z + 10.0 * fractal_noise(scaled)));
+	return (1.0 - t) * noise.even_color + t * noise.odd_color;
+}
+
+color texture_value(const texture& texture, double u, double v, const point3& point, double footprint) {
+	switch (texture.texture_type) {
+	case CHECKER_TEXTURE:
+		return checker_value(texture, u, v, footprint);
+	case NOISE_TEXTURE:
+		return noise_value(texture, point);
+	case IMAGE_TEXTURE:
+		return image_lookup(texture.image_index, u, v, footprint);
+	default:
+		return texture.odd_color;
+	}
+}
+
+void print_texture_cache_statistics(std::ostream& os) {
+	long long hits = 0;
+	long long misses = 0;
+	for (cache_shard& shard : tile_cache.shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		hits += shard.hits;
+		misses += shard.misses;
+	}
+	if (hits + misses == 0) {
+		return;
+	}
+
+	os << "Texture cache: " << hits + misses << " tile fetches, " << (100.0 * hits) / (hits + misses) << "% served from cache, " << misses << " tiles read from disk" << std::endl;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <ostream>
+#include "util.h"
+
+// Enum for what varies the color of a material over a surface
+enum texture_enum {
+	SOLID_TEXTURE,
+	CHECKER_TEXTURE,
+	NOISE_TEXTURE,
+	IMAGE_TEXTURE
+};
+
+// Texture reference of a material, procedural textures are evaluated inline and image textures index the registered images
+struct texture {
+	texture_enum texture_type = SOLID_TEXTURE; // Solid textures keep the constant material color
+	color even_color = color(0.0, 0.0, 0.0); // Checker squares with an even index sum, the low end of noise
+	color odd_color = color(1.0, 1.0, 1.0); // Checker squares with an odd index sum, the high end of noise
+	double scale = 1.0; // Checker squares per unit of texture coordinates, noise frequency per unit of distance
+	int image_index = -1; // Registered image of image textures
+};
+
+// Texels are stored in square tiles, the unit the cache loads and evicts
+const int texture_tile_size = 32;
+
+// One mip level of an image, its tiles lie back to back in the tile file of the image
+struct mip_level {
+	int width;
+	int height;
+	int tiles_x;
+	int tiles_y;
+	long long first_tile; // Index of the first tile of the level in the tile file
+};
+
+// Image texture kept on disk as a tiled mip pyramid, only the tiles in the cache are in memory
+struct image_texture {
+	std::string path;
+	std::vector<mip_level> levels; // Level 0 is the full resolution image, each level halves the previous one
+	int file_index; // Tile file of the image, opened for reading by the texture cache
+	uint64_t content_hash; // Hash of the full resolution texels, part of the render fingerprint
+};
+
+texture create_checker_texture(const color& even_color, const color& odd_color, double scale);
+texture create_noise_texture(const color& low_color, const color& high_color, double scale);
+texture create_image_texture(const std::string& path);
+
+bool load_image(const std::string& path, int& width, int& height, std::vector<color>& texels);
+int register_image_texture(const std::string& path);
+uint64_t image_texture_hash(int image_index);
+
+void configure_textures(double footprint_spread, int cache_megabytes);
+double texture_footprint(double distance, double cosine, double uv_density);
+color texture_value(const texture& texture, double u, double v, const point3& point, double footprint);
+void print_texture_cache_statistics(std::ostream& os);
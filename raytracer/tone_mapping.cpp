@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstdint>
+#include "tone_mapping.h"
+
+double srgb_encode(double linear) {
+	return (linear <= 0.0031308) ? 12.92 * linear : 1.055 * glm::pow(linear, 1.0 / 2.4) - 0.055;
+}
+
+// Srgb encoded values of [0, 1] in 2^14 steps, linear interpolation between them stays within 2e-6 of the curve, well below a 16 bit step
+const int srgb_table_size = 1 << 14;
+
+const std::vector<float>& srgb_table() {
+	static const std::vector<float> table = []() {
+		std::vector<float> entries(srgb_table_size + 1);
+		for (int k = 0; k <= srgb_table_size; k++) {
+			entries[k] = static_cast<float>(srgb_encode(static_cast<double>(k) / srgb_table_size));
+		}
+		return entries;
+	}();
+	return table;
+}
+
+// 8x8 bayer matrix, thresholds in [0, 64)
+const unsigned char bayer_matrix[8][8] = {
+	{ 0, 32, 8, 40, 2, 34, 10, 42 },
+	{ 48, 16, 56, 24, 50, 18, 58, 26 },
+	{ 12, 44, 4, 36, 14, 46, 6, 38 },
+	{ 60, 28, 52, 20, 62, 30, 54, 22 },
+	{ 3, 35, 11, 43, 1, 33, 9, 41 },
+	{ 51, 19, 59, 27, 49, 17, 57, 25 },
+	{ 15, 47, 7, 39, 13, 45, 5, 37 },
+	{ 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+// The channels of a row of pixels are read as one array of doubles
+static_assert(sizeof(color) == 3 * sizeof(double), "color channels are not contiguous");
+
+// Pixels tone mapped together, their channels stay in the first level cache between the stages
+const int tone_mapping_chunk = 256;
+
+// Tone map rows of pixels into big endian 8 or 16 bit channels, first_row places the rows in the image for the dither pattern
+// Chunks of a row are run through one stage at a time, every stage a branch free loop the compiler vectorizes
+// Only the srgb table lookup is a gather, rows are processed in parallel
+// A value x becomes floor(x * 2^bits), clamped to the largest code, so the defaults write the same bytes as before
+// Dithering offsets that by a bayer threshold in [-0.5, 0.5) of a code, which keeps the mean and breaks up banding
+void tone_map_rows(const std::vector<color>& pixels, int width, int nr_rows, int first_row, double scale, const tone_mapping& settings, std::vector<unsigned char>& bytes) {
+	int bits = (settings.bits == 16) ? 16 : 8;
+	int bytes_per_channel = bits / 8;
+	size_t row_size = static_cast<size_t>(width) * 3;
+	bytes.resize(row_size * nr_rows * bytes_per_channel);
+	const double exposed_scale = scale * glm::pow(2.0, settings.exposure);
+	const double levels = static_cast<double>(1 << bits);
+	const int max_code = (1 << bits) - 1;
+	const std::vector<float>& table = srgb_table();
+
+	parallel_for_rows(nr_rows, [&](int row) {
+		double values[3 * tone_mapping_chunk];
+		for (int chunk_begin = 0; chunk_begin < width; chunk_begin += tone_mapping_chunk) {
+			const int chunk_width = std::min(tone_mapping_chunk, width - chunk_begin);
+			const size_t chunk_size = static_cast<size_t>(chunk_width) * 3;
+			const double* source = &pixels[static_cast<size_t>(row) * width + chunk_begin].x;
+
+			switch (settings.curve) {
+			case REINHARD_CURVE:
+				for (size_t k = 0; k < chunk_size; k++) {
+					double x = std::max(source[k] * exposed_scale, 0.0);
+					values[k] = x / (1.0 + x);
+				}
+			break;
+			case ACES_CURVE:
+				// Narkowicz 2015, the fit expects the radiance scaled by 0.6
+				for (size_t k = 0; k < chunk_size; k++) {
+					double x = std::max(source[k] * exposed_scale, 0.0) * 0.6;
+					values[k] = std::min((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 1.0);
+				}
+			break;
+			default:
+				for (size_t k = 0; k < chunk_size; k++) {
+					values[k] = std::min(std::max(source[k] * exposed_scale, 0.0), 1.0);
+				}
+			break;
+			}
+
+			if (settings.transfer == SRGB_TRANSFER) {
+				for (size_t k = 0; k < chunk_size; k++) {
+					double position = values[k] * srgb_table_size;
+					int index = std::min(static_cast<int>(position), srgb_table_size - 1);
+					double fraction = position - index;
+					values[k] = table[index] + fraction * (table[index + 1] - table[index]);
+				}
+			}
+			else {
+				for (size_t k = 0; k < chunk_size; k++) {
+					values[k] = std::sqrt(values[k]);
+				}
+			}
+
+			// Codes are truncated instead of floored, the values are not negative at this point
+			if (settings.dither) {
+				const unsigned char* thresholds = bayer_matrix[(first_row + row) & 7];
+				for (int pixel = 0; pixel < chunk_width; pixel++) {
+					double offset = (thresholds[(chunk_begin + pixel) & 7] + 0.5) / 64.0 - 0.5;
+					for (int channel = 0; channel < 3; channel++) {
+						values[3 * pixel + channel] = std::max(values[3 * pixel + channel] * levels + offset, 0.0);
+					}
+				}
+			}
+			else {
+				for (size_t k = 0; k < chunk_size; k++) {
+					values[k] *= levels;
+				}
+			}
+
+			unsigned char* destination = &bytes[(row_size * row + 3 * static_cast<size_t>(chunk_begin)) * bytes_per_channel];
+			if (bytes_per_channel == 2) {
+				for (size_t k = 0; k < chunk_size; k++) {
+					int code = std::min(static_cast<int>(values[k]), max_code);
+					destination[2 * k] = static_cast<unsigned char>(code >> 8);
+					destination[2 * k + 1] = static_cast<unsigned char>(code & 0xff);
+				}
+			}
+			else {
+				for (size_t k = 0; k < chunk_size; k++) {
+					destination[k] = static_cast<unsigned char>(std::min(static_cast<int>(values[k]), max_code));
+				}
+			}
+		}
+	});
+}
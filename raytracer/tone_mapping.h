@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include "util.h"
+
+// Enum for the curve that compresses radiance into the displayable range
+enum tone_curve_enum {
+	CLIP_CURVE, // Radiance above 1 is clipped
+	REINHARD_CURVE, // x / (1 + x) per channel, never clips
+	ACES_CURVE // Narkowicz fit of the ACES filmic curve, a toe and a soft shoulder
+};
+
+// Enum for the encoding of the tone mapped values
+enum transfer_enum {
+	GAMMA_2_TRANSFER, // Square root, how images have always been written
+	SRGB_TRANSFER // Exact piecewise srgb curve through a lookup table
+};
+
+// Display conversion of the radiance in the 8 and 16 bit image formats, float maps keep the radiance as it is
+struct tone_mapping {
+	double exposure = 0.0; // Stops the radiance is scaled by before the curve
+	tone_curve_enum curve = CLIP_CURVE;
+	transfer_enum transfer = GAMMA_2_TRANSFER;
+	bool dither = false; // Ordered 8x8 bayer dithering before quantization, hides banding in smooth gradients
+	int bits = 8; // Bits per channel, 8 or 16
+};
+
+double srgb_encode(double linear);
+void tone_map_rows(const std::vector<color>& pixels, int width, int nr_rows, int first_row, double scale, const tone_mapping& settings, std::vector<unsigned char>& bytes);
@@ -1,8 +1,10 @@
 #include <iostream>
 #include <random>
 #include <thread>
+#include <cstdint>
 #include "util.h"
 #include "geometry.h"
+#include "fast_math.h"
 
 double degrees_to_radians(double degrees) {
 	return degrees * pi / 180.0;
@@ -60,17 +62,21 @@ glm::dvec3 random_cosine_direction() {
 	double r2 = random_double();
 	double z = glm::sqrt(1.0 - r2);
 	double phi = 2 * pi * r1;
-	double x = glm::cos(phi) * glm::sqrt(r2);
-	double y = glm::sin(phi) * glm::sqrt(r2);
+	double sin_phi, cos_phi;
+	fast_sincos(phi, sin_phi, cos_phi);
+	double x = cos_phi * glm::sqrt(r2);
+	double y = sin_phi * glm::sqrt(r2);
 	return glm::dvec3(x, y, z);
 }
 
-bool contains(interval i, double x) {
-	return i.min <= x && x <= i.max;
-}
-
-bool surrounds(interval i, double x) {
-	return i.min < x && x < i.max;
+// Uniformly distributed direction on the unit sphere
+glm::dvec3 random_unit_vector() {
+	double z = 1.0 - 2.0 * random_double();
+	double r = glm::sqrt(glm::max(0.0, 1.0 - z * z));
+	double phi = 2.0 * pi * random_double();
+	double sin_phi, cos_phi;
+	fast_sincos(phi, sin_phi, cos_phi);
+	return glm::dvec3(r * cos_phi, r * sin_phi, z);
 }
 
 glm::dvec3 local_coord(onb onb, double a, double b, double c) {
@@ -78,7 +84,7 @@ glm::dvec3 local_coord(onb onb, double a, double b, double c) {
 }
 
 glm::dvec3 local_coord(onb onb, glm::dvec3 a) {
-	return a.x * onb.u + a.y * onb.u + a.z * onb.w;
+	return a.x * onb.u + a.y * onb.v + a.z * onb.w;
 }
 
 onb build_onb_from_w(const glm::dvec3 normal) {
@@ -93,4 +99,47 @@ onb build_onb_from_w(const glm::dvec3 normal) {
 std::ostream& print_vector(std::ostream& os, glm::dvec3 vector) {
 	os << "(" << vector.x << ", " << vector.y << ", " << vector.z << ")";
 	return os;
+}
+
+// Hashed value noise in [-1, 1] with smooth interpolation between lattice points
+double lattice_value(int x, int y, int z) {
+	uint32_t hash = static_cast<uint32_t>(x) * 73856093u ^ static_cast<uint32_t>(y) * 19349663u ^ static_cast<uint32_t>(z) * 83492791u;
+	hash = (hash ^ (hash >> 13)) * 1274126177u;
+	hash = hash ^ (hash >> 16);
+	return static_cast<double>(hash & 0xffffff) / static_cast<double>(0x7fffff) - 1.0;
+}
+
+double value_noise(const point3& point) {
+	int x = static_cast<int>(glm::floor(point.x));
+	int y = static_cast<int>(glm::floor(point.y));
+	int z = static_cast<int>(glm::floor(point.z));
+	glm::dvec3 fraction = point - glm::dvec3(x, y, z);
+	glm::dvec3 fade = fraction * fraction * (3.0 - 2.0 * fraction);
+
+	double value = 0.0;
+	for (int corner = 0; corner < 8; corner++) {
+		int dx = corner & 1;
+		int dy = (corner >> 1) & 1;
+		int dz = (corner >> 2) & 1;
+		double weight = (dx ? fade.x : 1.0 - fade.x) * (dy ? fade.y : 1.0 - fade.y) * (dz ? fade.z : 1.0 - fade.z);
+		value += weight * lattice_value(x + dx, y + dy, z + dz);
+	}
+	return value;
+}
+
+// Sum of four octaves of value noise, normalized back to [-1, 1]
+double fractal_noise(const point3& point) {
+	double value = 0.0;
+	double amplitude = 1.0;
+	double frequency = 1.0;
+	double total_amplitude = 0.0;
+
+	for (int octave = 0; octave < 4; octave++) {
+		value += amplitude * value_noise(point * frequency);
+		total_amplitude += amplitude;
+		amplitude *= 0.5;
+		frequency *= 2.0;
+	}
+
+	return value / total_amplitude;
 }
\ No newline at end of file
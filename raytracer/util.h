@@ -9,6 +9,9 @@
 #include <thread>
 #include <chrono>
 #include <functional>
+#include <vector>
+#include <future>
+#include <algorithm>
 #include "glm.hpp"
 #include "gtc/random.hpp"
 #include "gtc/constants.hpp"
@@ -19,10 +22,13 @@ using point3 = glm::dvec3;
 using color = glm::dvec3;
 static std::mt19937 generator;
 
-struct interval {
-	double min = +infinity;
-	double max = -infinity;
+// Intervals are templated on their scalar type like rays, single precision tracing uses float intervals
+template <typename scalar>
+struct basic_interval {
+	scalar min = +std::numeric_limits<scalar>::infinity();
+	scalar max = -std::numeric_limits<scalar>::infinity();
 };
+using interval = basic_interval<double>;
 
 struct onb {
 	glm::dvec3 u;
@@ -40,11 +46,41 @@ int random_int(int min, int max);
 void re_seed_random_generator();
 point3 random_point_in_unit_disk();
 glm::dvec3 random_cosine_direction();
-bool contains(interval i, double x);
-bool surrounds(interval i, double x);
+glm::dvec3 random_unit_vector();
+double value_noise(const point3& point);
+double fractal_noise(const point3& point);
 
 glm::dvec3 local_coord(onb onb, double a, double b, double c);
 glm::dvec3 local_coord(onb onb, glm::dvec3 a);
 onb build_onb_from_w(const glm::dvec3 normal);
 
-std::ostream& print_vector(std::ostream& os, glm::dvec3 vector);
\ No newline at end of file
+template <typename scalar>
+bool contains(basic_interval<scalar> i, scalar x) {
+	return i.min <= x && x <= i.max;
+}
+
+template <typename scalar>
+bool surrounds(basic_interval<scalar> i, scalar x) {
+	return i.min < x && x < i.max;
+}
+
+std::ostream& print_vector(std::ostream& os, glm::dvec3 vector);
+
+// Rows split into one contiguous band per hardware thread, each band processed asynchronously
+template <typename row_function>
+void parallel_for_rows(int height, row_function function) {
+	int nr_bands = std::max(1, std::min(height, static_cast<int>(std::thread::hardware_concurrency())));
+	std::vector<std::future<void>> futures;
+	for (int band = 0; band < nr_bands; band++) {
+		int row_begin = height * band / nr_bands;
+		int row_end = height * (band + 1) / nr_bands;
+		futures.emplace_back(std::async(std::launch::async, [=]() {
+			for (int row = row_begin; row < row_end; row++) {
+				function(row);
+			}
+		}));
+	}
+	for (std::future<void>& future : futures) {
+		future.wait();
+	}
+}
\ No newline at end of file
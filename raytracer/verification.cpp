@@ -0,0 +1,113 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "verification.h"
+#include "environment.h"
+#include "fast_math.h"
+
+// Root mean square difference of the channels clamped to the displayable range, so lights and fireflies don't outweigh the rest of the image
+double image_rmse(const std::vector<color>& a, const std::vector<color>& b) {
+	double sum = 0.0;
+	for (size_t k = 0; k < a.size(); k++) {
+		for (int channel = 0; channel < 3; channel++) {
+			double difference = std::min(std::max(a[k][channel], 0.0), 1.0) - std::min(std::max(b[k][channel], 0.0), 1.0);
+			sum += difference * difference;
+		}
+	}
+	return std::sqrt(sum / (3.0 * static_cast<double>(std::max<size_t>(a.size(), 1))));
+}
+
+// Render to output.pfm and read the linear image back
+bool render_linear_image(camera camera, std::vector<color>& pixels) {
+	camera.output_format = PFM_IMAGE;
+	render(camera);
+	int width, height;
+	return load_pfm("output.pfm", width, height, pixels);
+}
+
+bool verify_against_reference(const char* name, const camera& reference, const camera& mode, double tolerance) {
+	std::vector<color> first_reference, second_reference, mode_image;
+	if (!render_linear_image(reference, first_reference) || !render_linear_image(reference, second_reference) || !render_linear_image(mode, mode_image) || mode_image.size() != first_reference.size()) {
+		std::cout << name << ": failed to render the images" << std::endl;
+		return false;
+	}
+	double noise = image_rmse(first_reference, second_reference);
+	double difference = image_rmse(first_reference, mode_image);
+	bool passed = difference <= (1.0 + tolerance) * noise;
+	std::cout << name << ": rmse " << difference << " against the reference, " << noise << " between two reference renders, " << (passed ? "passed" : "FAILED") << std::endl;
+	return passed;
+}
+
+// The cornell box with colored sphere lights and a glass sphere, lit directly, through glass and with caustics
+camera verification_camera() {
+	camera camera;
+	camera.scene_file = "scenes/cornell_box_lights.scene";
+	camera.image_width = 32;
+	camera.samples_per_pixel = 256;
+	camera.max_depth = 10;
+	return camera;
+}
+
+bool verify_single_precision(double tolerance) {
+	camera reference = verification_camera();
+	camera mode = reference;
+	mode.single_precision = true;
+	return verify_against_reference("Single precision tracing", reference, mode, tolerance);
+}
+
+bool verify_fast_math(double tolerance) {
+	camera reference = verification_camera();
+	reference.fast_math = false;
+	camera mode = reference;
+	mode.fast_math = true;
+	return verify_against_reference("Fast math", reference, mode, tolerance);
+}
+
+bool run_verification() {
+	bool passed = verify_single_precision();
+	passed = verify_fast_math() && passed;
+	std::cout << (passed ? "All checks passed" : "Some checks FAILED") << std::endl;
+	return passed;
+}
+
+// Nanoseconds per call of a function over the inputs, the results are summed so the calls aren't optimized away
+template <typename function>
+double nanoseconds_per_call(const std::vector<double>& inputs, function evaluate, double& sum) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (double input : inputs) {
+		sum += evaluate(input);
+	}
+	std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() / static_cast<double>(inputs.size());
+}
+
+// Inputs are drawn over the domain each approximation documents, its largest error is measured over the same inputs
+template <typename approximation, typename reference>
+void benchmark_function(std::ostream& os, const char* name, const std::vector<double>& inputs, approximation fast, reference library) {
+	double sum = 0.0;
+	double library_time = nanoseconds_per_call(inputs, library, sum);
+	double fast_time = nanoseconds_per_call(inputs, fast, sum);
+	double largest_error = 0.0;
+	for (double input : inputs) {
+		largest_error = std::max(largest_error, std::abs(fast(input) - library(input)));
+	}
+	os << name << ": " << fast_time << " ns against " << library_time << " ns for the standard library, largest error " << largest_error << " (checksum " << sum << ")" << std::endl;
+}
+
+void benchmark_fast_math(std::ostream& os) {
+	const size_t nr_inputs = 1 << 22;
+	std::mt19937_64 generator(1);
+	std::uniform_real_distribution<double> angles(-1e4, 1e4), cosines(-1.0, 1.0);
+	std::vector<double> angle_inputs(nr_inputs), cosine_inputs(nr_inputs);
+	for (size_t k = 0; k < nr_inputs; k++) {
+		angle_inputs[k] = angles(generator);
+		cosine_inputs[k] = cosines(generator);
+	}
+
+	bool enabled = fast_math_enabled();
+	configure_fast_math(true);
+	benchmark_function(os, "sin and cos", angle_inputs, [](double x) { double sine, cosine; fast_sincos(x, sine, cosine); return sine + cosine; }, [](double x) { return std::sin(x) + std::cos(x); });
+	benchmark_function(os, "acos", cosine_inputs, [](double x) { return fast_acos(x); }, [](double x) { return std::acos(x); });
+	configure_fast_math(enabled);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include <ostream>
+#include "util.h"
+#include "camera.h"
+
+// Self-checks of the render modes that trade precision for speed, run by starting the program with --verify
+// Each check renders a small scene with the mode on and off, a render is noisy so the reference mode is also rendered a second time
+// The mode passes when its difference from the reference stays within the tolerance of the noise between the two reference renders
+
+double image_rmse(const std::vector<color>& a, const std::vector<color>& b);
+bool render_linear_image(camera camera, std::vector<color>& pixels);
+bool verify_against_reference(const char* name, const camera& reference, const camera& mode, double tolerance);
+bool verify_single_precision(double tolerance = 0.25);
+bool verify_fast_math(double tolerance = 0.25);
+bool run_verification();
+
+// Speed and largest error of the fast math approximations against the standard library, printed when the program is started with --benchmark
+void benchmark_fast_math(std::ostream& os);
@@ -0,0 +1,461 @@
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "volume.h"
+#include "geometry.h"
+#include "geometry_util.h"
+#include "ray.h"
+#include "util.h"
+#include "glm.hpp"
+
+// Participating media
+// A medium is a boundary geometry with a density, optionally scaled by a density grid over its bounds
+// All media a ray passes through are tracked together with delta tracking against the sum of their majorants
+// Density grids keep a majorant per brick of cells, so empty bricks are skipped without a single density lookup
+
+// Density grids
+
+// Cell value of a grid, cells outside the grid and in bricks left out of sparse grids are empty
+float grid_cell(const density_grid& grid, int x, int y, int z) {
+	if (x < 0 || y < 0 || z < 0 || x >= grid.resolution[0] || y >= grid.resolution[1] || z >= grid.resolution[2]) {
+		return 0.0f;
+	}
+
+	int brick_index = ((z / brick_size) * grid.bricks[1] + (y / brick_size)) * grid.bricks[0] + (x / brick_size);
+	int offset = grid.brick_offsets[brick_index];
+	if (offset < 0) {
+		return 0.0f;
+	}
+
+	return grid.densities[offset + ((z % brick_size) * brick_size + (y % brick_size)) * brick_size + (x % brick_size)];
+}
+
+// Bricks a dense array of cells, x varies fastest, sparse grids only store bricks with at least one non-empty cell
+density_grid build_density_grid(const std::vector<float>& cells, const int resolution[3], const point3& lower, const point3& upper, bool sparse) {
+	density_grid grid;
+	grid.lower = lower;
+	grid.upper = upper;
+
+	for (int axis = 0; axis < 3; axis++) {
+		grid.resolution[axis] = resolution[axis];
+		grid.bricks[axis] = (resolution[axis] + brick_size - 1) / brick_size;
+	}
+
+	int nr_bricks = grid.bricks[0] * grid.bricks[1] * grid.bricks[2];
+	int brick_cells = brick_size * brick_size * brick_size;
+	grid.brick_offsets.assign(nr_bricks, -1);
+
+	for (int bz = 0; bz < grid.bricks[2]; bz++) {
+		for (int by = 0; by < grid.bricks[1]; by++) {
+			for (int bx = 0; bx < grid.bricks[0]; bx++) {
+				std::vector<float> brick(brick_cells, 0.0f);
+				bool empty = true;
+
+				for (int z = 0; z < brick_size; z++) {
+					for (int y = 0; y < brick_size; y++) {
+						for (int x = 0; x < brick_size; x++) {
+							int cx = bx * brick_size + x;
+							int cy = by * brick_size + y;
+							int cz = bz * brick_size + z;
+							if (cx >= resolution[0] || cy >= resolution[1] || cz >= resolution[2]) {
+								continue;
+							}
+
+							float value = cells[(cz * resolution[1] + cy) * resolution[0] + cx];
+							brick[(z * brick_size + y) * brick_size + x] = value;
+							empty = empty && value <= 0.0f;
+						}
+					}
+				}
+
+				if (sparse && empty) {
+					continue;
+				}
+
+				grid.brick_offsets[(bz * grid.bricks[1] + by) * grid.bricks[0] + bx] = static_cast<int>(grid.densities.size());
+				grid.densities.insert(grid.densities.end(), brick.begin(), brick.end());
+			}
+		}
+	}
+
+	// Interpolation inside a brick reaches one cell into the neighbouring bricks
+	grid.brick_majorants.assign(nr_bricks, 0.0f);
+	for (int bz = 0; bz < grid.bricks[2]; bz++) {
+		for (int by = 0; by < grid.bricks[1]; by++) {
+			for (int bx = 0; bx < grid.bricks[0]; bx++) {
+				float majorant = 0.0f;
+				for (int z = bz * brick_size - 1; z <= (bz + 1) * brick_size; z++) {
+					for (int y = by * brick_size - 1; y <= (by + 1) * brick_size; y++) {
+						for (int x = bx * brick_size - 1; x <= (bx + 1) * brick_size; x++) {
+							majorant = std::max(majorant, grid_cell(grid, x, y, z));
+						}
+					}
+				}
+				grid.brick_majorants[(bz * grid.bricks[1] + by) * grid.bricks[0] + bx] = majorant;
+			}
+		}
+	}
+
+	return grid;
+}
+
+// Trilinear interpolation between cell centers
+double grid_density(const density_grid& grid, const point3& point) {
+	glm::dvec3 extent = grid.upper - grid.lower;
+	double coordinates[3];
+	int cell[3];
+	double fraction[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+		coordinates[axis] = (point[axis] - grid.lower[axis]) / extent[axis] * static_cast<double>(grid.resolution[axis]) - 0.5;
+		cell[axis] = static_cast<int>(glm::floor(coordinates[axis]));
+		fraction[axis] = coordinates[axis] - static_cast<double>(cell[axis]);
+	}
+
+	double density = 0.0;
+	for (int corner = 0; corner < 8; corner++) {
+		int dx = corner & 1;
+		int dy = (corner >> 1) & 1;
+		int dz = (corner >> 2) & 1;
+		double weight = (dx ? fraction[0] : 1.0 - fraction[0]) * (dy ? fraction[1] : 1.0 - fraction[1]) * (dz ? fraction[2] : 1.0 - fraction[2]);
+		density += weight * grid_cell(grid, cell[0] + dx, cell[1] + dy, cell[2] + dz);
+	}
+
+	return density;
+}
+
+// Signed distance to the boundary geometry of a medium, exact for spheres and a lower bound for cubes
+double boundary_distance(const scene_object& medium, const point3& point) {
+	if (medium.object_type == SPHERE) {
+		return glm::length(point - medium.sphere_center) - medium.sphere_radius;
+	}
+
+	// Cubes are convex, so the distance is the largest distance to any face plane
+	double distance = -infinity;
+	for (int i = 0; i < medium.nr_cube_triangles; i++) {
+		const triangle& face = medium.cube_triangles[i];
+		glm::dvec3 normal = (glm::dot(face.normal, face.vertices[0] - medium.cube_center) < 0.0) ? -face.normal : face.normal;
+		distance = std::max(distance, glm::dot(normal, point - face.vertices[0]));
+	}
+	return distance;
+}
+
+// Axis aligned bounds of the boundary geometry of a medium
+void boundary_bounds(const scene_object& medium, point3& lower, point3& upper) {
+	if (medium.object_type == SPHERE) {
+		glm::dvec3 radius = glm::dvec3(medium.sphere_radius, medium.sphere_radius, medium.sphere_radius);
+		lower = medium.sphere_center - radius;
+		upper = medium.sphere_center + radius;
+		return;
+	}
+
+	lower = point3(infinity, infinity, infinity);
+	upper = point3(-infinity, -infinity, -infinity);
+	for (int i = 0; i < medium.nr_cube_triangles; i++) {
+		for (int v = 0; v < 3; v++) {
+			lower = glm::min(lower, medium.cube_triangles[i].vertices[v]);
+			upper = glm::max(upper, medium.cube_triangles[i].vertices[v]);
+		}
+	}
+}
+
+// Irregular version of a medium, its boundary is displaced by fractal noise with an amplitude of jitter times its size
+// Cells fade out over two cells at the displaced boundary and the density inside varies with a second noise lookup
+std::shared_ptr<const density_grid> create_jittered_density_grid(const scene_object& medium, double jitter, int resolution) {
+	point3 lower, upper;
+	boundary_bounds(medium, lower, upper);
+
+	double size = 0.5 * glm::length(upper - lower) / glm::sqrt(3.0);
+	double amplitude = jitter * size;
+	glm::dvec3 margin = glm::dvec3(amplitude, amplitude, amplitude);
+	lower -= margin;
+	upper += margin;
+
+	glm::dvec3 extent = upper - lower;
+	double longest = std::max(extent.x, std::max(extent.y, extent.z));
+	int grid_resolution[3];
+	for (int axis = 0; axis < 3; axis++) {
+		grid_resolution[axis] = std::max(1, static_cast<int>(glm::ceil(resolution * extent[axis] / longest)));
+	}
+
+	double cell_size = longest / static_cast<double>(resolution);
+	double frequency = 2.0 / size;
+	std::vector<float> cells(grid_resolution[0] * grid_resolution[1] * grid_resolution[2], 0.0f);
+
+	for (int z = 0; z < grid_resolution[2]; z++) {
+		for (int y = 0; y < grid_resolution[1]; y++) {
+			for (int x = 0; x < grid_resolution[0]; x++) {
+				point3 cell_center = lower + glm::dvec3((x + 0.5) * extent.x / grid_resolution[0], (y + 0.5) * extent.y / grid_resolution[1], (z + 0.5) * extent.z / grid_resolution[2]);
+				double distance = boundary_distance(medium, cell_center) + amplitude * fractal_noise(cell_center * frequency);
+				double coverage = glm::clamp(-distance / (2.0 * cell_size), 0.0, 1.0);
+				double variation = 0.75 + 0.25 * fractal_noise(cell_center * (2.0 * frequency) + glm::dvec3(17.0, 31.0, 47.0));
+				cells[(z * grid_resolution[1] + y) * grid_resolution[0] + x] = static_cast<float>(coverage * variation);
+			}
+		}
+	}
+
+	return std::make_shared<const density_grid>(build_density_grid(cells, grid_resolution, lower, upper, true));
+}
+
+// Boundary intervals
+
+// Slab test against axis aligned bounds
+bool box_interval(const ray& ray, const point3& lower, const point3& upper, double& enter, double& exit) {
+	enter = -infinity;
+	exit = infinity;
+	for (int axis = 0; axis < 3; axis++) {
+		if (ray.direction[axis] == 0.0) {
+			if (ray.origin[axis] < lower[axis] || ray.origin[axis] > upper[axis]) {
+				return false;
+			}
+			continue;
+		}
+
+		double t0 = (lower[axis] - ray.origin[axis]) / ray.direction[axis];
+		double t1 = (upper[axis] - ray.origin[axis]) / ray.direction[axis];
+		enter = std::max(enter, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+	return enter < exit;
+}
+
+// Entry and exit ray times of the whole line through the boundary of a medium, found in one pass over the geometry
+// Media with a density grid are bounded by the grid, irregular shapes reach outside their boundary geometry
+bool medium_boundary_interval(const ray& ray, const scene_object& medium, double& enter, double& exit) {
+	if (medium.medium_grid) {
+		return box_interval(ray, medium.medium_grid->lower, medium.medium_grid->upper, enter, exit);
+	}
+
+	switch (medium.object_type) {
+	case SPHERE: {
+		glm::dvec3 oc = ray.origin - medium.sphere_center;
+		double a = glm::dot(ray.direction, ray.direction);
+		double half_b = glm::dot(oc, ray.direction);
+		double c = glm::dot(oc, oc) - medium.sphere_radius * medium.sphere_radius;
+		double discriminant = half_b * half_b - a * c;
+		if (discriminant <= 0.0) {
+			return false;
+		}
+
+		double sqrtd = glm::sqrt(discriminant);
+		enter = (-half_b - sqrtd) / a;
+		exit = (-half_b + sqrtd) / a;
+		return true;
+	}
+	case CUBE:
+	case ASYMMETRIC_CUBE: {
+		// Cubes are convex, so the line enters at the first and leaves at the last triangle it crosses
+		enter = infinity;
+		exit = -infinity;
+		for (int i = 0; i < medium.nr_cube_triangles; i++) {
+			double time;
+			if (triangle_line_intersection(ray, medium.cube_triangles[i], time)) {
+				enter = std::min(enter, time);
+				exit = std::max(exit, time);
+			}
+		}
+		return enter < exit;
+	}
+	default:
+		// Quads have no inside
+		return false;
+	}
+}
+
+double medium_density(const scene_object& medium, const point3& point) {
+	if (medium.medium_grid) {
+		return medium.density * grid_density(*medium.medium_grid, point);
+	}
+	return medium.density;
+}
+
+// Constant media are bounded by their density over the whole interval, grid media by the majorant of each brick the ray passes
+// Bricks are walked with a 3D DDA and empty bricks produce no segment at all
+void collect_majorant_segments(const ray& ray, const scene_object& medium, const medium_interval& span, std::vector<majorant_segment>& segments) {
+	if (!medium.medium_grid) {
+		segments.push_back(majorant_segment{ span.object_index, span.enter, span.exit, medium.density });
+		return;
+	}
+
+	const density_grid& grid = *medium.medium_grid;
+	glm::dvec3 brick_extent;
+	for (int axis = 0; axis < 3; axis++) {
+		brick_extent[axis] = (grid.upper[axis] - grid.lower[axis]) * brick_size / static_cast<double>(grid.resolution[axis]);
+	}
+
+	point3 start = ray_at(ray, span.enter);
+	int brick[3];
+	int step[3];
+	double next_time[3];
+	double delta_time[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+		brick[axis] = glm::clamp(static_cast<int>(glm::floor((start[axis] - grid.lower[axis]) / brick_extent[axis])), 0, grid.bricks[axis] - 1);
+
+		if (ray.direction[axis] > 0.0) {
+			step[axis] = 1;
+			next_time[axis] = (grid.lower[axis] + (brick[axis] + 1) * brick_extent[axis] - ray.origin[axis]) / ray.direction[axis];
+			delta_time[axis] = brick_extent[axis] / ray.direction[axis];
+		}
+		else if (ray.direction[axis] < 0.0) {
+			step[axis] = -1;
+			next_time[axis] = (grid.lower[axis] + brick[axis] * brick_extent[axis] - ray.origin[axis]) / ray.direction[axis];
+			delta_time[axis] = -brick_extent[axis] / ray.direction[axis];
+		}
+		else {
+			step[axis] = 0;
+			next_time[axis] = infinity;
+			delta_time[axis] = infinity;
+		}
+	}
+
+	double time = span.enter;
+	while (time < span.exit) {
+		int axis = (next_time[0] < next_time[1]) ? ((next_time[0] < next_time[2]) ? 0 : 2) : ((next_time[1] < next_time[2]) ? 1 : 2);
+		double end = std::min(next_time[axis], span.exit);
+
+		double majorant = grid.brick_majorants[(brick[2] * grid.bricks[1] + brick[1]) * grid.bricks[0] + brick[0]] * medium.density;
+		if (majorant > 0.0 && end > time) {
+			segments.push_back(majorant_segment{ span.object_index, time, end, majorant });
+		}
+
+		time = end;
+		brick[axis] += step[axis];
+		next_time[axis] += delta_time[axis];
+		if (brick[axis] < 0 || brick[axis] >= grid.bricks[axis]) {
+			break;
+		}
+	}
+}
+
+// Tracking
+
+// Sum of the majorants of all segments covering the time and the next time that sum changes
+double combined_majorant(const std::vector<majorant_segment>& segments, double time, double& next_change) {
+	double majorant = 0.0;
+	next_change = infinity;
+	for (const majorant_segment& segment : segments) {
+		if (segment.begin <= time && time < segment.end) {
+			majorant += segment.majorant;
+			next_change = std::min(next_change, segment.end);
+		}
+		else if (segment.begin > time) {
+			next_change = std::min(next_change, segment.begin);
+		}
+	}
+	return majorant;
+}
+
+// Delta tracking through all media along the ray at once
+// Tentative collisions are sampled against the summed majorant, a collision is real with probability density over majorant
+// and then belongs to each medium in proportion to its density, so overlapping media share one distance sample
+bool sample_medium_collision(const ray& ray, const std::vector<medium_interval>& intervals, const std::vector<scene_object>& scene_objects, hit_record& rec) {
+	static thread_local std::vector<majorant_segment> segments;
+	segments.clear();
+
+	for (const medium_interval& span : intervals) {
+		collect_majorant_segments(ray, scene_objects[span.object_index], span, segments);
+	}
+
+	double ray_length = glm::length(ray.direction);
+	double time = infinity;
+	for (const majorant_segment& segment : segments) {
+		time = std::min(time, segment.begin);
+	}
+
+	while (time < infinity) {
+		double next_change;
+		double majorant = combined_majorant(segments, time, next_change);
+		if (next_change == infinity) {
+			return false;
+		}
+
+		if (majorant <= 0.0) {
+			time = next_change;
+			continue;
+		}
+
+		// Densities are per unit distance, the ray direction isn't necessarily normalized
+		double distance = -glm::log(1.0 - random_double()) / majorant;
+		if (time + distance / ray_length >= next_change) {
+			time = next_change;
+			continue;
+		}
+
+		time += distance / ray_length;
+		point3 point = ray_at(ray, time);
+
+		double threshold = random_double() * majorant;
+		for (const majorant_segment& segment : segments) {
+			if (segment.begin <= time && time < segment.end) {
+				threshold -= medium_density(scene_objects[segment.object_index], point);
+				if (threshold < 0.0) {
+					const scene_object& medium = scene_objects[segment.object_index];
+					hit_record collision;
+					collision.time = time;
+					collision.point = point;
+					collision.normal = -glm::normalize(ray.direction);
+					collision.outward_face = true;
+					collision.object_index = segment.object_index;
+					set_hit_material(collision, medium);
+					rec = collision;
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+// Ratio tracking estimate of the transmittance of all media along the ray, surfaces aren't considered
+double medium_transmittance(const ray& ray, interval ray_time, const std::vector<scene_object>& scene_objects) {
+	static thread_local std::vector<majorant_segment> segments;
+	segments.clear();
+
+	for (int i = 0; i < static_cast<int>(scene_objects.size()); i++) {
+		double enter, exit;
+		if (scene_objects[i].constant_density_medium && medium_boundary_interval(ray, scene_objects[i], enter, exit)) {
+			medium_interval span = { i, std::max(enter, ray_time.min), std::min(exit, ray_time.max) };
+			if (span.enter < span.exit) {
+				collect_majorant_segments(ray, scene_objects[i], span, segments);
+			}
+		}
+	}
+
+	double ray_length = glm::length(ray.direction);
+	double transmittance = 1.0;
+	double time = ray_time.min;
+
+	while (transmittance > 0.0) {
+		double next_change;
+		double majorant = combined_majorant(segments, time, next_change);
+		if (next_change == infinity) {
+			break;
+		}
+
+		if (majorant <= 0.0) {
+			time = next_change;
+			continue;
+		}
+
+		double distance = -glm::log(1.0 - random_double()) / majorant;
+		if (time + distance / ray_length >= next_change) {
+			time = next_change;
+			continue;
+		}
+
+		time += distance / ray_length;
+		point3 point = ray_at(ray, time);
+
+		double density = 0.0;
+		for (const majorant_segment& segment : segments) {
+			if (segment.begin <= time && time < segment.end) {
+				density += medium_density(scene_objects[segment.object_index], point);
+			}
+		}
+		transmittance *= 1.0 - density / majorant;
+	}
+
+	return std::max(transmittance, 0.0);
+}
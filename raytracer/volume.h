@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "util.h"
+#include "geometry.h"
+
+// Cells of density grids are stored in cubic bricks with this many cells per side
+const int brick_size = 8;
+
+// Heterogeneous density over an axis aligned box, scales the density of the medium it belongs to
+struct density_grid {
+	point3 lower;
+	point3 upper;
+	int resolution[3]; // Cells per axis
+	int bricks[3]; // Bricks per axis
+	std::vector<int> brick_offsets; // Offset of each brick into densities, -1 for empty bricks left out of sparse grids
+	std::vector<float> densities; // Cells of the stored bricks, brick after brick
+	std::vector<float> brick_majorants; // Largest density inside each brick, including the neighbouring cells interpolation reaches
+};
+
+// Part of a ray inside the boundary of a medium, in ray time
+struct medium_interval {
+	int object_index;
+	double enter;
+	double exit;
+};
+
+// Part of a ray over which the density of one medium stays below a majorant
+struct majorant_segment {
+	int object_index;
+	double begin;
+	double end;
+	double majorant;
+};
+
+density_grid build_density_grid(const std::vector<float>& cells, const int resolution[3], const point3& lower, const point3& upper, bool sparse);
+double grid_density(const density_grid& grid, const point3& point);
+std::shared_ptr<const density_grid> create_jittered_density_grid(const scene_object& medium, double jitter, int resolution = 64);
+
+bool medium_boundary_interval(const ray& ray, const scene_object& medium, double& enter, double& exit);
+double medium_density(const scene_object& medium, const point3& point);
+void collect_majorant_segments(const ray& ray, const scene_object& medium, const medium_interval& span, std::vector<majorant_segment>& segments);
+
+bool sample_medium_collision(const ray& ray, const std::vector<medium_interval>& intervals, const std::vector<scene_object>& scene_objects, hit_record& rec);
+double medium_transmittance(const ray& ray, interval ray_time, const std::vector<scene_object>& scene_objects);